@@ -4,10 +4,21 @@
 #include "tachy_calc_cache.h"
 #include "tachy_vector.h"
 #include "tachy_iota_engine.h"
+#include "tachy_generator_engine.h"
+#include "tachy_random_engine.h"
+#include "tachy_scenario_scalar.h"
+#include "tachy_sobol_directions.h"
+#include "tachy_sobol_sequence.h"
+#include "tachy_brownian_bridge.h"
+#include "tachy_short_rate_scenario.h"
 #include "tachy_expression.h"
 #include "tachy_static_functor_engine.h"
+#include "tachy_vector_tie.h"
+#include "tachy_rolling_window_engine.h"
 #include "tachy_linear_spline_uniform.h"
 #include "tachy_linear_spline_uniform_index.h"
+#include "tachy_linear_spline_bank_uniform_index.h"
 #include "tachy_mod_linear_spline_uniform.h"
+#include "tachy_bilinear_surface_uniform_index.h"
 
 #endif // TACHY_H__INCLUDED
@@ -305,6 +305,10 @@ namespace tachy
             {
                   return x*y + c;
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return x*y - c;
+            }
       };
 
       template <> struct arch_traits<float, ARCH_IA_SSE>
@@ -485,6 +489,10 @@ namespace tachy
             {
                   return add(mul(x, y), c);
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return sub(mul(x, y), c);
+            }
 #endif
       };
 
@@ -624,6 +632,10 @@ namespace tachy
             {
                   return add(mul(x, y), c);
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return sub(mul(x, y), c);
+            }
 #endif
       };
 
@@ -789,6 +801,10 @@ namespace tachy
             {
                   return add(mul(x, y), c);
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return sub(mul(x, y), c);
+            }
 #endif
       };
 
@@ -962,22 +978,26 @@ namespace tachy
             }
             static inline packed_t gather(const scalar_t* s, const index_t& i)
             {
-                  return _mm256_setr_pd(s[((int*)(&i))[0]],
-                                        s[((int*)(&i))[1]],
-                                        s[((int*)(&i))[2]],
-                                        s[((int*)(&i))[3]]);
+                  return _mm256_setr_pd(s[_mm_extract_epi32(i, 0)],
+                                        s[_mm_extract_epi32(i, 1)],
+                                        s[_mm_extract_epi32(i, 2)],
+                                        s[_mm_extract_epi32(i, 3)]);
             }
             static inline index_t igather(const int* is, const index_t& i)
             {
-                  return _mm_setr_epi32(is[((int*)(&i))[0]],
-                                        is[((int*)(&i))[1]],
-                                        is[((int*)(&i))[2]],
-                                        is[((int*)(&i))[3]]);
+                  return _mm_setr_epi32(is[_mm_extract_epi32(i, 0)],
+                                        is[_mm_extract_epi32(i, 1)],
+                                        is[_mm_extract_epi32(i, 2)],
+                                        is[_mm_extract_epi32(i, 3)]);
             }
             static inline packed_t fmadd(const packed_t x, const packed_t y, const packed_t c)
             {
                   return add(mul(x, y), c);
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return sub(mul(x, y), c);
+            }
 #endif
       };
 
@@ -1003,6 +1023,10 @@ namespace tachy
             {
                   return _mm256_fmadd_pd(x, y, c);
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return _mm256_fmsub_pd(x, y, c);
+            }
 #endif
       };
 
@@ -1013,6 +1037,10 @@ namespace tachy
             {
                   return _mm256_fmadd_pd(x, y, c);
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return _mm256_fmsub_pd(x, y, c);
+            }
 #endif
       };
 
@@ -1232,8 +1260,48 @@ namespace tachy
             {
                   return add(mul(x, y), c);
             }
+            static inline packed_t fmsub(const packed_t x, const packed_t y, const packed_t c)
+            {
+                  return sub(mul(x, y), c);
+            }
 #endif
       };
+
+      // Alignment of the packed reads of an engine, as its phase: get_packed(i) reads from an
+      // aligned address iff (i + phase) is a multiple of the stride. Engines which do not read
+      // memory (scalars, generators) fit any phase; operands reading at different phases
+      // make the whole expression mixed, in which case only unaligned loads are safe
+      template <typename NumType>
+      struct packed_alignment
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            enum { any = -1, mixed = -2 };
+
+            // phase of the reads shifted by offset elements
+            static inline int shift(int phase, int offset)
+            {
+                  if (phase < 0)
+                        return phase;
+                  const int r = (phase + offset)%int(arch_traits_t::stride);
+                  return r < 0 ? r + arch_traits_t::stride : r;
+            }
+
+            // phase of an expression reading two operands
+            static inline int combine(int phase1, int phase2)
+            {
+                  if (phase1 == any)
+                        return phase2;
+                  if (phase2 == any || phase1 == phase2)
+                        return phase1;
+                  return mixed;
+            }
+
+            static inline bool is_aligned(int phase, int idx)
+            {
+                  return phase == any || (phase >= 0 && 0 == shift(phase, idx));
+            }
+      };
 }
 
 #endif // TACHY_ARCH_TRAITS_H__INCLUDED
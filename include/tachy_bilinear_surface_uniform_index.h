@@ -0,0 +1,330 @@
+#if !defined(TACHY_BILINEAR_SURFACE_UNIFORM_INDEX_H__INCLUDED)
+#define TACHY_BILINEAR_SURFACE_UNIFORM_INDEX_H__INCLUDED
+
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "tachy_spline_util.h"
+#include "tachy_functor.h"
+#include "tachy_cacheable.h"
+#include "tachy_exception.h"
+
+namespace tachy
+{
+      // Maps a coordinate to its grid interval through a lookup table over a uniform partition
+      // of the grid (same approach as in linear_spline_uniform_index); coordinates outside of
+      // the grid map to the first/last interval
+      template <typename NumType>
+      class uniform_grid_index
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+
+      private:
+            unsigned int _idx_size;
+            NumType _dx;
+            NumType _x0;
+            unsigned int* _idx;
+
+            void copy(const uniform_grid_index& other)
+            {
+                  _idx_size = other._idx_size;
+                  _dx = other._dx;
+                  _x0 = other._x0;
+                  if (_idx_size > 0)
+                  {
+                        _idx = spline_util<NumType>::template allocate<unsigned int>(_idx_size);
+                        memcpy(_idx, other._idx, _idx_size*sizeof(_idx[0]));
+                  }
+            }
+
+      public:
+            uniform_grid_index() :
+                  _idx_size(0),
+                  _dx(0),
+                  _x0(0),
+                  _idx(0)
+            {}
+
+            explicit uniform_grid_index(const std::vector<NumType>& nodes) :
+                  _idx_size(0),
+                  _dx(0),
+                  _x0(0),
+                  _idx(0)
+            {
+                  const unsigned int n = nodes.size();
+                  if (n < 2)
+                        TACHY_THROW("At least two grid nodes are required, got " << n);
+
+                  const NumType k_eps = spline_util<NumType>::epsilon();
+                  unsigned int d0 = 0;
+                  for (unsigned int i = 1; i < n; ++i)
+                  {
+                        if (not (nodes[i] > nodes[i-1]))
+                              TACHY_THROW("Grid nodes must be increasing: " << nodes[i-1] << " followed by " << nodes[i]);
+                        d0 = spline_util<NumType>::gcd(d0, (unsigned int)((nodes[i] - nodes[i-1])/k_eps + 0.5));
+                  }
+                  if (0 == d0)
+                        TACHY_THROW("Cannot convert grid to uniform");
+
+                  NumType delta = k_eps*d0;
+                  _dx = 1.0/delta;
+                  _x0 = nodes.front();
+                  NumType x1 = nodes[n-2] + delta;
+                  _idx_size = (unsigned int)((x1 - _x0)*_dx + 0.5);
+                  _idx = spline_util<NumType>::template allocate<unsigned int>(_idx_size);
+                  NumType x = _x0 + 0.5*delta;
+                  unsigned int i = 0;
+                  _idx[0] = i;
+                  for (unsigned int k = 1; k < _idx_size; ++k)
+                  {
+                        x += delta;
+                        if (i + 2 < n && x > nodes[i + 1])
+                              ++i;
+                        _idx[k] = i;
+                  }
+            }
+
+            uniform_grid_index(const uniform_grid_index& other) :
+                  _idx_size(0),
+                  _dx(0),
+                  _x0(0),
+                  _idx(0)
+            {
+                  copy(other);
+            }
+
+            uniform_grid_index& operator= (const uniform_grid_index& other)
+            {
+                  if (this != &other)
+                  {
+                        spline_util<NumType>::deallocate(_idx);
+                        copy(other);
+                  }
+                  return *this;
+            }
+
+            ~uniform_grid_index()
+            {
+                  spline_util<NumType>::deallocate(_idx);
+            }
+
+            inline unsigned int get_index(NumType x) const
+            {
+                  return _idx[std::max<int>(0, std::min<int>(int((x - _x0)*_dx), _idx_size-1))];
+            }
+
+            inline typename arch_traits_t::index_t get_packed_index(const packed_t& x) const
+            {
+                  packed_t t = arch_traits_t::mul(arch_traits_t::set1(_dx), arch_traits_t::sub(x, arch_traits_t::set1(_x0)));
+                  return arch_traits_t::igather((const int*)_idx,
+                                                arch_traits_t::imin(int(_idx_size-1), arch_traits_t::imax(0, arch_traits_t::cvti(arch_traits_t::floor(t)))));
+            }
+      };
+
+      // Bilinear interpolation over a rectangular grid, e.g. incentive x loan age:
+      // values[i*y_nodes.size() + j] is the surface value at (x_nodes[i], y_nodes[j]).
+      // Each grid cell keeps f = a + b*x + c*y + d*x*y, so both scalar and packed evaluation
+      // are two index lookups, four gathers and three multiply-adds; outside of the grid
+      // the boundary cells are extrapolated
+      template <typename NumType>
+      class bilinear_surface_uniform_index : public cacheable
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+            typedef bilinear_surface_uniform_index<NumType> surface_t;
+            typedef uniform_grid_index<NumType> grid_index_t;
+
+      private:
+            std::string _key;
+
+            grid_index_t _x_index;
+            grid_index_t _y_index;
+
+            unsigned int _nx; // number of cells along x
+            unsigned int _ny; // number of cells along y
+
+            NumType* _a;
+            NumType* _b;
+            NumType* _c;
+            NumType* _d;
+
+            void clear()
+            {
+                  spline_util<NumType>::deallocate(_a);
+                  spline_util<NumType>::deallocate(_b);
+                  spline_util<NumType>::deallocate(_c);
+                  spline_util<NumType>::deallocate(_d);
+                  _nx = _ny = 0;
+            }
+
+            void allocate()
+            {
+                  const unsigned int n = _nx*_ny;
+                  _a = spline_util<NumType>::allocate(n);
+                  _b = spline_util<NumType>::allocate(n);
+                  _c = spline_util<NumType>::allocate(n);
+                  _d = spline_util<NumType>::allocate(n);
+            }
+
+            void copy(const bilinear_surface_uniform_index& other)
+            {
+                  assert(_a == 0 && _b == 0 && _c == 0 && _d == 0);
+                  _key = other._key;
+                  _x_index = other._x_index;
+                  _y_index = other._y_index;
+                  _nx = other._nx;
+                  _ny = other._ny;
+                  allocate();
+                  const unsigned int n = _nx*_ny;
+                  memcpy(_a, other._a, n*sizeof(NumType));
+                  memcpy(_b, other._b, n*sizeof(NumType));
+                  memcpy(_c, other._c, n*sizeof(NumType));
+                  memcpy(_d, other._d, n*sizeof(NumType));
+            }
+
+            inline unsigned int get_cell(NumType x, NumType y) const
+            {
+                  return _x_index.get_index(x)*_ny + _y_index.get_index(y);
+            }
+
+            template <class Engine, unsigned int Level>
+            static calc_vector<NumType, Engine, Level> make_vector(const std::string& id, const Engine& eng, calc_cache<NumType, Level>& cache)
+            {
+                  return calc_vector<NumType, Engine, Level>(id, eng.get_start_date(), eng, cache);
+            }
+
+            // level 0 vectors are not cached
+            template <class Engine>
+            static calc_vector<NumType, Engine, 0> make_vector(const std::string& id, const Engine& eng, calc_cache<NumType, 0>&)
+            {
+                  return calc_vector<NumType, Engine, 0>(id, eng.get_start_date(), eng);
+            }
+
+      public:
+            bilinear_surface_uniform_index(const std::string& name,
+                                           const std::vector<NumType>& x_nodes,
+                                           const std::vector<NumType>& y_nodes,
+                                           const std::vector<NumType>& values) :
+                  _key("BSui_" + name),
+                  _x_index(x_nodes),
+                  _y_index(y_nodes),
+                  _nx(x_nodes.size() - 1),
+                  _ny(y_nodes.size() - 1),
+                  _a(0),
+                  _b(0),
+                  _c(0),
+                  _d(0)
+            {
+                  const unsigned int n_y = y_nodes.size();
+                  if (values.size() != x_nodes.size()*n_y)
+                        TACHY_THROW("Incorrect number of surface values: got " << values.size() << ", expected: " << x_nodes.size()*n_y);
+
+                  allocate();
+                  for (unsigned int i = 0; i < _nx; ++i)
+                  {
+                        const NumType x0 = x_nodes[i];
+                        const NumType x1 = x_nodes[i+1];
+                        for (unsigned int j = 0; j < _ny; ++j)
+                        {
+                              const NumType y0 = y_nodes[j];
+                              const NumType y1 = y_nodes[j+1];
+                              const NumType z00 = values[i*n_y + j];
+                              const NumType z01 = values[i*n_y + j + 1];
+                              const NumType z10 = values[(i+1)*n_y + j];
+                              const NumType z11 = values[(i+1)*n_y + j + 1];
+                              // f = (z00*(x1 - x)*(y1 - y) + z10*(x - x0)*(y1 - y) + z01*(x1 - x)*(y - y0) + z11*(x - x0)*(y - y0))/(dx*dy)
+                              const NumType w = NumType(1)/((x1 - x0)*(y1 - y0));
+                              const unsigned int k = i*_ny + j;
+                              _a[k] = w*(z00*x1*y1 - z10*x0*y1 - z01*x1*y0 + z11*x0*y0);
+                              _b[k] = w*(-z00*y1 + z10*y1 + z01*y0 - z11*y0);
+                              _c[k] = w*(-z00*x1 + z10*x0 + z01*x1 - z11*x0);
+                              _d[k] = w*(z00 - z10 - z01 + z11);
+                        }
+                  }
+            }
+
+            bilinear_surface_uniform_index(const surface_t& other) :
+                  cacheable(other),
+                  _nx(0),
+                  _ny(0),
+                  _a(0),
+                  _b(0),
+                  _c(0),
+                  _d(0)
+            {
+                  copy(other);
+            }
+
+            surface_t& operator= (const surface_t& other)
+            {
+                  if (this != &other)
+                  {
+                        clear();
+                        copy(other);
+                  }
+                  return *this;
+            }
+
+            virtual ~bilinear_surface_uniform_index()
+            {
+                  clear();
+            }
+
+            virtual surface_t* clone() const
+            {
+                  return new surface_t(*this);
+            }
+
+            std::string get_id() const
+            {
+                  return _key;
+            }
+
+            inline NumType operator()(NumType x, NumType y) const
+            {
+                  const unsigned int k = get_cell(x, y);
+                  return _a[k] + _b[k]*x + y*(_c[k] + _d[k]*x);
+            }
+
+            inline packed_t apply_packed(const packed_t& x, const packed_t& y) const
+            {
+                  typename arch_traits_t::index_t k = arch_traits_t::iadd(arch_traits_t::imul(_x_index.get_packed_index(x), arch_traits_t::iset1(_ny)),
+                                                                          _y_index.get_packed_index(y));
+                  return arch_traits_t::fmadd(y,
+                                              arch_traits_t::fmadd(x, arch_traits_t::gather(_d, k), arch_traits_t::gather(_c, k)),
+                                              arch_traits_t::fmadd(x, arch_traits_t::gather(_b, k), arch_traits_t::gather(_a, k)));
+            }
+
+            // cached at the lower of the arguments' levels
+            template <class Eng1, class Eng2, unsigned int Level1, unsigned int Level2>
+            calc_vector<NumType, binary_functor_engine<NumType, typename data_engine_traits<Eng1>::cached_engine_t, typename data_engine_traits<Eng2>::cached_engine_t, surface_t, take_min<Level1, Level2>::result, functor_obj_policy_ref<surface_t> >, take_min<Level1, Level2>::result>
+            operator()(const calc_vector<NumType, Eng1, Level1>& x, const calc_vector<NumType, Eng2, Level2>& y) const
+            {
+                  typedef calc_cache<NumType, take_min<Level1, Level2>::result> cache_t;
+                  typedef cache_chooser<(unsigned int)(cache_t::cache_level) == Level1, calc_cache<NumType, Level1>, calc_cache<NumType, Level2> > cache_chooser_t;
+                  typedef binary_functor_engine<NumType, typename data_engine_traits<Eng1>::cached_engine_t, typename data_engine_traits<Eng2>::cached_engine_t, surface_t, take_min<Level1, Level2>::result, functor_obj_policy_ref<surface_t> > engine_t;
+                  cache_t& cache = cache_chooser_t::choose(x.cache(), y.cache());
+                  std::string id = cache.get_hash_key(_key + x.get_id() + std::string("_") + y.get_id(), x, y);
+                  const typename data_engine_traits<Eng1>::cached_engine_t& eng_x = do_cache(x.engine());
+                  const typename data_engine_traits<Eng2>::cached_engine_t& eng_y = do_cache(y.engine());
+                  return make_vector(id, engine_t(id, eng_x, eng_y, *this, cache), cache);
+            }
+
+            template <class Eng1, class Eng2>
+            calc_vector<NumType, binary_functor_engine<NumType, Eng1, Eng2, surface_t, 0, functor_obj_policy_ref<surface_t> >, 0>
+            operator()(const calc_vector<NumType, Eng1, 0>& x, const calc_vector<NumType, Eng2, 0>& y) const
+            {
+                  typedef binary_functor_engine<NumType, Eng1, Eng2, surface_t, 0, functor_obj_policy_ref<surface_t> > engine_t;
+                  engine_t eng(x.engine(), y.engine(), *this);
+                  return calc_vector<NumType, engine_t, 0>(calc_cache<NumType, 0>::get_dummy_key(), eng.get_start_date(), eng);
+            }
+      };
+}
+
+#endif // TACHY_BILINEAR_SURFACE_UNIFORM_INDEX_H__INCLUDED
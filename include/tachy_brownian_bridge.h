@@ -0,0 +1,230 @@
+#if !defined(TACHY_BROWNIAN_BRIDGE_H__INCLUDED)
+#define TACHY_BROWNIAN_BRIDGE_H__INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "tachy_aligned_allocator.h"
+#include "tachy_arch_traits.h"
+#include "tachy_sobol_sequence.h"
+#include "tachy_util.h"
+
+namespace tachy
+{
+      // Inverse of the standard normal distribution function: Acklam's rational approximation
+      // (relative error below 1.2e-9) refined with one Halley step to full double precision
+      template <typename NumType>
+      NumType inverse_normal_cdf(NumType p)
+      {
+            static const double a[] = { -3.969683028665376e+01,  2.209460984245205e+02, -2.759285104469687e+02,
+                                         1.383577518672690e+02, -3.066479806614716e+01,  2.506628277459239e+00 };
+            static const double b[] = { -5.447609879822406e+01,  1.615858368580409e+02, -1.556989798598866e+02,
+                                         6.680131188771972e+01, -1.328068155288572e+01 };
+            static const double c[] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                        -2.549732539343734e+00,  4.374664141464968e+00,  2.938163982698783e+00 };
+            static const double d[] = {  7.784695709041462e-03,  3.224671290700398e-01,  2.445134137142996e+00,
+                                         3.754408661907416e+00 };
+            const double p_low = 0.02425;
+
+            double x;
+            if (p < p_low)
+            {
+                  const double q = std::sqrt(-2.0*std::log(double(p)));
+                  x = (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5])/((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.0);
+            }
+            else if (p <= 1.0 - p_low)
+            {
+                  const double q = p - 0.5;
+                  const double r = q*q;
+                  x = (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q/(((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1.0);
+            }
+            else
+            {
+                  const double q = std::sqrt(-2.0*std::log(1.0 - p));
+                  x = -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5])/((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.0);
+            }
+            const double e = 0.5*std::erfc(-x/std::sqrt(2.0)) - p;
+            const double u = e*2.50662827463100050242*std::exp(0.5*x*x); // e/pdf(x)
+            return NumType(x - u/(1.0 + 0.5*x*u));
+      }
+
+      // Brownian bridge on steps 1, ..., n: the first normal sets the level at the last step, each next one
+      // the midpoint of the widest gap left between the levels already set (Glasserman, "Monte Carlo Methods
+      // in Financial Engineering", 3.1). Fed with a low-discrepancy sequence, the coordinates with the best
+      // uniformity go into the largest scale moves of the paths.
+      // Paths are built a pack at a time, one path per lane, with packed multiply-adds
+      template <typename NumType>
+      class brownian_bridge
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+
+            // the variance of a step is sigma^2
+            brownian_bridge(unsigned int n, NumType sigma) :
+                  _n(n),
+                  _bridge(n),
+                  _left(n),
+                  _right(n),
+                  _left_weight(n),
+                  _right_weight(n),
+                  _sd(n)
+            {
+                  if (0 == n)
+                        TACHY_THROW("Brownian bridge of no steps");
+
+                  // t[i] = i + 1, level i is set by normal map[i] - 1 (0 if not set yet)
+                  std::vector<unsigned int> map(n, 0);
+                  map[n-1] = 1;
+                  _bridge[0] = n - 1;
+                  _sd[0] = sigma*std::sqrt(NumType(n));
+                  for (unsigned int i = 1, j = 0; i < n; ++i)
+                  {
+                        while (j < n && map[j])
+                              ++j;
+                        if (j == n) // no gaps left in this sweep, start the next one
+                        {
+                              j = 0;
+                              while (map[j])
+                                    ++j;
+                        }
+                        unsigned int k = j;
+                        while (0 == map[k])
+                              ++k;
+                        // levels j, ..., k-1 are not set, k is (and j-1 is, unless j == 0)
+                        const unsigned int l = j + ((k - 1 - j) >> 1);
+                        map[l] = i + 1;
+                        _bridge[i] = l;
+                        _left[i] = j;
+                        _right[i] = k;
+                        const NumType t_left = NumType(j); // t[j-1], or 0
+                        const NumType t_l = NumType(l + 1);
+                        const NumType t_right = NumType(k + 1);
+                        _left_weight[i] = (t_right - t_l)/(t_right - t_left);
+                        _right_weight[i] = (t_l - t_left)/(t_right - t_left);
+                        _sd[i] = sigma*std::sqrt((t_l - t_left)*(t_right - t_l)/(t_right - t_left));
+                        j = k + 1;
+                        if (j >= n)
+                              j = 0;
+                  }
+            }
+
+            unsigned int size() const
+            {
+                  return _n;
+            }
+
+            // z[i] are the packed normals, w[t] receives the levels after t+1 steps
+            void transform(const packed_t* z, packed_t* w) const
+            {
+                  w[_n-1] = arch_traits_t::mul(arch_traits_t::set1(_sd[0]), z[0]);
+                  for (unsigned int i = 1; i < _n; ++i)
+                  {
+                        const unsigned int j = _left[i];
+                        packed_t x = arch_traits_t::fmadd(arch_traits_t::set1(_right_weight[i]), w[_right[i]],
+                                                          arch_traits_t::mul(arch_traits_t::set1(_sd[i]), z[i]));
+                        if (j)
+                              x = arch_traits_t::fmadd(arch_traits_t::set1(_left_weight[i]), w[j-1], x);
+                        w[_bridge[i]] = x;
+                  }
+            }
+
+      private:
+            unsigned int _n;
+            std::vector<unsigned int> _bridge; // the level set by each normal
+            std::vector<unsigned int> _left;   // first level of its gap
+            std::vector<unsigned int> _right;  // the set level right of its gap
+            std::vector<NumType> _left_weight;
+            std::vector<NumType> _right_weight;
+            std::vector<NumType> _sd;
+      };
+
+      // Brownian paths over n monthly steps from a Sobol sequence of n dimensions: path p is point p + 1 of
+      // the sequence through the inverse normal and the bridge - point 0 is 0 in every dimension, a path of
+      // normals of about -6.3 that would bias any small number of paths. Paths are generated a pack at a
+      // time and the last pack is kept, so going through the paths in order builds each pack once
+      template <typename NumType>
+      class sobol_brownian_paths
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+            typedef std::vector<NumType, aligned_allocator<NumType, arch_traits_t::align> > storage_t; // n packs
+
+            sobol_brownian_paths(unsigned int n, NumType sigma, uint64_t seed = 0) :
+                  _sobol(n, seed),
+                  _bridge(n, sigma),
+                  _first(0),
+                  _has_pack(false),
+                  _z(n*arch_traits_t::stride),
+                  _w(n*arch_traits_t::stride)
+            {}
+
+            unsigned int size() const
+            {
+                  return _bridge.size();
+            }
+
+            // res[t] = W(t+1), the level of path p after t+1 steps, for t below min(res.size(), size())
+            template <class Vector>
+            void levels(uint32_t p, Vector& res)
+            {
+                  const NumType* w = &get_pack(p)[0];
+                  const unsigned int lane = p % arch_traits_t::stride;
+                  for (unsigned int t = 0, n = std::min<unsigned int>(res.size(), size()); t < n; ++t)
+                        res[t] = w[t*arch_traits_t::stride + lane];
+            }
+
+            // res[t] = W(t+1) - W(t), the shock of path p in month t
+            template <class Vector>
+            void shocks(uint32_t p, Vector& res)
+            {
+                  const NumType* w = &get_pack(p)[0];
+                  const unsigned int lane = p % arch_traits_t::stride;
+                  NumType w0 = NumType(0);
+                  for (unsigned int t = 0, n = std::min<unsigned int>(res.size(), size()); t < n; ++t)
+                  {
+                        const NumType w1 = w[t*arch_traits_t::stride + lane];
+                        res[t] = w1 - w0;
+                        w0 = w1;
+                  }
+            }
+
+            // z[t*stride + i] = W(t+1) - W(t) of path first + i for t < n <= size(), first a multiple of stride
+            void pack_shocks(uint32_t first, unsigned int n, NumType* z)
+            {
+                  const NumType* w = &get_pack(first)[0];
+                  for (unsigned int i = 0; i < arch_traits_t::stride; ++i)
+                        z[i] = w[i];
+                  for (unsigned int i = arch_traits_t::stride, m = n*arch_traits_t::stride; i < m; ++i)
+                        z[i] = w[i] - w[i - arch_traits_t::stride];
+            }
+
+      private:
+            sobol_sequence<NumType> _sobol;
+            brownian_bridge<NumType> _bridge;
+            uint32_t  _first; // first path of the pack in _w
+            bool      _has_pack;
+            storage_t _z;
+            storage_t _w;
+
+            const storage_t& get_pack(uint32_t p)
+            {
+                  const uint32_t first = p - p % arch_traits_t::stride;
+                  if (not _has_pack || first != _first)
+                  {
+                        _sobol.points(first + 1, arch_traits_t::stride, &_z[0]);
+                        for (unsigned int i = 0; i < _z.size(); ++i)
+                              _z[i] = inverse_normal_cdf(_z[i]);
+                        _bridge.transform((const packed_t*)(&_z[0]), (packed_t*)(&_w[0]));
+                        _first = first;
+                        _has_pack = true;
+                  }
+                  return _w;
+            }
+      };
+}
+
+#endif // TACHY_BROWNIAN_BRIDGE_H__INCLUDED
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <set>
 #include <cstring>
 
 #include "tachy_util.h"
@@ -12,8 +13,140 @@
 
 namespace tachy
 {
+      // The nodes computed from each id of a Level > 0 cache: they are in the same cache or, for operations
+      // mixing levels, in the cache of the lower level. Edges are kept by the cache of the operand, so that
+      // invalidating an id reaches nodes in any cache; caches holding edges into each other unlink on clear()
+      class calc_cache_links
+      {
+      public:
+            // the node with the hash index k in cache is computed from the value of op_id in this cache
+            void add_dependent(const std::string& op_id, calc_cache_links* cache, unsigned int k)
+            {
+                  _dependents[op_id].insert(node_t(cache, k));
+                  if (cache != this)
+                  {
+                        _targets.insert(cache);
+                        cache->_sources.insert(this);
+                  }
+            }
+
+      protected:
+            calc_cache_links() {}
+            virtual ~calc_cache_links() {}
+
+            static std::string hashed_id(unsigned int k)
+            {
+                  const char* const s = "0123456789abcdef";
+                  char res[2*sizeof(unsigned int)/sizeof(char) + 2];
+                  res[0] = 'X';
+                  char* ptr = &res[1];
+                  for (; k > 0; ++ptr)
+                  {
+                        *ptr = s[k&0xf];
+                        k >>= 4;
+                  }
+                  *ptr = '\0';
+                  //sprintf(res, "X%d", k);
+                  return res;
+            }
+
+            // removes the cached value of id, if any
+            virtual bool remove(const std::string& id) = 0;
+
+            // whether the edges into the node with the hash index k are in place
+            bool is_linked(unsigned int k) const
+            {
+                  return k < _linked.size() && _linked[k];
+            }
+
+            void set_linked(unsigned int k)
+            {
+                  if (k >= _linked.size())
+                        _linked.resize(k + 1, 0);
+                  _linked[k] = 1;
+            }
+
+            unsigned int remove_dependents(const std::string& id)
+            {
+                  typedef std::pair<calc_cache_links*, std::string> key_t;
+                  unsigned int num_removed = 0;
+                  std::set<key_t> seen;
+                  std::vector<key_t> pending(1, key_t(this, id));
+                  seen.insert(pending.back());
+                  while (not pending.empty())
+                  {
+                        const key_t key = pending.back();
+                        pending.pop_back();
+                        if (key.first->remove(key.second))
+                              ++num_removed;
+                        dependents_t::const_iterator d = key.first->_dependents.find(key.second);
+                        if (d != key.first->_dependents.end())
+                        {
+                              for (std::set<node_t>::const_iterator k = d->second.begin(); k != d->second.end(); ++k)
+                              {
+                                    const key_t node(k->first, hashed_id(k->second));
+                                    if (seen.insert(node).second)
+                                          pending.push_back(node);
+                              }
+                        }
+                  }
+                  return num_removed;
+            }
+
+            // forgets all edges from and into this cache; the nodes they pointed to record them again when next hashed
+            void drop_links()
+            {
+                  for (dependents_t::const_iterator d = _dependents.begin(); d != _dependents.end(); ++d)
+                  {
+                        for (std::set<node_t>::const_iterator k = d->second.begin(); k != d->second.end(); ++k)
+                        {
+                              if (k->first != this && k->second < k->first->_linked.size())
+                                    k->first->_linked[k->second] = 0;
+                        }
+                  }
+                  _dependents.clear();
+                  _linked.clear();
+
+                  for (std::set<calc_cache_links*>::const_iterator c = _sources.begin(); c != _sources.end(); ++c)
+                  {
+                        (*c)->drop_dependents_in(this);
+                        (*c)->_targets.erase(this);
+                  }
+                  for (std::set<calc_cache_links*>::const_iterator c = _targets.begin(); c != _targets.end(); ++c)
+                        (*c)->_sources.erase(this);
+                  _sources.clear();
+                  _targets.clear();
+            }
+
+      private:
+            typedef std::pair<calc_cache_links*, unsigned int> node_t; // the cache of a node and its hash index
+            typedef std::map<std::string, std::set<node_t> > dependents_t;
+
+            dependents_t _dependents;               // the nodes computed from each id
+            std::vector<char> _linked;              // by hash index
+            std::set<calc_cache_links*> _sources;   // other caches with edges into this one
+            std::set<calc_cache_links*> _targets;   // other caches this one has edges into
+
+            void drop_dependents_in(const calc_cache_links* cache)
+            {
+                  for (dependents_t::iterator d = _dependents.begin(); d != _dependents.end(); ++d)
+                  {
+                        for (std::set<node_t>::iterator k = d->second.begin(); k != d->second.end();)
+                        {
+                              if (k->first == cache)
+                                    d->second.erase(k++);
+                              else
+                                    ++k;
+                        }
+                  }
+            }
+
+            calc_cache_links(const calc_cache_links&);
+            calc_cache_links& operator= (const calc_cache_links&);
+      };
+
       template <typename NumType, unsigned int Level>
-      class calc_cache
+      class calc_cache : public calc_cache_links
       {
       protected:
             typedef std::map<std::string, unsigned int> hash_t;
@@ -30,8 +163,10 @@ namespace tachy
                   : _id(id)
             {}
 
+            // the copy starts without the dependency links of the original, they are added as its keys are hashed again
             calc_cache(const self_t& other)
-                  : _id(other._id)
+                  : calc_cache_links(),
+                    _id(other._id)
             {
                   TACHY_LOG("Copying cache " << _id);
                   for (typename cache_engine_t::const_iterator i = other._cache.begin(); i != other._cache.end(); ++i)
@@ -68,6 +203,16 @@ namespace tachy
                         delete i->second;
                   }
                   _cache.clear();
+                  drop_links();
+            }
+
+            // removes the cached values of id and of everything computed from it, directly or not (see get_hash_key),
+            // to be recomputed when next used - the rest of the cache is kept. Returns the number of values removed.
+            // As with clear(), the vectors and the expressions using the removed values must be gone by then
+            unsigned int invalidate(const std::string& id)
+            {
+                  TACHY_LOG("calc_cache " << _id << ": invalidating " << id);
+                  return remove_dependents(id);
             }
 
             void insert(const typename cache_engine_t::value_type& kv)
@@ -137,25 +282,50 @@ namespace tachy
 
             std::string get_hash_key(const std::string& key)
             {
-                  hash_t::iterator h = _hashed.find(key);
-                  if (h == _hashed.end())
+                  return hashed_id(hash_index(key));
+            }
+
+            // the hashed key of a node computed from the operands with the given ids, which it depends on:
+            // it is invalidated with any of them (see invalidate). The operands are in this cache
+            std::string get_hash_key(const std::string& key, const std::string& op1_id, const std::string& op2_id = std::string())
+            {
+                  const unsigned int k = hash_index(key);
+                  if (not is_linked(k))
                   {
-                        h = _hashed.insert(hash_t::value_type(key, 1 + _hashed.size())).first;
-                        TACHY_LOG("calc_cache " << _id << ": hash key " << key << " -> " << h->second);
+                        if (not op1_id.empty())
+                              add_dependent(op1_id, this, k);
+                        if (not op2_id.empty())
+                              add_dependent(op2_id, this, k);
+                        set_linked(k);
                   }
-                  unsigned int k = h->second;
-                  const char* const s = "0123456789abcdef";
-                  char res[2*sizeof(unsigned int)/sizeof(char) + 2];
-                  res[0] = 'X';
-                  char* ptr = &res[1];
-                  for (; k > 0; ++ptr)
+                  return hashed_id(k);
+            }
+
+            // same for a node computed from any number of operands of this cache
+            std::string get_hash_key(const std::string& key, const std::vector<std::string>& op_ids)
+            {
+                  const unsigned int k = hash_index(key);
+                  if (not is_linked(k))
                   {
-                        *ptr = s[k&0xf];
-                        k >>= 4;
+                        for (std::vector<std::string>::const_iterator op_id = op_ids.begin(); op_id != op_ids.end(); ++op_id)
+                              add_dependent(*op_id, this, k);
+                        set_linked(k);
                   }
-                  *ptr = '\0';
-                  //sprintf(res, "X%d", h->second);
-                  return res;
+                  return hashed_id(k);
+            }
+
+            // same for operands that may come from other caches (operations mixing levels)
+            template <class Op1, class Op2>
+            std::string get_hash_key(const std::string& key, const Op1& op1, const Op2& op2)
+            {
+                  const unsigned int k = hash_index(key);
+                  if (not is_linked(k))
+                  {
+                        link(op1.get_id(), op1.cache(), k);
+                        link(op2.get_id(), op2.cache(), k);
+                        set_linked(k);
+                  }
+                  return hashed_id(k);
             }
 
             const std::string& get_id() const
@@ -168,6 +338,18 @@ namespace tachy
                   _id = id;
             }
 
+      protected:
+            virtual bool remove(const std::string& id)
+            {
+                  typename cache_engine_t::iterator i = _cache.find(id);
+                  if (i == _cache.end())
+                        return false;
+                  TACHY_LOG("calc_cache " << _id << ": removing key " << id);
+                  delete i->second;
+                  _cache.erase(i);
+                  return true;
+            }
+
       private:
             std::string  _id;
             cache_engine_t _cache;
@@ -176,6 +358,26 @@ namespace tachy
             mutable hash_t _use_count;
 #endif
             calc_cache() {}
+
+            unsigned int hash_index(const std::string& key)
+            {
+                  hash_t::iterator h = _hashed.find(key);
+                  if (h == _hashed.end())
+                  {
+                        h = _hashed.insert(hash_t::value_type(key, 1 + _hashed.size())).first;
+                        TACHY_LOG("calc_cache " << _id << ": hash key " << key << " -> " << h->second);
+                  }
+                  return h->second;
+            }
+
+            template <unsigned int OpLevel>
+            void link(const std::string& op_id, calc_cache<NumType, OpLevel>& op_cache, unsigned int k)
+            {
+                  op_cache.add_dependent(op_id, this, k);
+            }
+
+            void link(const std::string&, const calc_cache<NumType, 0>&, unsigned int)
+            {} // Level 0 values are not cached
       };
 
       // partial specialization
@@ -231,6 +433,22 @@ namespace tachy
                   return get_dummy_key(); // not cached - so why bother?
             }
 
+            std::string get_hash_key(const std::string&, const std::string&, const std::string& = std::string())
+            {
+                  return get_dummy_key();
+            }
+
+            template <class Op1, class Op2>
+            std::string get_hash_key(const std::string&, const Op1&, const Op2&)
+            {
+                  return get_dummy_key();
+            }
+
+            unsigned int invalidate(const std::string&)
+            {
+                  return 0;
+            }
+
             static std::string get_dummy_key()
             {
                   return "V0";
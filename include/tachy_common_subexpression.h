@@ -0,0 +1,289 @@
+#if !defined(TACHY_COMMON_SUBEXPRESSION_H__INCLUDED)
+#define TACHY_COMMON_SUBEXPRESSION_H__INCLUDED
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "tachy_arch_traits.h"
+#include "tachy_lagged_engine.h"
+
+namespace tachy
+{
+      template <typename NumType> class vector_engine;
+      template <typename NumType> class scalar;
+
+      // Structural identity of two operands of a statement: by default only an object is the same as itself,
+      // scalars of the same value and lags of the same operand by the same lag are the same too, and the
+      // Level 0 nodes of the same type compare their operands (see op_engine::same_as)
+      template <class Engine1, class Engine2>
+      bool same_operand(const Engine1&, const Engine2&)
+      {
+            return false;
+      }
+
+      template <class Engine>
+      bool same_operand(const Engine& x, const Engine& y)
+      {
+            return &x == &y;
+      }
+
+      template <typename NumType>
+      bool same_operand(const scalar<NumType>& x, const scalar<NumType>& y)
+      {
+            return x[0] == y[0];
+      }
+
+      template <typename NumType, class Op, bool Checked>
+      bool same_operand(const lagged_engine<NumType, Op, Checked>& x, const lagged_engine<NumType, Op, Checked>& y)
+      {
+            return x.lag() == y.lag() and same_operand(x.op(), y.op());
+      }
+
+      // The packed value of a node at the last index it was evaluated at
+      template <typename NumType>
+      struct packed_memo
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+
+            template <bool Aligned, bool Prologue, class Node>
+            inline packed_t get(const Node& node, int idx)
+            {
+                  if (idx != _idx)
+                  {
+                        _value = node.template evaluate_packed<Aligned, Prologue>(idx);
+                        _idx = idx;
+                  }
+                  return _value;
+            }
+
+            void reset()
+            {
+                  _idx = std::numeric_limits<int>::min();
+            }
+
+      private:
+            packed_t _value;
+            int      _idx;
+      };
+
+      // Statement-scoped common subexpression elimination for Level 0, where nothing is cached: the nodes
+      // of the same type over the same operands in one statement share a packed_memo, so each of them is
+      // evaluated once per pack. Passed to depends_on() of the expression, this probe walks it - the nodes
+      // worth sharing register themselves with add(), the operands of a repeated node are not walked.
+      // Only the static functors (exp, log, ...) do: an arithmetic node costs about as much as the memo
+      // lookup, and the check would slow down every statement without repeats.
+      // The spline engines on a vector and on its lagged views share the segment indices of the vector the same
+      // way (see spline_segment_engine): the first of them to register computes the table, from the vector as
+      // it is right before the loop.
+      // The memos and tables live as long as the probe does: create it right before the packed loop over the statement
+      template <typename NumType>
+      class common_subexpressions
+      {
+      public:
+            typedef packed_memo<NumType> memo_t;
+            typedef std::vector<int> segment_table_t;
+            enum { max_nodes = 32, max_memos = 8, max_tables = 4, max_table_users = 32 };
+
+            // the expressions of the statements evaluated in the same loop (see vector_tie)
+            template <class... Engines>
+            explicit common_subexpressions(const Engines&... engs) :
+                  _num_nodes(0),
+                  _num_memos(0),
+                  _num_tables(0),
+                  _num_table_users(0),
+                  _num_kept(0)
+            {
+                  std::fill(_kept, _kept + max_memos, false);
+                  const bool walked[] = { engs.depends_on(*this)... };
+                  (void)walked;
+            }
+
+            ~common_subexpressions()
+            {
+                  for (unsigned int i = 0; i < _num_nodes; ++i)
+                        *_nodes[i].memo = nullptr;
+                  for (unsigned int i = 0; i < _num_table_users; ++i)
+                        *_table_users[i] = nullptr;
+                  for (unsigned int i = 0; i < _num_kept; ++i)
+                        *_kept_users[i] = nullptr;
+            }
+
+            // nothing depends on the probe, so every operand gets walked
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return eng.depends_on(*this);
+            }
+
+            bool depends_on(const vector_engine<NumType>&) const
+            {
+                  return false;
+            }
+
+            // sets the memo of node when it repeats one seen before, and tells whether it does
+            template <class Node>
+            bool add(const Node& node, memo_t*& memo) const
+            {
+                  memo = nullptr;
+                  if (_num_nodes == max_nodes)
+                        return false;
+                  for (unsigned int i = 0; i < _num_nodes; ++i)
+                  {
+                        if (_nodes[i].type == type_tag<Node>() and same_operand(*static_cast<const Node*>(_nodes[i].node), node))
+                        {
+                              if (nullptr == *_nodes[i].memo)
+                              {
+                                    if (_num_memos == max_memos)
+                                          return false;
+                                    _memos[_num_memos].reset();
+                                    *_nodes[i].memo = &_memos[_num_memos++];
+                              }
+                              memo = *_nodes[i].memo;
+                              _nodes[_num_nodes++] = node_t(type_tag<Node>(), &node, &memo);
+                              return true;
+                        }
+                  }
+                  _nodes[_num_nodes++] = node_t(type_tag<Node>(), &node, &memo);
+                  return false;
+            }
+
+            unsigned int num_shared() const
+            {
+                  return _num_memos;
+            }
+
+            // keeps the value of a node from one pass over a pack to the next (see loop_invariants): the memo
+            // of a repeated node is kept as it is, a node not repeated gets one - false when out of room
+            bool keep(memo_t*& memo) const
+            {
+                  if (nullptr == memo)
+                  {
+                        if (_num_memos == max_memos or _num_kept == max_nodes)
+                              return false;
+                        _memos[_num_memos].reset();
+                        memo = &_memos[_num_memos++];
+                        _kept_users[_num_kept++] = &memo;
+                  }
+                  _kept[memo - _memos] = true;
+                  return true;
+            }
+
+            // before another pass over the same pack: the memos not kept are evaluated again
+            void next_pass() const
+            {
+                  for (unsigned int i = 0; i < _num_memos; ++i)
+                  {
+                        if (not _kept[i])
+                              _memos[i].reset();
+                  }
+            }
+
+            // sets table to the segment indices of src for spline, at least min_size of them - null when out of room
+            template <class Spline, class Source>
+            void add_segments(const Spline& spline, const Source& src, unsigned int min_size, const segment_table_t*& table) const
+            {
+                  table = nullptr;
+                  if (_num_table_users == max_table_users)
+                        return;
+                  unsigned int i = 0;
+                  while (i < _num_tables and (_tables[i].spline != &spline or _tables[i].source != &src))
+                        ++i;
+                  if (i == _num_tables)
+                  {
+                        if (_num_tables == max_tables)
+                              return;
+                        _tables[i].spline = &spline;
+                        _tables[i].source = &src;
+                        spline.fill_segment_table(src, min_size, _tables[i].segments);
+                        ++_num_tables;
+                  }
+                  else if (_tables[i].segments.size() < min_size)
+                        _tables[i].segments.resize(min_size, 0);
+                  table = &_tables[i].segments;
+                  _table_users[_num_table_users++] = &table;
+            }
+
+            unsigned int num_tables() const
+            {
+                  return _num_tables;
+            }
+
+      private:
+            struct node_t
+            {
+                  node_t() {}
+                  node_t(const void* t, const void* n, memo_t** m) : type(t), node(n), memo(m) {}
+
+                  const void* type;
+                  const void* node;
+                  memo_t** memo;
+            };
+
+            template <class Node> static const void* type_tag()
+            {
+                  static const char tag = 0;
+                  return &tag;
+            }
+
+            struct table_t
+            {
+                  const void*     spline;
+                  const void*     source;
+                  segment_table_t segments;
+            };
+
+            mutable node_t                  _nodes[max_nodes];
+            mutable memo_t                  _memos[max_memos];
+            mutable bool                    _kept[max_memos];
+            mutable memo_t**                _kept_users[max_nodes];
+            mutable table_t                 _tables[max_tables];
+            mutable const segment_table_t** _table_users[max_table_users];
+            mutable unsigned int            _num_nodes;
+            mutable unsigned int            _num_memos;
+            mutable unsigned int            _num_tables;
+            mutable unsigned int            _num_table_users;
+            mutable unsigned int            _num_kept;
+
+            common_subexpressions(const common_subexpressions&);
+            common_subexpressions& operator= (const common_subexpressions&);
+      };
+
+      // Hoisting out of a loop evaluating each pack of a statement several times over, for the values of one of
+      // its leaves (see assign_scenarios): passed to depends_on() of the expression once its common_subexpressions
+      // are in place, the probe gives the function nodes which don't read the leaf - LeafProbe tells - a memo
+      // kept from one pass to the next. They are evaluated once per pack, their operands are not walked.
+      // The memos of the other nodes are evaluated again on every pass (see common_subexpressions::next_pass)
+      template <typename NumType, class LeafProbe>
+      class loop_invariants
+      {
+      public:
+            loop_invariants(const LeafProbe& leaf, const common_subexpressions<NumType>& cse) :
+                  _leaf(leaf),
+                  _cse(cse)
+            {}
+
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return eng.depends_on(*this);
+            }
+
+            bool depends_on(const vector_engine<NumType>&) const
+            {
+                  return false;
+            }
+
+            // whether node is evaluated once per pack from now on
+            template <class Node>
+            bool add(const Node& node, packed_memo<NumType>*& memo) const
+            {
+                  return not node.depends_on(_leaf) and _cse.keep(memo);
+            }
+
+      private:
+            const LeafProbe& _leaf;
+            const common_subexpressions<NumType>& _cse;
+      };
+}
+
+#endif // TACHY_COMMON_SUBEXPRESSION_H__INCLUDED
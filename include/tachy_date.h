@@ -5,150 +5,132 @@
 
 namespace tachy
 {
+      // A month is stored as a single index, months since January of year 0, so date arithmetic is integer
+      // arithmetic: it is constexpr and does not throw, the range is only checked when a date is built from
+      // its yyyymm form (a date moved out of range reports it with is_valid())
       class tachy_date
       {
       public:
-            static tachy_date min_date()
+            static constexpr tachy_date min_date()
             {
-                  return tachy_date(101);
+                  return from_index(12*1 + 0);
+            }
+
+            static constexpr tachy_date from_index(int idx)
+            {
+                  return tachy_date(idx, index_tag());
             }
 
             explicit tachy_date(unsigned int dt)
-                  : _y(dt/100),
-                    _m(dt%100)
+                  : _idx(12*int(dt/100) + int(dt%100) - 1)
             {
-                  if (not is_valid())
+                  if (not (0 < dt%100 && dt%100 < 13 && is_valid()))
                         TACHY_THROW("Invalid date: " << dt);
             }
 
-            tachy_date(const tachy_date& other) :
-                  _y(other._y),
-                  _m(other._m)
-            {}
-
-            bool is_valid() const
+            constexpr bool is_valid() const
             {
-                  return 0 < _m && _m < 13 && 0 < _y && _y < 10000;
+                  return 12 <= _idx && _idx < 12*10000;
             }
 
-            tachy_date& operator= (const tachy_date& other)
+            constexpr tachy_date& operator+= (int months)
             {
-                  _y = other._y;
-                  _m = other._m;
+                  _idx += months;
                   return *this;
             }
 
-            tachy_date& operator+= (int months)
+            constexpr tachy_date& operator-= (int months)
             {
-                  bool valid = false;
-                  int y = _y + months/12;
-                  int m = _m + months%12;
-                  if (y > 0)
-                  {
-                        if (m > 12)
-                        {
-                              _y = y + 1;
-                              _m = m - 12;
-                        }
-                        else if (m < 1)
-                        {
-                              _y = y - 1;
-                              _m = m + 12;
-                        }
-                        else
-                        {
-                              _y = y;
-                              _m = m;
-                        }
-                        valid = is_valid();
-                  }
-                  if (not valid)
-                        TACHY_THROW("Got invalid date after adding " << months << " months");
+                  _idx -= months;
                   return *this;
             }
 
-            tachy_date& operator-= (int months)
+            constexpr tachy_date& operator++ ()
             {
-                  return *this += -months;
+                  ++_idx;
+                  return *this;
             }
 
-            tachy_date& operator++ ()
+            constexpr tachy_date operator++ (int)
             {
-                  return *this += 1;
+                  tachy_date dt(*this);
+                  ++_idx;
+                  return dt;
             }
 
-            tachy_date operator++ (int)
+            constexpr int index() const
             {
-                  tachy_date dt(*this);
-                  *this += 1;
-                  return dt;
+                  return _idx;
             }
 
-            int year() const
+            constexpr int year() const
             {
-                  return _y;
+                  return _idx/12;
             }
 
-            int month() const
+            constexpr int month() const
             {
-                  return _m;
+                  return _idx%12 + 1;
             }
 
-            unsigned int as_uint() const
+            constexpr unsigned int as_uint() const
             {
-                  return 100*_y + _m;
+                  return 100*year() + month();
             }
 
       private:
-            unsigned int _y;
-            unsigned int _m;
+            struct index_tag {};
+
+            int _idx;
+
+            constexpr tachy_date(int idx, index_tag) :
+                  _idx(idx)
+            {}
       };
 
-      tachy_date operator+ (const tachy_date& dt, int months)
+      inline constexpr tachy_date operator+ (const tachy_date& dt, int months)
       {
-            tachy_date dt_new(dt);
-            return dt_new += months;
+            return tachy_date::from_index(dt.index() + months);
       }
 
-      tachy_date operator- (const tachy_date& dt, int months)
+      inline constexpr tachy_date operator- (const tachy_date& dt, int months)
       {
-            tachy_date dt_new(dt);
-            return dt_new += -months;
+            return tachy_date::from_index(dt.index() - months);
       }
 
-      int operator- (const tachy_date& dt2, const tachy_date& dt1)
+      inline constexpr int operator- (const tachy_date& dt2, const tachy_date& dt1)
       {
-            return 12*(dt2.year() - dt1.year()) + dt2.month() - dt1.month();
+            return dt2.index() - dt1.index();
       }
 
-      bool operator== (const tachy_date& dt2, const tachy_date& dt1)
+      inline constexpr bool operator== (const tachy_date& dt2, const tachy_date& dt1)
       {
-            return dt2.year() == dt1.year() and dt2.month() == dt1.month();
+            return dt2.index() == dt1.index();
       }
 
-      bool operator!= (const tachy_date& dt2, const tachy_date& dt1)
+      inline constexpr bool operator!= (const tachy_date& dt2, const tachy_date& dt1)
       {
-            return not (dt2 == dt1);
+            return dt2.index() != dt1.index();
       }
 
-      bool operator< (const tachy_date& dt2, const tachy_date& dt1)
+      inline constexpr bool operator< (const tachy_date& dt2, const tachy_date& dt1)
       {
-            return dt2.year() < dt1.year() or (dt2.year() == dt1.year() and dt2.month() < dt1.month());
+            return dt2.index() < dt1.index();
       }
 
-      bool operator<= (const tachy_date& dt2, const tachy_date& dt1)
+      inline constexpr bool operator<= (const tachy_date& dt2, const tachy_date& dt1)
       {
-            return dt2.year() < dt1.year() or (dt2.year() == dt1.year() and dt2.month() <= dt1.month());
+            return dt2.index() <= dt1.index();
       }
 
-      bool operator> (const tachy_date& dt2, const tachy_date& dt1)
+      inline constexpr bool operator> (const tachy_date& dt2, const tachy_date& dt1)
       {
-            return not (dt2 <= dt1);
+            return dt2.index() > dt1.index();
       }
 
-      bool operator>= (const tachy_date& dt2, const tachy_date& dt1)
+      inline constexpr bool operator>= (const tachy_date& dt2, const tachy_date& dt1)
       {
-            return not (dt2 < dt1);
+            return dt2.index() >= dt1.index();
       }
 }
 
@@ -28,14 +28,20 @@ namespace tachy
             } \
             template <class Res, class Op1, class Op2> \
                   static inline void apply(Res& res, const Op1& x, const Op2& y, int offset_x, int offset_y) \
+            { \
+                  typedef packed_alignment<NumType> align_t; \
+                  if (align_t::is_aligned(align_t::combine(align_t::shift(x.get_alignment(), offset_x), align_t::shift(y.get_alignment(), offset_y)), 0)) \
+                        apply<true>(res, x, y, offset_x, offset_y); \
+                  else \
+                        apply<false>(res, x, y, offset_x, offset_y); \
+            } \
+            template <bool Aligned, class Res, class Op1, class Op2> \
+                  static inline void apply(Res& res, const Op1& x, const Op2& y, int offset_x, int offset_y) \
             { \
                   TACHY_LOG("in scalar version");     \
-                  unsigned int sz = res.size(); \
-                  unsigned int i; \
-                  for (i = 0; i < sz; i += arch_traits_t::stride)    \
-                        (*(typename arch_traits_t::packed_t*)(&res[i])) = arch_traits_t::OP_NAME_TRAITS(x.get_packed(i + offset_x), y.get_packed(i + offset_y)); \
-                  for ( ; i < sz; ++i ) \
-                        res[i] = apply(x[i+offset_x], y[i+offset_y]); \
+                  /* whole packs: the last one spills into the storage padding of res (see vector_engine) */ \
+                  for (unsigned int i = 0, sz = res.size(); i < sz; i += arch_traits_t::stride) \
+                        res.set_packed(i, arch_traits_t::OP_NAME_TRAITS(x.template get_packed<Aligned>(i + offset_x), y.template get_packed<Aligned>(i + offset_y))); \
             } \
             typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t; \
             typedef typename arch_traits_t::packed_t packed_t; \
@@ -71,7 +77,8 @@ namespace tachy
             typedef arch_traits<NumType, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
 
             op_engine(const std::string& key, const Op1& op1, const Op2& op2, calc_cache<NumType, Level>& cache) :
-                  _res(dynamic_cast<vector_engine<NumType>*>(cache[key]))
+                  _res(dynamic_cast<vector_engine<NumType>*>(cache[key])),
+                  _reads(op1, op2)
             {
                   if (0 == _res || 0 == _res->size())
                   {
@@ -93,15 +100,17 @@ namespace tachy
             }
            
             op_engine(const op_engine& other) :
-                  _res(other._res)
+                  _res(other._res),
+                  _reads(other._reads)
             {}
            
             ~op_engine()
             {}
            
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(unsigned int idx) const
             {
-                  return _res->get_packed(idx);
+                  return _res->template get_packed<Aligned, Prologue>(idx);
             }
 
             NumType operator[] (const unsigned int idx) const
@@ -119,6 +128,11 @@ namespace tachy
                   return _res->get_start_date();
             }
 
+            int get_alignment() const
+            {
+                  return _res->get_alignment();
+            }
+
             template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
             {
                   return _res and eng.depends_on(*_res);
@@ -129,8 +143,16 @@ namespace tachy
                   return _res == &eng;
             }
 
+            // what the operands read when the result was computed
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.read(_reads);
+                  return false;
+            }
+
       protected:
             vector_engine<NumType>* _res;
+            operand_reads<NumType>  _reads;
            
             op_engine& operator= (const op_engine& other)
             {
@@ -183,9 +205,10 @@ namespace tachy
                   _offset2(other._offset2)
             {}
            
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(unsigned int idx) const
             {
-                  return OpType::apply_packed(_op1.get_packed(idx + _offset1), _op2.get_packed(idx + _offset2));
+                  return OpType::apply_packed(_op1.template get_packed<Aligned, Prologue>(idx + _offset1), _op2.template get_packed<Aligned, Prologue>(idx + _offset2));
             }
 
             NumType operator[] (const unsigned int idx) const
@@ -203,10 +226,32 @@ namespace tachy
                   return _dt;
             }
 
+            int get_alignment() const
+            {
+                  typedef packed_alignment<NumType> align_t;
+                  return align_t::combine(align_t::shift(_op1.get_alignment(), _offset1), align_t::shift(_op2.get_alignment(), _offset2));
+            }
+
             template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
             {
                   return _op1.depends_on(eng) or _op2.depends_on(eng);
             }
+
+            bool same_as(const op_engine& other) const
+            {
+                  return same_operand(_op1, other._op1) and same_operand(_op2, other._op2);
+            }
+
+            // the operands, for folding scalars into a chain of operations (see TACHY_EXPR_SCALAR_FOLD_PACK)
+            const Op1& get_op1() const
+            {
+                  return _op1;
+            }
+
+            const Op2& get_op2() const
+            {
+                  return _op2;
+            }
             
       protected:
             typename data_engine_traits<Op1>::ref_type_t _op1;
@@ -225,6 +270,21 @@ namespace tachy
       template <typename NumType, typename Op1, class OpType, typename Op2, unsigned int Level>
       class op_engine_delayed_cache
       {
+      protected:
+
+            // operands of different start dates are aligned the same way as at Level 0
+            void setup()
+            {
+                  tachy_date dt1 = _op1.get_start_date();
+                  tachy_date dt2 = _op2.get_start_date();
+                  _dt = dt1 < dt2 ? dt2 : dt1;
+                  _offset1 = std::max<int>(0, _dt - dt1);
+                  _offset2 = std::max<int>(0, _dt - dt2);
+                  unsigned int sz1 = _op1.size() - _offset1;
+                  unsigned int sz2 = _op2.size() - _offset2;
+                  _sz = sz1 && sz2 ? std::min(sz1, sz2) : sz1 + sz2;
+            }
+
       public:
             typedef calc_cache<NumType, Level> cache_t;
             typedef arch_traits<NumType, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
@@ -234,17 +294,24 @@ namespace tachy
                   _op1(op1),    
                   _op2(op2),    
                   _cache(cache),
-                  _cached_vector(nullptr)
+                  _cached_vector(nullptr),
+                  _dt(tachy_date::min_date())
             {
+                  setup();
                   TACHY_LOG("Delayed Cache " << cache.get_id() << ": delayed caching for " << key);
             }
            
             op_engine_delayed_cache(const op_engine_delayed_cache& other) :
                   _key(other._key),    
+                  _operand_id(other._operand_id),
                   _op1(other._op1),    
                   _op2(other._op2),    
                   _cache(other._cache),
-                  _cached_vector(nullptr)
+                  _cached_vector(nullptr),
+                  _dt(other._dt),
+                  _sz(other._sz),
+                  _offset1(other._offset1),
+                  _offset2(other._offset2)
             {}
            
             ~op_engine_delayed_cache()
@@ -255,26 +322,29 @@ namespace tachy
            
             NumType operator[] (const unsigned int idx) const
             {
-                  return OpType::apply(_op1[idx], _op2[idx]);
+                  return OpType::apply(_op1[idx + _offset1], _op2[idx + _offset2]);
             }
            
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(unsigned int idx) const
             {
-                  return OpType::apply_packed(_op1.get_packed(idx), _op2.get_packed(idx));
+                  return OpType::apply_packed(_op1.template get_packed<Aligned, Prologue>(idx + _offset1), _op2.template get_packed<Aligned, Prologue>(idx + _offset2));
             }
 
             unsigned int size() const
             {
-                  unsigned int s1 = _op1.size();
-                  unsigned int s2 = _op2.size();
-                  return s1 && s2 ? std::min(s1, s2) : std::max(s1, s2);
+                  return _sz;
             }
            
             tachy_date get_start_date() const
             {
-                  tachy_date d1 = _op1.get_start_date();
-                  tachy_date d2 = _op2.get_start_date();
-                  return d1 < d2 ? d2 : d1;
+                  return _dt;
+            }
+
+            int get_alignment() const
+            {
+                  typedef packed_alignment<NumType> align_t;
+                  return align_t::combine(align_t::shift(_op1.get_alignment(), _offset1), align_t::shift(_op2.get_alignment(), _offset2));
             }
             
             const op_engine<NumType, Op1, OpType, Op2, Level>& get_cached_engine() const
@@ -291,13 +361,40 @@ namespace tachy
                   else
                         return _op1.depends_on(eng) or _op2.depends_on(eng);
             }
+
+            // the operands, for folding scalars into a chain of operations (see TACHY_EXPR_SCALAR_FOLD_PACK)
+            const Op1& get_op1() const
+            {
+                  return _op1;
+            }
+
+            const Op2& get_op2() const
+            {
+                  return _op2;
+            }
+
+            // the id of the vector operand of a scalar operation: the key of a folded operation is built from it
+            const std::string& get_operand_id() const
+            {
+                  return _operand_id;
+            }
+
+            void set_operand_id(const std::string& id)
+            {
+                  _operand_id = id;
+            }
             
       protected:
             std::string _key;
+            std::string _operand_id;
             typename data_engine_traits<Op1>::ref_type_t _op1;
             typename data_engine_traits<Op2>::ref_type_t _op2;
             cache_t& _cache;
             op_engine<NumType, Op1, OpType, Op2, Level>* _cached_vector;
+            tachy_date   _dt;
+            unsigned int _sz;
+            unsigned int _offset1;
+            unsigned int _offset2;
            
             op_engine_delayed_cache& operator= (const op_engine_delayed_cache& other )
             {
@@ -318,8 +415,402 @@ namespace tachy
             typedef op_engine<NumType, Op1, OpType, Op2, Level> cached_engine_t;
             typedef op_engine_delayed_cache<NumType, Op1, OpType, Op2, Level> const& ref_type_t;
       };
+
+      template <typename NumType, class Op1, class OpType, class Op2>
+      struct has_lagged_operand< op_engine<NumType, Op1, OpType, Op2, 0> >
+      {
+            enum { result = has_lagged_operand<Op1>::result || has_lagged_operand<Op2>::result };
+      };
+
+      template <typename NumType, class Op1, class OpType, class Op2, unsigned int Level>
+      struct has_lagged_operand< op_engine_delayed_cache<NumType, Op1, OpType, Op2, Level> >
+      {
+            enum { result = has_lagged_operand<Op1>::result || has_lagged_operand<Op2>::result };
+      };
+
+      template <typename NumType, class Op1, class OpType, class Op2>
+      bool same_operand(const op_engine<NumType, Op1, OpType, Op2, 0>& x, const op_engine<NumType, Op1, OpType, Op2, 0>& y)
+      {
+            return &x == &y or x.same_as(y);
+      }
+
+      /** Fused multiply-add: x*y + z and x*y - z as one packed operation (arch_traits::fmadd and fmsub),
+       *  the product is not rounded before the sum
+       */
+#define TACHY_FUSED_OP_TYPE_CLASS(OP_NAME, OP, OP_NAME_TRAITS) \
+      template <typename NumType> \
+      struct OP_NAME \
+      { \
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t; \
+            typedef typename arch_traits_t::packed_t packed_t; \
+            static inline NumType apply(NumType x, NumType y, NumType z) \
+            { \
+                  return x*y OP z; \
+            } \
+            static inline packed_t apply_packed(const packed_t& x, const packed_t& y, const packed_t& z) \
+            { \
+                  return arch_traits_t::OP_NAME_TRAITS(x, y, z); \
+            } \
+            template <class Res, class Op1, class Op2, class Op3> \
+            static inline void apply(Res& res, const Op1& x, const Op2& y, const Op3& z, int offset_x, int offset_y, int offset_z) \
+            { \
+                  typedef packed_alignment<NumType> align_t; \
+                  const bool aligned = align_t::is_aligned(align_t::combine(align_t::combine(align_t::shift(x.get_alignment(), offset_x), align_t::shift(y.get_alignment(), offset_y)), align_t::shift(z.get_alignment(), offset_z)), 0); \
+                  if (aligned) \
+                        apply<true>(res, x, y, z, offset_x, offset_y, offset_z); \
+                  else \
+                        apply<false>(res, x, y, z, offset_x, offset_y, offset_z); \
+            } \
+            /* whole packs: the last one spills into the storage padding of res (see vector_engine) */ \
+            template <bool Aligned, class Res, class Op1, class Op2, class Op3> \
+            static inline void apply(Res& res, const Op1& x, const Op2& y, const Op3& z, int offset_x, int offset_y, int offset_z) \
+            { \
+                  for (unsigned int i = 0, sz = res.size(); i < sz; i += arch_traits_t::stride) \
+                        res.set_packed(i, arch_traits_t::OP_NAME_TRAITS(x.template get_packed<Aligned>(i + offset_x), \
+                                                                        y.template get_packed<Aligned>(i + offset_y), \
+                                                                        z.template get_packed<Aligned>(i + offset_z))); \
+            } \
+      };
+// end of TACHY_FUSED_OP_TYPE_CLASS macro
+
+      TACHY_FUSED_OP_TYPE_CLASS(OpMulAdd, +, fmadd)
+      TACHY_FUSED_OP_TYPE_CLASS(OpMulSub, -, fmsub)
+
+      // operands of different start dates are aligned the same way as in op_engine
+      struct fused_layout
+      {
+            template <class Op1, class Op2, class Op3>
+            fused_layout(const Op1& op1, const Op2& op2, const Op3& op3) :
+                  dt(std::max(op1.get_start_date(), std::max(op2.get_start_date(), op3.get_start_date()))),
+                  offset1(std::max<int>(0, dt - op1.get_start_date())),
+                  offset2(std::max<int>(0, dt - op2.get_start_date())),
+                  offset3(std::max<int>(0, dt - op3.get_start_date()))
+            {
+                  unsigned int sz1 = op1.size() - offset1;
+                  unsigned int sz2 = op2.size() - offset2;
+                  unsigned int sz3 = op3.size() - offset3;
+                  unsigned int sz12 = sz1 && sz2 ? std::min(sz1, sz2) : sz1 + sz2;
+                  sz = sz12 && sz3 ? std::min(sz12, sz3) : sz12 + sz3;
+            }
+
+            tachy_date   dt;
+            unsigned int sz;
+            unsigned int offset1;
+            unsigned int offset2;
+            unsigned int offset3;
+      };
+
+      template <typename NumType, typename Op1, typename Op2, typename Op3, class OpType, unsigned int Level>
+      class fma_engine
+      {
+      public:
+            typedef arch_traits<NumType, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            fma_engine(const std::string& key, const Op1& op1, const Op2& op2, const Op3& op3, calc_cache<NumType, Level>& cache) :
+                  _res(dynamic_cast<vector_engine<NumType>*>(cache[key])),
+                  _reads(op1, op2, op3)
+            {
+                  if (0 == _res || 0 == _res->size())
+                  {
+                        TACHY_LOG("Cache " << cache.get_id() << ": calculating for " << key);
+                        fused_layout layout(op1, op2, op3);
+                        _res = new vector_engine<NumType>(layout.dt, layout.sz, NumType(0));
+                        cache[key] = _res;
+                        OpType::apply(*_res, op1, op2, op3, layout.offset1, layout.offset2, layout.offset3);
+                  }
+                  else
+                        TACHY_LOG("Cache " << cache.get_id() << ": using cached result for " << key);
+            }
+
+            fma_engine(const fma_engine& other) :
+                  _res(other._res),
+                  _reads(other._reads)
+            {}
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(unsigned int idx) const
+            {
+                  return _res->template get_packed<Aligned, Prologue>(idx);
+            }
+
+            NumType operator[] (const unsigned int idx) const
+            {
+                  return (*_res)[idx];
+            }
+
+            unsigned int size() const
+            {
+                  return _res->size();
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _res->get_start_date();
+            }
+
+            int get_alignment() const
+            {
+                  return _res->get_alignment();
+            }
+
+            template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
+            {
+                  return _res and eng.depends_on(*_res);
+            }
+
+            bool depends_on(const vector_engine<NumType>& eng) const
+            {
+                  return _res == &eng;
+            }
+
+            // what the operands read when the result was computed
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.read(_reads);
+                  return false;
+            }
+
+      protected:
+            vector_engine<NumType>* _res;
+            operand_reads<NumType>  _reads;
+
+            fma_engine& operator= (const fma_engine& other)
+            {
+                  return *this;
+            }
+      };
+
+      template <typename NumType, typename Op1, typename Op2, typename Op3, class OpType>
+      class fma_engine<NumType, Op1, Op2, Op3, OpType, 0>
+      {
+      public:
+            typedef arch_traits<NumType, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            fma_engine(const std::string&, const Op1& op1, const Op2& op2, const Op3& op3, const calc_cache<NumType, 0>&) :
+                  _op1(op1),
+                  _op2(op2),
+                  _op3(op3),
+                  _layout(op1, op2, op3)
+            {}
+
+            fma_engine(const fma_engine& other) :
+                  _op1(other._op1),
+                  _op2(other._op2),
+                  _op3(other._op3),
+                  _layout(other._layout)
+            {}
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(unsigned int idx) const
+            {
+                  return OpType::apply_packed(_op1.template get_packed<Aligned, Prologue>(idx + _layout.offset1),
+                                              _op2.template get_packed<Aligned, Prologue>(idx + _layout.offset2),
+                                              _op3.template get_packed<Aligned, Prologue>(idx + _layout.offset3));
+            }
+
+            NumType operator[] (const unsigned int idx) const
+            {
+                  return OpType::apply(_op1[idx + _layout.offset1], _op2[idx + _layout.offset2], _op3[idx + _layout.offset3]);
+            }
+
+            unsigned int size() const
+            {
+                  return _layout.sz;
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _layout.dt;
+            }
+
+            int get_alignment() const
+            {
+                  typedef packed_alignment<NumType> align_t;
+                  return align_t::combine(align_t::combine(align_t::shift(_op1.get_alignment(), _layout.offset1),
+                                                           align_t::shift(_op2.get_alignment(), _layout.offset2)),
+                                          align_t::shift(_op3.get_alignment(), _layout.offset3));
+            }
+
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return _op1.depends_on(eng) or _op2.depends_on(eng) or _op3.depends_on(eng);
+            }
+
+            bool same_as(const fma_engine& other) const
+            {
+                  return same_operand(_op1, other._op1) and same_operand(_op2, other._op2) and same_operand(_op3, other._op3);
+            }
+
+      protected:
+            typename data_engine_traits<Op1>::ref_type_t _op1;
+            typename data_engine_traits<Op2>::ref_type_t _op2;
+            typename data_engine_traits<Op3>::ref_type_t _op3;
+            fused_layout _layout;
+
+            fma_engine& operator= (const fma_engine& other)
+            {
+                  return *this;
+            }
+      };
+
+      template <typename NumType, typename Op1, typename Op2, typename Op3, class OpType, unsigned int Level>
+      class fma_engine_delayed_cache
+      {
+      public:
+            typedef calc_cache<NumType, Level> cache_t;
+            typedef arch_traits<NumType, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef fma_engine<NumType, Op1, Op2, Op3, OpType, Level> cached_engine_t;
+
+            fma_engine_delayed_cache(const std::string& key, const Op1& op1, const Op2& op2, const Op3& op3, cache_t& cache) :
+                  _key(key),
+                  _op1(op1),
+                  _op2(op2),
+                  _op3(op3),
+                  _cache(cache),
+                  _cached_vector(nullptr),
+                  _layout(op1, op2, op3)
+            {
+                  TACHY_LOG("Delayed Cache " << cache.get_id() << ": delayed caching for " << key);
+            }
+
+            fma_engine_delayed_cache(const fma_engine_delayed_cache& other) :
+                  _key(other._key),
+                  _op1(other._op1),
+                  _op2(other._op2),
+                  _op3(other._op3),
+                  _cache(other._cache),
+                  _cached_vector(nullptr),
+                  _layout(other._layout)
+            {}
+
+            ~fma_engine_delayed_cache()
+            {
+                  delete _cached_vector;
+            }
+
+            NumType operator[] (const unsigned int idx) const
+            {
+                  return OpType::apply(_op1[idx + _layout.offset1], _op2[idx + _layout.offset2], _op3[idx + _layout.offset3]);
+            }
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(unsigned int idx) const
+            {
+                  return OpType::apply_packed(_op1.template get_packed<Aligned, Prologue>(idx + _layout.offset1),
+                                              _op2.template get_packed<Aligned, Prologue>(idx + _layout.offset2),
+                                              _op3.template get_packed<Aligned, Prologue>(idx + _layout.offset3));
+            }
+
+            unsigned int size() const
+            {
+                  return _layout.sz;
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _layout.dt;
+            }
+
+            int get_alignment() const
+            {
+                  typedef packed_alignment<NumType> align_t;
+                  return align_t::combine(align_t::combine(align_t::shift(_op1.get_alignment(), _layout.offset1),
+                                                           align_t::shift(_op2.get_alignment(), _layout.offset2)),
+                                          align_t::shift(_op3.get_alignment(), _layout.offset3));
+            }
+
+            const cached_engine_t& get_cached_engine() const
+            {
+                  if (0 == _cached_vector)
+                        const_cast<fma_engine_delayed_cache*>(this)->_cached_vector = new cached_engine_t(_key, _op1, _op2, _op3, _cache);
+                  return *_cached_vector;
+            }
+
+            template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
+            {
+                  if (_cached_vector)
+                        return _cached_vector->depends_on(eng);
+                  else
+                        return _op1.depends_on(eng) or _op2.depends_on(eng) or _op3.depends_on(eng);
+            }
+
+      protected:
+            std::string _key;
+            typename data_engine_traits<Op1>::ref_type_t _op1;
+            typename data_engine_traits<Op2>::ref_type_t _op2;
+            typename data_engine_traits<Op3>::ref_type_t _op3;
+            cache_t& _cache;
+            cached_engine_t* _cached_vector;
+            fused_layout _layout;
+
+            fma_engine_delayed_cache& operator= (const fma_engine_delayed_cache& other)
+            {
+                  return *this;
+            }
+      };
+
+      template <typename NumType, class Op1, class Op2, class Op3, class OpType, unsigned int Level>
+      const fma_engine<NumType, Op1, Op2, Op3, OpType, Level>& do_cache(const fma_engine_delayed_cache<NumType, Op1, Op2, Op3, OpType, Level>& eng)
+      {
+            return eng.get_cached_engine();
+      }
+
+      template <typename NumType, class Op1, class Op2, class Op3, class OpType, unsigned int Level>
+      struct data_engine_traits< fma_engine_delayed_cache<NumType, Op1, Op2, Op3, OpType, Level> >
+      {
+            typedef fma_engine<NumType, Op1, Op2, Op3, OpType, Level> cached_engine_t;
+            typedef fma_engine_delayed_cache<NumType, Op1, Op2, Op3, OpType, Level> const& ref_type_t;
+      };
+
+      template <typename NumType, class Op1, class Op2, class Op3, class OpType>
+      struct has_lagged_operand< fma_engine<NumType, Op1, Op2, Op3, OpType, 0> >
+      {
+            enum { result = has_lagged_operand<Op1>::result || has_lagged_operand<Op2>::result || has_lagged_operand<Op3>::result };
+      };
+
+      template <typename NumType, class Op1, class Op2, class Op3, class OpType, unsigned int Level>
+      struct has_lagged_operand< fma_engine_delayed_cache<NumType, Op1, Op2, Op3, OpType, Level> >
+      {
+            enum { result = has_lagged_operand<Op1>::result || has_lagged_operand<Op2>::result || has_lagged_operand<Op3>::result };
+      };
+
+      template <typename NumType, class Op1, class Op2, class Op3, class OpType>
+      bool same_operand(const fma_engine<NumType, Op1, Op2, Op3, OpType, 0>& x, const fma_engine<NumType, Op1, Op2, Op3, OpType, 0>& y)
+      {
+            return &x == &y or x.same_as(y);
+      }
       
 
+      /** Scalar operands
+       *  A vector with a scalar on either side is kept as scalar OP vector for the commutative operations,
+       *  subtracting a scalar is adding its negative and dividing by one is multiplying by its reciprocal.
+       *  Then a chain of + or * with scalars folds into a single operation at construction:
+       *  2.0*(3.0*x), (x*2.0)*3.0 and x/0.5*3.0 are all 6.0*x, (1.0 + x) - 2.0 is -1.0 + x - one node,
+       *  one cache key and one packed operation per element. The folded results can differ in the last
+       *  bits from the ones evaluated left to right, and x/s is not always correctly rounded
+       */
+      template <class OpType, typename NumType, class Eng, unsigned int Level>
+      calc_vector<NumType, op_engine_delayed_cache<NumType, scalar<NumType>, OpType, Eng, Level>, Level>
+      scalar_operation(const char* op, const NumType& x, const Eng& y, const std::string& y_id, calc_cache<NumType, Level>& cache)
+      {
+            typedef op_engine_delayed_cache<NumType, scalar<NumType>, OpType, Eng, Level> engine_t;
+            std::string hashed_id = cache.get_hash_key(scalar<NumType>::get_id(x) + op + y_id, y_id);
+            engine_t eng(hashed_id, scalar<NumType>(x), y, cache);
+            eng.set_operand_id(y_id);
+            return calc_vector<NumType, engine_t, Level>(hashed_id, y.get_start_date(), eng, cache);
+      }
+
+      // Level == 0 - no caching here & id is a dummy
+      template <class OpType, typename NumType, class Eng>
+      calc_vector<NumType, op_engine<NumType, scalar<NumType>, OpType, Eng, 0>, 0>
+      scalar_operation(const char*, const NumType& x, const Eng& y, const std::string&, const calc_cache<NumType, 0>&)
+      {
+            typedef calc_cache<NumType, 0> cache_t;
+            cache_t cache;
+            typedef op_engine<NumType, scalar<NumType>, OpType, Eng, 0> engine_t;
+            return calc_vector<NumType, engine_t, 0>(cache_t::get_dummy_key(), scalar<NumType>(x), y, cache);
+      }
+
 #define TACHY_EXPR_OPERATOR_PACK(OP_TYPE, OP) \
       /* 1) general case template for binary operation */                                    \
       template <typename NumType, class Eng1, class Eng2, unsigned int Level1, unsigned int Level2> \
@@ -329,7 +820,7 @@ namespace tachy
             typedef cache_chooser<(unsigned int)(cache_t::cache_level) == Level1, calc_cache<NumType, Level1>, calc_cache<NumType,Level2> > cache_chooser_t; \
             cache_t& cache = cache_chooser_t::choose(x.cache(), y.cache()); \
             typedef op_engine<NumType, typename data_engine_traits<Eng1>::cached_engine_t, OP_TYPE, typename data_engine_traits<Eng2>::cached_engine_t, take_min<Level1, Level2>::result> engine_t; \
-            std::string id = cache.get_hash_key(x.get_id() + #OP + y.get_id()); \
+            std::string id = cache.get_hash_key(x.get_id() + #OP + y.get_id(), x, y); \
             TACHY_LOG("Doing delayed cache calculations on " << id); \
             const typename data_engine_traits<Eng1>::cached_engine_t& eng_x = do_cache(x.engine()); \
             const typename data_engine_traits<Eng2>::cached_engine_t& eng_y = do_cache(y.engine()); \
@@ -343,7 +834,7 @@ namespace tachy
             typedef calc_cache<NumType, Level> cache_t; \
             cache_t& cache = x.cache();                               \
             typedef op_engine_delayed_cache<NumType, Eng1, OP_TYPE, Eng2, Level> engine_t; \
-            std::string id = cache.get_hash_key(x.get_id() + #OP + y.get_id()); \
+            std::string id = cache.get_hash_key(x.get_id() + #OP + y.get_id(), x.get_id(), y.get_id()); \
             return calc_vector<NumType, engine_t, Level>(id, x.engine(), y.engine(), cache); \
       } \
       \
@@ -363,44 +854,14 @@ namespace tachy
       template <typename NumType, class Eng, unsigned int Level> \
       calc_vector<NumType, op_engine_delayed_cache<NumType, scalar<NumType>, OP_TYPE, Eng, Level>, Level> operator OP (const NumType& x, const calc_vector<NumType, Eng, Level>& y) \
       { \
-            std::string x_id = scalar<NumType>::get_id(x); \
-            std::string hashed_id = y.cache().get_hash_key(x_id + #OP + y.get_id()); \
-            typedef op_engine_delayed_cache<NumType, scalar<NumType>, OP_TYPE, Eng, Level> engine_t; \
-            engine_t eng(hashed_id, scalar<NumType>(x), y.engine(), y.cache()); \
-            return calc_vector<NumType, engine_t, Level>(hashed_id, y.get_start_date(), eng, y.cache()); \
-      } \
-      \
-      /* 5) general template for vector with a scalar */         \
-      template <typename NumType, class Eng, unsigned int Level> \
-      calc_vector<NumType, op_engine_delayed_cache<NumType, Eng, OP_TYPE, scalar<NumType>, Level>, Level> operator OP (const calc_vector<NumType, Eng, Level>& x, const NumType& y) \
-      { \
-            std::string y_id = scalar<NumType>::get_id(y); \
-            std::string hashed_id = x.cache().get_hash_key(x.get_id() + #OP + y_id); \
-            typedef op_engine_delayed_cache<NumType, Eng, OP_TYPE, scalar<NumType>, Level> engine_t; \
-            engine_t eng(hashed_id, x.engine(), scalar<NumType>(y), x.cache()); \
-            return calc_vector<NumType, engine_t, Level>(hashed_id, x.get_start_date(), eng, x.cache()); \
+            return scalar_operation<OP_TYPE>(#OP, x, y.engine(), y.get_id(), y.cache()); \
       } \
       \
-      /* 6) template for scalar and a non-cacheable (Level == 0) vector */  \
+      /* 5) template for scalar and a non-cacheable (Level == 0) vector */  \
       template <typename NumType, class Eng>               \
       calc_vector<NumType, op_engine<NumType, scalar<NumType>, OP_TYPE, Eng, 0>, 0> operator OP (const NumType& x, const calc_vector<NumType, Eng, 0>& y) \
       { \
-            typedef calc_cache<NumType, 0> cache_t; \
-            cache_t cache; \
-            std::string hashed_id = cache_t::get_dummy_key();                   \
-            typedef op_engine<NumType, scalar<NumType>, OP_TYPE, Eng, 0> engine_t; \
-            return calc_vector<NumType, engine_t, 0>(hashed_id, scalar<NumType>(x), y.engine(), cache); \
-      } \
-      \
-      /* 7) template for a non-cacheable (Level == 0) vector and a scalar */  \
-      template <typename NumType, class Eng> \
-      calc_vector<NumType, op_engine<NumType, Eng, OP_TYPE, scalar<NumType>, 0>, 0> operator OP (const calc_vector<NumType, Eng, 0>& x, const NumType& y) \
-      { \
-            typedef calc_cache<NumType, 0> cache_t; \
-            cache_t cache; \
-            std::string hashed_id = cache_t::get_dummy_key(); \
-            typedef op_engine<NumType, Eng, OP_TYPE, scalar<NumType>, 0> engine_t; \
-            return calc_vector<NumType, engine_t, 0>(hashed_id, x.engine(), scalar<NumType>(y), cache); \
+            return scalar_operation<OP_TYPE>(#OP, x, y.engine(), y.get_id(), y.cache()); \
       }
 
 // end of TACHY_EXPR_OPERATOR_PACK macro
@@ -409,6 +870,147 @@ namespace tachy
       TACHY_EXPR_OPERATOR_PACK(OpMinus<NumType>, -)
       TACHY_EXPR_OPERATOR_PACK(OpTimes<NumType>, *)
       TACHY_EXPR_OPERATOR_PACK(OpDivide<NumType>, /)
+
+#define TACHY_EXPR_SCALAR_FOLD_PACK(OP_TYPE, OP) \
+      /* 1) s OP (t OP y) is (s OP t) OP y */ \
+      template <typename NumType, class Eng, unsigned int Level> \
+      calc_vector<NumType, op_engine_delayed_cache<NumType, scalar<NumType>, OP_TYPE, Eng, Level>, Level> operator OP (const NumType& x, const calc_vector<NumType, op_engine_delayed_cache<NumType, scalar<NumType>, OP_TYPE, Eng, Level>, Level>& y) \
+      { \
+            return scalar_operation<OP_TYPE>(#OP, OP_TYPE::apply(x, y.engine().get_op1()[0]), y.engine().get_op2(), y.engine().get_operand_id(), y.cache()); \
+      } \
+      \
+      /* 2) same for Level == 0 */ \
+      template <typename NumType, class Eng> \
+      calc_vector<NumType, op_engine<NumType, scalar<NumType>, OP_TYPE, Eng, 0>, 0> operator OP (const NumType& x, const calc_vector<NumType, op_engine<NumType, scalar<NumType>, OP_TYPE, Eng, 0>, 0>& y) \
+      { \
+            return scalar_operation<OP_TYPE>(#OP, OP_TYPE::apply(x, y.engine().get_op1()[0]), y.engine().get_op2(), std::string(), y.cache()); \
+      } \
+      \
+      /* 3) y OP s is s OP y */ \
+      template <typename NumType, class Eng, unsigned int Level> \
+      auto operator OP (const calc_vector<NumType, Eng, Level>& x, const NumType& y) -> decltype(y OP x) \
+      { \
+            return y OP x; \
+      }
+
+// end of TACHY_EXPR_SCALAR_FOLD_PACK macro
+
+      TACHY_EXPR_SCALAR_FOLD_PACK(OpPlus<NumType>,  +)
+      TACHY_EXPR_SCALAR_FOLD_PACK(OpTimes<NumType>, *)
+
+      // x - s is x + (-s), exact
+      template <typename NumType, class Eng, unsigned int Level>
+      auto operator- (const calc_vector<NumType, Eng, Level>& x, const NumType& y) -> decltype(-y + x)
+      {
+            return -y + x;
+      }
+
+      // x/s is x*(1/s)
+      template <typename NumType, class Eng, unsigned int Level>
+      auto operator/ (const calc_vector<NumType, Eng, Level>& x, const NumType& y) -> decltype(y*x)
+      {
+            return (NumType(1)/y)*x;
+      }
+
+      /** Fused multiply-add
+       *  A product plus or minus another operand is built as one fused node - one cache key and one packed
+       *  operation per element - when the product is not cached on its own: at Level 0 and between operands
+       *  of the same Level. The keys are those of the separate operations prefixed with FMA_, so a fused node and
+       *  an unfused sum of the same operands are cached apart. x*y - s is -s + x*y, so it fuses too
+       */
+      template <class OpType, typename NumType, class Op1, class Op2, class Op3, unsigned int Level>
+      calc_vector<NumType, fma_engine_delayed_cache<NumType, Op1, Op2, Op3, OpType, Level>, Level>
+      fused_operation(const std::string& id, const Op1& x, const Op2& y, const Op3& z, calc_cache<NumType, Level>& cache)
+      {
+            typedef fma_engine_delayed_cache<NumType, Op1, Op2, Op3, OpType, Level> engine_t;
+            engine_t eng(id, x, y, z, cache);
+            return calc_vector<NumType, engine_t, Level>(id, eng.get_start_date(), eng, cache);
+      }
+
+      // Level == 0 - no caching here & id is a dummy
+      template <class OpType, typename NumType, class Op1, class Op2, class Op3>
+      calc_vector<NumType, fma_engine<NumType, Op1, Op2, Op3, OpType, 0>, 0>
+      fused_operation(const std::string&, const Op1& x, const Op2& y, const Op3& z, const calc_cache<NumType, 0>& cache)
+      {
+            typedef calc_cache<NumType, 0> cache_t;
+            typedef fma_engine<NumType, Op1, Op2, Op3, OpType, 0> engine_t;
+            engine_t eng(cache_t::get_dummy_key(), x, y, z, cache);
+            return calc_vector<NumType, engine_t, 0>(cache_t::get_dummy_key(), eng.get_start_date(), eng, cache);
+      }
+
+/* PRODUCT_ENGINE(OP1, OP2) and FMA_ENGINE(OP1, OP2, OP3, OP_TYPE) name the engines at LEVEL, __VA_ARGS__ is its template parameter if any */
+#define TACHY_EXPR_FMA_PACK(PRODUCT_ENGINE, FMA_ENGINE, LEVEL, ...) \
+      /* 1) x*y + z */ \
+      template <typename NumType, class Op1, class Op2, class Eng __VA_ARGS__> \
+      calc_vector<NumType, FMA_ENGINE(Op1, Op2, Eng, OpMulAdd<NumType>), LEVEL> operator+ (const calc_vector<NumType, PRODUCT_ENGINE(Op1, Op2), LEVEL>& x, const calc_vector<NumType, Eng, LEVEL>& y) \
+      { \
+            return fused_operation<OpMulAdd<NumType> >(x.cache().get_hash_key(std::string("FMA_") + x.get_id() + "+" + y.get_id(), x.get_id(), y.get_id()), x.engine().get_op1(), x.engine().get_op2(), y.engine(), x.cache()); \
+      } \
+      \
+      /* 2) z + x*y */ \
+      template <typename NumType, class Op1, class Op2, class Eng __VA_ARGS__> \
+      calc_vector<NumType, FMA_ENGINE(Op1, Op2, Eng, OpMulAdd<NumType>), LEVEL> operator+ (const calc_vector<NumType, Eng, LEVEL>& x, const calc_vector<NumType, PRODUCT_ENGINE(Op1, Op2), LEVEL>& y) \
+      { \
+            return fused_operation<OpMulAdd<NumType> >(y.cache().get_hash_key(std::string("FMA_") + x.get_id() + "+" + y.get_id(), x.get_id(), y.get_id()), y.engine().get_op1(), y.engine().get_op2(), x.engine(), y.cache()); \
+      } \
+      \
+      /* 3) x*y + z*w - the left product is fused */ \
+      template <typename NumType, class Op1, class Op2, class Op3, class Op4 __VA_ARGS__> \
+      calc_vector<NumType, FMA_ENGINE(Op1, Op2, PRODUCT_ENGINE(Op3, Op4), OpMulAdd<NumType>), LEVEL> operator+ (const calc_vector<NumType, PRODUCT_ENGINE(Op1, Op2), LEVEL>& x, const calc_vector<NumType, PRODUCT_ENGINE(Op3, Op4), LEVEL>& y) \
+      { \
+            return fused_operation<OpMulAdd<NumType> >(x.cache().get_hash_key(std::string("FMA_") + x.get_id() + "+" + y.get_id(), x.get_id(), y.get_id()), x.engine().get_op1(), x.engine().get_op2(), y.engine(), x.cache()); \
+      } \
+      \
+      /* 4) x*y - z */ \
+      template <typename NumType, class Op1, class Op2, class Eng __VA_ARGS__> \
+      calc_vector<NumType, FMA_ENGINE(Op1, Op2, Eng, OpMulSub<NumType>), LEVEL> operator- (const calc_vector<NumType, PRODUCT_ENGINE(Op1, Op2), LEVEL>& x, const calc_vector<NumType, Eng, LEVEL>& y) \
+      { \
+            return fused_operation<OpMulSub<NumType> >(x.cache().get_hash_key(std::string("FMA_") + x.get_id() + "-" + y.get_id(), x.get_id(), y.get_id()), x.engine().get_op1(), x.engine().get_op2(), y.engine(), x.cache()); \
+      } \
+      \
+      /* 5) s + x*y, and x*y + s (see TACHY_EXPR_SCALAR_FOLD_PACK) */ \
+      template <typename NumType, class Op1, class Op2 __VA_ARGS__> \
+      calc_vector<NumType, FMA_ENGINE(Op1, Op2, scalar<NumType>, OpMulAdd<NumType>), LEVEL> operator+ (const NumType& x, const calc_vector<NumType, PRODUCT_ENGINE(Op1, Op2), LEVEL>& y) \
+      { \
+            return fused_operation<OpMulAdd<NumType> >(y.cache().get_hash_key(std::string("FMA_") + scalar<NumType>::get_id(x) + "+" + y.get_id(), y.get_id()), y.engine().get_op1(), y.engine().get_op2(), scalar<NumType>(x), y.cache()); \
+      }
+
+// end of TACHY_EXPR_FMA_PACK macro
+
+#define TACHY_EXPR_PRODUCT_ENGINE(OP1, OP2) op_engine_delayed_cache<NumType, OP1, OpTimes<NumType>, OP2, Level>
+#define TACHY_EXPR_FMA_ENGINE(OP1, OP2, OP3, OP_TYPE) fma_engine_delayed_cache<NumType, OP1, OP2, OP3, OP_TYPE, Level>
+      TACHY_EXPR_FMA_PACK(TACHY_EXPR_PRODUCT_ENGINE, TACHY_EXPR_FMA_ENGINE, Level, , unsigned int Level)
+#undef TACHY_EXPR_PRODUCT_ENGINE
+#undef TACHY_EXPR_FMA_ENGINE
+
+#define TACHY_EXPR_PRODUCT_ENGINE(OP1, OP2) op_engine<NumType, OP1, OpTimes<NumType>, OP2, 0>
+#define TACHY_EXPR_FMA_ENGINE(OP1, OP2, OP3, OP_TYPE) fma_engine<NumType, OP1, OP2, OP3, OP_TYPE, 0>
+      TACHY_EXPR_FMA_PACK(TACHY_EXPR_PRODUCT_ENGINE, TACHY_EXPR_FMA_ENGINE, 0, )
+#undef TACHY_EXPR_PRODUCT_ENGINE
+#undef TACHY_EXPR_FMA_ENGINE
+
+      /** Compound assignments: the stored vector is updated in place, in one packed pass over it,
+       *  without building an expression around it (see calc_vector::update)
+       */
+#define TACHY_COMPOUND_ASSIGNMENT_PACK(OP_TYPE, OP) \
+      template <typename NumType, unsigned int Level, class Eng, unsigned int OtherLevel> \
+      calc_vector<NumType, vector_engine<NumType>, Level>& operator OP (calc_vector<NumType, vector_engine<NumType>, Level>& x, const calc_vector<NumType, Eng, OtherLevel>& y) \
+      { \
+            return x.template update<OP_TYPE>(y); \
+      } \
+      \
+      template <typename NumType, unsigned int Level> \
+      calc_vector<NumType, vector_engine<NumType>, Level>& operator OP (calc_vector<NumType, vector_engine<NumType>, Level>& x, const NumType& y) \
+      { \
+            return x.template update<OP_TYPE>(scalar<NumType>(y)); \
+      }
+
+// end of TACHY_COMPOUND_ASSIGNMENT_PACK macro
+
+      TACHY_COMPOUND_ASSIGNMENT_PACK(OpPlus<NumType>,  +=)
+      TACHY_COMPOUND_ASSIGNMENT_PACK(OpMinus<NumType>, -=)
+      TACHY_COMPOUND_ASSIGNMENT_PACK(OpTimes<NumType>, *=)
+      TACHY_COMPOUND_ASSIGNMENT_PACK(OpDivide<NumType>, /=)
 }
 
 #endif // TACHY_EXPR_H__INCLUDED
@@ -15,9 +15,10 @@ namespace tachy
                   return fct(arg[i]);
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             static inline typename arch_traits_t::packed_t call_packed(unsigned int i, const Arg& arg, const Functor& fct)
             {
-                  return fct.apply_packed(arg.get_packed(i));
+                  return fct.apply_packed(arg.template get_packed<Aligned, Prologue>(i));
             }
       };
 
@@ -31,9 +32,10 @@ namespace tachy
                   return fct(i, arg[i]);
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             static inline typename arch_traits_t::packed_t call_packed(unsigned int i, const Arg& arg, const Functor& fct)
             {
-                  return fct.apply_packed(i, arg.get_packed(i));
+                  return fct.apply_packed(i, arg.template get_packed<Aligned, Prologue>(i));
             }
       };
 
@@ -80,7 +82,8 @@ namespace tachy
                   _cache(cache),
                   _id(key),
                   _engine(nullptr),
-                  _own_engine(true)
+                  _own_engine(true),
+                  _reads(arg)
             {
                   const auto k = _cache.find(key);
                   if (k == _cache.end())
@@ -88,8 +91,8 @@ namespace tachy
                         TACHY_LOG("Cache " << cache.get_id() << ": calculating for " << key);
                         unsigned int sz = arg.size();
                         _engine = new data_engine_t(start_date, sz, NumType(0));
-                        for (int i = 0; i < sz; ++i)
-                              (*_engine)[i] = FcnCallPolicy::call(i, arg, fct);
+                        for (unsigned int i = 0; i < sz; i += arch_traits_t::stride)
+                              _engine->set_packed(i, FcnCallPolicy::call_packed(i, arg, fct));
                   }
                   else
                   {
@@ -103,7 +106,8 @@ namespace tachy
                   _cache(other._cache),
                   _id(other._id),
                   _engine(other._engine),
-                  _own_engine(other._engine ? false : true)
+                  _own_engine(other._engine ? false : true),
+                  _reads(other._reads)
             {}
 
             ~functor_engine()
@@ -123,9 +127,10 @@ namespace tachy
                   return (*_engine)[idx];
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return arch_traits_t::loadu(&(*_engine)[idx]);
+                  return _engine->template get_packed<Aligned, Prologue>(idx);
             }
 
             unsigned int size() const
@@ -137,6 +142,11 @@ namespace tachy
             {
                   return _engine->get_start_date();
             }
+
+            int get_alignment() const
+            {
+                  return _engine->get_alignment();
+            }
             
             template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
             {
@@ -147,12 +157,20 @@ namespace tachy
             {
                   return _engine == &eng;
             }
+
+            // what the argument read when the result was computed
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.read(_reads);
+                  return false;
+            }
             
       protected:
             cache_t& _cache;
             std::string _id;
             data_engine_t* _engine;
             bool _own_engine;
+            operand_reads<NumType> _reads;
 
             functor_engine& operator= (const functor_engine& other)
             {
@@ -168,11 +186,18 @@ namespace tachy
 
             functor_engine(const Arg& arg, const Functor& fct)
                   : _arg(arg),
-                    _fct(fct)
+                    _fct(fct),
+                    _memo(nullptr)
+            {}
+            functor_engine(const std::string&, const tachy_date&, const Arg& arg, const Functor& fct, const calc_cache<NumType, 0>&)
+                  : _arg(arg),
+                    _fct(fct),
+                    _memo(nullptr)
             {}
             functor_engine(const functor_engine& other)
                   : _arg(other._arg),
-                    _fct(other._fct)
+                    _fct(other._fct),
+                    _memo(nullptr)
             {}
             
             NumType operator[] (unsigned int idx) const
@@ -180,9 +205,18 @@ namespace tachy
                   return FcnCallPolicy::call(idx, _arg, _fct);
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return FcnCallPolicy::call_packed(idx, _arg, _fct);
+                  if (_memo)
+                        return _memo->template get<Aligned, Prologue>(*this, idx);
+                  return evaluate_packed<Aligned, Prologue>(idx);
+            }
+
+            template <bool Aligned, bool Prologue>
+            typename arch_traits_t::packed_t evaluate_packed(int idx) const
+            {
+                  return FcnCallPolicy::template call_packed<Aligned, Prologue>(idx, _arg, _fct);
             }
 
             unsigned int size() const
@@ -194,6 +228,11 @@ namespace tachy
             {
                   return _arg.get_start_date();
             }
+
+            int get_alignment() const
+            {
+                  return _arg.get_alignment();
+            }
             
             const Arg& arg() const
             {
@@ -209,11 +248,17 @@ namespace tachy
             {
                   return _arg.depends_on(eng);
             }
+
+            template <class LeafProbe> bool depends_on(const loop_invariants<NumType, LeafProbe>& inv) const
+            {
+                  return not inv.add(*this, _memo) and _arg.depends_on(inv);
+            }
             
       protected:
             typename data_engine_traits<Arg>::ref_type_t _arg;
 
             typename FunctorObjPolicy::held_const_functor_obj_t _fct;
+            mutable packed_memo<NumType>* _memo; // kept across passes over a pack (see loop_invariants)
 
             functor_engine& operator= (const functor_engine&)
             {
@@ -260,9 +305,10 @@ namespace tachy
                   return FcnCallPolicy::call(idx, _arg, _fct);
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return FcnCallPolicy::call_packed(idx, _arg, _fct);
+                  return FcnCallPolicy::template call_packed<Aligned, Prologue>(idx, _arg, _fct);
             }
 
             unsigned int size() const
@@ -274,6 +320,11 @@ namespace tachy
             {
                   return _arg.get_start_date();
             }
+
+            int get_alignment() const
+            {
+                  return _arg.get_alignment();
+            }
             
             const functor_engine<NumType, Arg, Functor, Level, FcnCallPolicy, FunctorObjPolicy>& get_cached_engine() const
             {
@@ -316,6 +367,246 @@ namespace tachy
             typedef functor_engine_delayed_cache<NumType, Arg, Functor, Level, FcnCallPolicy, FunctorObjPolicy> const& ref_type_t;
       };
 
+      template <typename NumType, class Arg, class Functor, class FcnCallPolicy, class FunctorObjPolicy>
+      struct has_lagged_operand< functor_engine<NumType, Arg, Functor, 0, FcnCallPolicy, FunctorObjPolicy> >
+      {
+            enum { result = has_lagged_operand<Arg>::result };
+      };
+
+      template <typename NumType, class Arg, class Functor, unsigned int Level, class FcnCallPolicy, class FunctorObjPolicy>
+      struct has_lagged_operand< functor_engine_delayed_cache<NumType, Arg, Functor, Level, FcnCallPolicy, FunctorObjPolicy> >
+      {
+            enum { result = has_lagged_operand<Arg>::result };
+      };
+
+
+      // CalcVector Engine for non-static functors of two arguments - e.g. surfaces
+      // These classes must implement "NumType operator()(NumType, NumType) const" and its packed counterpart
+      // "packed_t apply_packed(const packed_t&, const packed_t&) const"; arguments are aligned on start dates as in op_engine
+
+      template <typename NumType,
+                typename Arg1,
+                typename Arg2,
+                class Functor,
+                unsigned int Level,
+                class FunctorObjPolicy = functor_obj_policy_copy<Functor> >
+      class binary_functor_engine
+      {
+      private:
+            typedef vector_engine<NumType> data_engine_t;
+            typedef calc_cache<NumType, Level> cache_t;
+            
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            
+            binary_functor_engine(const std::string& key, const Arg1& arg1, const Arg2& arg2, const Functor& fct, calc_cache<NumType, Level>& cache) :
+                  _cache(cache),
+                  _id(key),
+                  _engine(nullptr),
+                  _own_engine(true),
+                  _reads(arg1, arg2)
+            {
+                  const auto k = _cache.find(key);
+                  if (k == _cache.end())
+                  {
+                        TACHY_LOG("Cache " << cache.get_id() << ": calculating for " << key);
+                        tachy_date dt1 = arg1.get_start_date();
+                        tachy_date dt2 = arg2.get_start_date();
+                        tachy_date dt = dt1 < dt2 ? dt2 : dt1;
+                        int offset1 = std::max<int>(0, dt - dt1);
+                        int offset2 = std::max<int>(0, dt - dt2);
+                        unsigned int sz1 = arg1.size() - offset1;
+                        unsigned int sz2 = arg2.size() - offset2;
+                        unsigned int sz = sz1 && sz2 ? std::min(sz1, sz2) : sz1 + sz2;
+                        _engine = new data_engine_t(dt, sz, NumType(0));
+                        for (unsigned int i = 0; i < sz; i += arch_traits_t::stride)
+                              _engine->set_packed(i, fct.apply_packed(arg1.get_packed(i + offset1), arg2.get_packed(i + offset2)));
+                  }
+                  else
+                  {
+                        TACHY_LOG("Cache " << cache.get_id() << ": using cached result for " << key);
+                        _engine = dynamic_cast<data_engine_t*>(k->second);
+                        _own_engine = false;
+                  }
+            }
+
+            binary_functor_engine(const binary_functor_engine& other) :
+                  _cache(other._cache),
+                  _id(other._id),
+                  _engine(other._engine),
+                  _own_engine(other._engine ? false : true),
+                  _reads(other._reads)
+            {}
+
+            ~binary_functor_engine()
+            {
+                  if (_own_engine)
+                  {
+                        auto k = _cache.find(_id);
+                        if (k == _cache.end())
+                              _cache[_id] = _engine;
+                        else
+                              delete _engine;
+                  }
+            }
+
+            NumType operator[] (const unsigned int idx) const
+            {
+                  return (*_engine)[idx];
+            }
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
+            {
+                  return _engine->template get_packed<Aligned, Prologue>(idx);
+            }
+
+            unsigned int size() const
+            {
+                  return _engine->size();
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _engine->get_start_date();
+            }
+
+            int get_alignment() const
+            {
+                  return _engine->get_alignment();
+            }
+            
+            template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
+            {
+                  return _engine and eng.depends_on(*_engine);
+            }
+            
+            bool depends_on(const data_engine_t& eng) const
+            {
+                  return _engine == &eng;
+            }
+
+            // what the argument read when the result was computed
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.read(_reads);
+                  return false;
+            }
+            
+      protected:
+            cache_t& _cache;
+            std::string _id;
+            data_engine_t* _engine;
+            bool _own_engine;
+            operand_reads<NumType> _reads;
+
+            binary_functor_engine& operator= (const binary_functor_engine& other)
+            {
+                  return *this;
+            }
+      };
+
+      template <typename NumType, typename Arg1, typename Arg2, class Functor, class FunctorObjPolicy>
+      class binary_functor_engine<NumType, Arg1, Arg2, Functor, 0, FunctorObjPolicy>
+      {
+      protected:
+
+            void setup()
+            {
+                  tachy_date dt1 = _arg1.get_start_date();
+                  tachy_date dt2 = _arg2.get_start_date();
+                  _dt = dt1 < dt2 ? dt2 : dt1;
+                  _offset1 = std::max<int>(0, _dt - dt1);
+                  _offset2 = std::max<int>(0, _dt - dt2);
+                  unsigned int sz1 = _arg1.size() - _offset1;
+                  unsigned int sz2 = _arg2.size() - _offset2;
+                  _sz = sz1 && sz2 ? std::min(sz1, sz2) : sz1 + sz2;
+            }
+            
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            binary_functor_engine(const Arg1& arg1, const Arg2& arg2, const Functor& fct) :
+                  _arg1(arg1),
+                  _arg2(arg2),
+                  _fct(fct),
+                  _dt(tachy_date::min_date())
+            {
+                  setup();
+            }
+
+            binary_functor_engine(const std::string&, const Arg1& arg1, const Arg2& arg2, const Functor& fct, const calc_cache<NumType, 0>&) :
+                  _arg1(arg1),
+                  _arg2(arg2),
+                  _fct(fct),
+                  _dt(tachy_date::min_date())
+            {
+                  setup();
+            }
+
+            binary_functor_engine(const binary_functor_engine& other) :
+                  _arg1(other._arg1),
+                  _arg2(other._arg2),
+                  _fct(other._fct),
+                  _dt(other._dt),
+                  _sz(other._sz),
+                  _offset1(other._offset1),
+                  _offset2(other._offset2)
+            {}
+            
+            NumType operator[] (unsigned int idx) const
+            {
+                  return _fct(_arg1[idx + _offset1], _arg2[idx + _offset2]);
+            }
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
+            {
+                  return _fct.apply_packed(_arg1.template get_packed<Aligned, Prologue>(idx + _offset1), _arg2.template get_packed<Aligned, Prologue>(idx + _offset2));
+            }
+
+            unsigned int size() const
+            {
+                  return _sz;
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _dt;
+            }
+
+            int get_alignment() const
+            {
+                  typedef packed_alignment<NumType> align_t;
+                  return align_t::combine(align_t::shift(_arg1.get_alignment(), _offset1), align_t::shift(_arg2.get_alignment(), _offset2));
+            }
+            
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return _arg1.depends_on(eng) or _arg2.depends_on(eng);
+            }
+            
+      protected:
+            typename data_engine_traits<Arg1>::ref_type_t _arg1;
+            typename data_engine_traits<Arg2>::ref_type_t _arg2;
+            typename FunctorObjPolicy::held_const_functor_obj_t _fct;
+            tachy_date   _dt;
+            unsigned int _sz;
+            unsigned int _offset1;
+            unsigned int _offset2;
+
+            binary_functor_engine& operator= (const binary_functor_engine&)
+            {
+                  return *this;
+            }
+      };
+
+      template <typename NumType, typename Arg1, typename Arg2, class Functor, class FunctorObjPolicy>
+      struct has_lagged_operand< binary_functor_engine<NumType, Arg1, Arg2, Functor, 0, FunctorObjPolicy> >
+      {
+            enum { result = has_lagged_operand<Arg1>::result || has_lagged_operand<Arg2>::result };
+      };
+
       
       template <typename NumType>
       class exp_functor
@@ -337,7 +628,7 @@ namespace tachy
             calc_vector<NumType, functor_engine<NumType, Engine, exp_functor<NumType>, Level>, Level> operator()(const calc_vector<NumType, Engine, Level>& x) const
             {
                   typedef functor_engine<NumType, Engine, exp_functor<NumType>, Level> engine_t;
-                  std::string hashed_id = x.cache().get_hash_key(_key + x.get_id());
+                  std::string hashed_id = x.cache().get_hash_key(_key + x.get_id(), x.get_id());
                   engine_t eng(hashed_id, x.engine(), *this, x.cache());
                   return calc_vector<NumType, engine_t, Level>(hashed_id, x.get_start_date(), eng, x.cache());
             }
@@ -469,7 +760,7 @@ namespace tachy
       { \
             typedef functor_engine<NumType, Engine, FUNC_TYPE, Level> engine_t; \
             FUNC_TYPE bf(param); \
-            std::string hashed_id = x.cache().get_hash_key(bf.get_id() + scalar<NumType>::get_id(param) + std::string("_") + x.get_id()); \
+            std::string hashed_id = x.cache().get_hash_key(bf.get_id() + scalar<NumType>::get_id(param) + std::string("_") + x.get_id(), x.get_id()); \
             engine_t eng(hashed_id, x.get_start_date(), x.engine(), bf, x.cache()); \
             return calc_vector<NumType, engine_t, Level>(hashed_id, x.get_start_date(), eng, x.cache()); \
       } \
@@ -505,7 +796,7 @@ namespace tachy
       {
             typedef functor_engine<NumType, Engine, min_max_functor<NumType>, Level> engine_t;
             min_max_functor<NumType> mmf(lower, upper);
-            std::string hashed_id = x.cache().get_hash_key(mmf.get_id() + scalar<NumType>::get_id(lower) + std::string("_") + scalar<NumType>::get_id(upper) + std::string("_") + x.get_id());
+            std::string hashed_id = x.cache().get_hash_key(mmf.get_id() + scalar<NumType>::get_id(lower) + std::string("_") + scalar<NumType>::get_id(upper) + std::string("_") + x.get_id(), x.get_id());
             engine_t eng(hashed_id, x.get_start_date(), x.engine(), mmf, x.cache());
             return calc_vector<NumType, engine_t, Level>(hashed_id, x.get_start_date(), eng, x.cache());
       }
@@ -0,0 +1,239 @@
+#if !defined(TACHY_GENERATOR_ENGINE_H__INCLUDED)
+#define TACHY_GENERATOR_ENGINE_H__INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "tachy_arch_traits.h"
+#include "tachy_date.h"
+
+namespace tachy
+{
+      // Generators compute the value at index t in closed form, so vectors like flat rates, seasoning ramps
+      // or decay factors need no storage. Each generator implements "NumType operator()(int t) const" and
+      // "packed_t apply_packed(int t) const" for the pack starting at t - the packs are built from the lane
+      // offsets { 0, 1, ..., stride-1 } kept with the generator, not lane by lane
+
+      template <typename NumType>
+      struct generator_util
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            // { x0, x0*r, x0*r^2, ... }
+            static typename arch_traits_t::packed_t powers(NumType x0, NumType r)
+            {
+                  typename arch_traits_t::packed_t p;
+                  NumType x = x0;
+                  for (int i = 0; i < arch_traits_t::stride; ++i, x *= r)
+                        ((NumType*)(&p))[i] = x;
+                  return p;
+            }
+
+            // { 0, 1, ..., stride-1 }
+            static typename arch_traits_t::packed_t lanes()
+            {
+                  typename arch_traits_t::packed_t p;
+                  for (int i = 0; i < arch_traits_t::stride; ++i)
+                        ((NumType*)(&p))[i] = NumType(i);
+                  return p;
+            }
+      };
+
+      template <typename NumType>
+      class constant_generator
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            explicit constant_generator(NumType x) :
+                  _x(x),
+                  _packed(arch_traits_t::set1(x))
+            {}
+
+            inline NumType operator()(int) const
+            {
+                  return _x;
+            }
+
+            inline typename arch_traits_t::packed_t apply_packed(int) const
+            {
+                  return _packed;
+            }
+
+      private:
+            NumType _x;
+            typename arch_traits_t::packed_t _packed;
+      };
+
+      // a + b*t, clamped to [lo, hi] - e.g. seasoning min(age/30, 1) is affine_generator(age0/30, 1/30, 0, 1)
+      template <typename NumType>
+      class affine_generator
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            affine_generator(NumType a, NumType b,
+                             NumType lo = std::numeric_limits<NumType>::lowest(),
+                             NumType hi = std::numeric_limits<NumType>::max()) :
+                  _a(a),
+                  _b(b),
+                  _lo(lo),
+                  _hi(hi),
+                  _lanes(arch_traits_t::mul(arch_traits_t::set1(b), generator_util<NumType>::lanes())),
+                  _lo_packed(arch_traits_t::set1(lo)),
+                  _hi_packed(arch_traits_t::set1(hi))
+            {
+                  if (hi < lo)
+                        TACHY_THROW("Empty range for affine generator: [" << lo << ", " << hi << "]");
+            }
+
+            inline NumType operator()(int t) const
+            {
+                  return std::max(_lo, std::min(_hi, _a + _b*t));
+            }
+
+            inline typename arch_traits_t::packed_t apply_packed(int t) const
+            {
+                  return arch_traits_t::max(_lo_packed, arch_traits_t::min(_hi_packed, arch_traits_t::add(arch_traits_t::set1(_a + _b*t), _lanes)));
+            }
+
+      private:
+            NumType _a;
+            NumType _b;
+            NumType _lo;
+            NumType _hi;
+            typename arch_traits_t::packed_t _lanes;
+            typename arch_traits_t::packed_t _lo_packed;
+            typename arch_traits_t::packed_t _hi_packed;
+      };
+
+      // x0 before t0, x1 from t0 on
+      template <typename NumType>
+      class step_generator
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            step_generator(int t0, NumType x0, NumType x1) :
+                  _t0(t0),
+                  _x0(x0),
+                  _x1(x1),
+                  _lanes(generator_util<NumType>::lanes()),
+                  _x0_packed(arch_traits_t::set1(x0)),
+                  _x1_packed(arch_traits_t::set1(x1))
+            {}
+
+            inline NumType operator()(int t) const
+            {
+                  return t < _t0 ? _x0 : _x1;
+            }
+
+            // the lanes at or past t0 get s = 1, the others s = 0, the result x0*(1-s) + x1*s is exact
+            inline typename arch_traits_t::packed_t apply_packed(int t) const
+            {
+                  const typename arch_traits_t::packed_t one = arch_traits_t::set1(NumType(1));
+                  const typename arch_traits_t::packed_t s = arch_traits_t::max(arch_traits_t::zero(), arch_traits_t::min(one, arch_traits_t::add(arch_traits_t::set1(NumType(t - _t0 + 1)), _lanes)));
+                  return arch_traits_t::add(arch_traits_t::mul(_x0_packed, arch_traits_t::sub(one, s)), arch_traits_t::mul(_x1_packed, s));
+            }
+
+      private:
+            int _t0;
+            NumType _x0;
+            NumType _x1;
+            typename arch_traits_t::packed_t _lanes;
+            typename arch_traits_t::packed_t _x0_packed;
+            typename arch_traits_t::packed_t _x1_packed;
+      };
+
+      // x0*r^t - e.g. decay factors 0.98^t, or exp(-age/36) as geometric_generator(exp(-age0/36), exp(-1/36))
+      template <typename NumType>
+      class geometric_generator
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            geometric_generator(NumType x0, NumType r) :
+                  _x0(x0),
+                  _r(r),
+                  _powers(generator_util<NumType>::powers(NumType(1), r))
+            {}
+
+            inline NumType operator()(int t) const
+            {
+                  return _x0*std::pow(_r, NumType(t));
+            }
+
+            inline typename arch_traits_t::packed_t apply_packed(int t) const
+            {
+                  return arch_traits_t::mul(arch_traits_t::set1((*this)(t)), _powers);
+            }
+
+      private:
+            NumType _x0;
+            NumType _r;
+            typename arch_traits_t::packed_t _powers;
+      };
+
+      // CalcVector engine for generators - no storage, can be used at any level in place of vector_engine
+      // (see iota_engine for integer ramps)
+      template <typename NumType, class Generator>
+      class generator_engine
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef Generator generator_t;
+
+            generator_engine(const tachy_date& start_date, unsigned int n, const Generator& gen) :
+                  _gen(gen),
+                  _start_date(start_date),
+                  _size(n)
+            {}
+
+            generator_engine(const generator_engine& other) :
+                  _gen(other._gen),
+                  _start_date(other._start_date),
+                  _size(other._size)
+            {}
+
+            generator_engine& operator= (const generator_engine& other) = delete;
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
+            {
+                  return _gen.apply_packed(idx);
+            }
+
+            NumType operator[] (int idx) const
+            {
+                  return _gen(idx);
+            }
+
+            unsigned int size() const
+            {
+                  return _size;
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _start_date;
+            }
+
+            int get_alignment() const
+            {
+                  return packed_alignment<NumType>::any;
+            }
+
+            template <class SomeDataEngine> constexpr bool depends_on(const SomeDataEngine&) const
+            {
+                  return false;
+            }
+
+      protected:
+            Generator    _gen;
+            tachy_date   _start_date;
+            unsigned int _size;
+      };
+}
+
+#endif // TACHY_GENERATOR_ENGINE_H__INCLUDED
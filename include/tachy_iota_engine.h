@@ -3,6 +3,7 @@
 
 #include "tachy_arch_traits.h"
 #include "tachy_date.h"
+#include "tachy_generator_engine.h"
 
 namespace tachy
 {
@@ -17,29 +18,30 @@ namespace tachy
             iota_engine(const tachy_date& start_date) :
                   _start_date(start_date),
                   _first(0),
-                  _size(0)
+                  _size(0),
+                  _lanes(generator_util<NumType>::lanes())
             {}
 
             iota_engine(const tachy_date& start_date, int first, unsigned int n) :
                   _start_date(start_date),
                   _first(first),
-                  _size(n)
+                  _size(n),
+                  _lanes(generator_util<NumType>::lanes())
             {}
 
             iota_engine(const iota_engine& other) :
                   _start_date(other._start_date),
                   _first(other._first),
-                  _size(other._size)
+                  _size(other._size),
+                  _lanes(other._lanes)
             {}
 
             iota_engine& operator= (const iota_engine& other) = delete;
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  typename arch_traits_t::packed_t p;
-                  for (int i = 0; i < arch_traits_t::stride; ++i)
-			((typename arch_traits_t::scalar_t*)(&p))[i] = (typename arch_traits_t::scalar_t)(_first + idx + i);
-                  return p;
+                  return arch_traits_t::add(arch_traits_t::set1(NumType(_first + idx)), _lanes);
             }
 
             int operator[] (int idx) const
@@ -56,11 +58,22 @@ namespace tachy
             {
                   return _start_date;
             }
+
+            int get_alignment() const
+            {
+                  return packed_alignment<NumType>::any;
+            }
+
+            template <class SomeDataEngine> constexpr bool depends_on(const SomeDataEngine&) const
+            {
+                  return false;
+            }
             
       protected:
             tachy_date   _start_date;
             int          _first;
             unsigned int _size;
+            typename arch_traits_t::packed_t _lanes; // { 0, 1, ..., stride-1 }
       };
 }
 
@@ -1,12 +1,190 @@
 #if !defined(TACHY_LAGGED_ENGINE_H__INCLUDED)
 #define TACHY_LAGGED_ENGINE_H__INCLUDED
 
+#include <algorithm>
+#include <vector>
+
 #include "tachy_arch_traits.h"
 #include "tachy_calc_cache.h"
 #include "tachy_date.h"
 
 namespace tachy
 {
+      // Assignment alias analysis: assigning an expression which reads the target through a positive lag
+      // is a recursion and must be evaluated element by element, in order.
+      // At compile time: whether an engine reads any of its operands through a lag - engines evaluating
+      // their operands on demand forward this to the operands, leaves and eagerly cached engines don't
+      template <class Engine>
+      struct has_lagged_operand
+      {
+            enum { result = 0 };
+      };
+
+      // At run time: passed to depends_on() of the assigned expression, the probe matches only the
+      // lagged reads of the target (see lagged_engine_base), plain reads of it are element-wise and safe.
+      // With Lead, it matches the reads through a negative lag instead - ahead of the element evaluated
+      template <class Target, bool Lead = false>
+      class lagged_alias_probe
+      {
+      public:
+            explicit lagged_alias_probe(const Target& target) :
+                  _target(target)
+            {}
+
+            const Target& target() const
+            {
+                  return _target;
+            }
+
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return eng.depends_on(*this);
+            }
+
+            bool depends_on(const Target&) const
+            {
+                  return false;
+            }
+
+      private:
+            const Target& _target;
+      };
+
+      template <typename NumType> class vector_engine;
+      template <typename NumType> class operand_reads;
+
+      // The longest lead an expression reads its vectors through: passed to depends_on() of the expression,
+      // the probe follows the lags down to the vectors (see lagged_engine_base). When the vectors change from
+      // a date on, the expression changes from that many months earlier on.
+      // The eager nodes, which compute their result when they are created, report what their operands read
+      // then (see operand_reads): the probe also collects the vectors read that way, with their values of
+      // the time the expression was built.
+      // On the way, the probe also notes the longest checked lag walked through: the packs of the expression
+      // before that index may read before the start of an operand (see packed_prologue)
+      template <typename NumType>
+      class lead_probe
+      {
+      public:
+            lead_probe() :
+                  _lead(0),
+                  _max_lead(0),
+                  _prologue(0)
+            {}
+
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return eng.depends_on(*this);
+            }
+
+            bool depends_on(const vector_engine<NumType>& v) const
+            {
+                  _max_lead = std::max(_max_lead, _lead);
+                  add(_reads, &v);
+                  return false;
+            }
+
+            // the lead of the operands walked next
+            void shift(int lead) const
+            {
+                  _lead += lead;
+            }
+
+            // the reads of the operands of an eager node
+            void read(const operand_reads<NumType>& reads) const
+            {
+                  if (reads.vectors().empty())
+                        return;
+                  _max_lead = std::max(_max_lead, _lead + reads.max_lead());
+                  for (auto v : reads.vectors())
+                        add(_eager_reads, v);
+            }
+
+            // a checked lag of the operands walked next
+            void check_lag(int lag) const
+            {
+                  _prologue = std::max(_prologue, lag - _lead);
+            }
+
+            int max_lead() const
+            {
+                  return _max_lead;
+            }
+
+            // the index of the expression from which on no checked lag reads before the start of its operand
+            int prologue() const
+            {
+                  return _prologue;
+            }
+
+            // the vectors read as the expression is evaluated
+            const std::vector<const vector_engine<NumType>*>& reads() const
+            {
+                  return _reads;
+            }
+
+            // the vectors read by the eager nodes, when the expression was built
+            const std::vector<const vector_engine<NumType>*>& eager_reads() const
+            {
+                  return _eager_reads;
+            }
+
+            bool reads_eagerly(const vector_engine<NumType>& v) const
+            {
+                  return std::find(_eager_reads.begin(), _eager_reads.end(), &v) != _eager_reads.end();
+            }
+
+      private:
+            typedef std::vector<const vector_engine<NumType>*> vectors_t;
+
+            static void add(vectors_t& vectors, const vector_engine<NumType>* v)
+            {
+                  if (std::find(vectors.begin(), vectors.end(), v) == vectors.end())
+                        vectors.push_back(v);
+            }
+
+            mutable int       _lead;
+            mutable int       _max_lead;
+            mutable int       _prologue;
+            mutable vectors_t _reads;
+            mutable vectors_t _eager_reads;
+      };
+
+      // What the operands of an eager node read when it was created: the vectors and the longest lead
+      // through which. The node keeps only its result, and reports these to lead_probe in its place
+      template <typename NumType>
+      class operand_reads
+      {
+      public:
+            template <class... Ops>
+            explicit operand_reads(const Ops&... ops)
+            {
+                  lead_probe<NumType> probe;
+                  const bool walked[] = { ops.depends_on(probe)... };
+                  (void)walked;
+                  _max_lead = probe.max_lead();
+                  _vectors = probe.reads();
+                  for (auto v : probe.eager_reads())
+                  {
+                        if (std::find(_vectors.begin(), _vectors.end(), v) == _vectors.end())
+                              _vectors.push_back(v);
+                  }
+            }
+
+            int max_lead() const
+            {
+                  return _max_lead;
+            }
+
+            const std::vector<const vector_engine<NumType>*>& vectors() const
+            {
+                  return _vectors;
+            }
+
+      private:
+            int _max_lead;
+            std::vector<const vector_engine<NumType>*> _vectors;
+      };
+
       // Note that lag is not a functor, because it works on the index into array, not array value at that index
       template <typename NumType, typename Op>
       class lagged_engine_base
@@ -17,25 +195,14 @@ namespace tachy
             lagged_engine_base(const Op& op, int lag) :
                   _op(op),
                   _lag(lag)
-            {
-                  if (_lag > 0)
-                        _op.set_assign_guard(*this);
-            }
+            {}
 
             // Copying is suspect - it may lead to dangling references (see the type of _op variable)
             lagged_engine_base(const lagged_engine_base& other) :
                   _op(other._op),
                   _lag(other._lag)
-            {
-                  if (_lag > 0)
-                        _op.set_assign_guard(*this);
-            }
+            {}
 
-            virtual ~lagged_engine_base()
-            {
-                  _op.release_assign_guard(*this);
-            }
-                        
             unsigned int size() const
             {
                   return _op.size();
@@ -46,6 +213,11 @@ namespace tachy
                   return _op.get_start_date();
             }
 
+            int get_alignment() const
+            {
+                  return packed_alignment<NumType>::shift(_op.get_alignment(), -_lag);
+            }
+
             template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
             {
                   return eng.depends_on(_op);
@@ -55,6 +227,29 @@ namespace tachy
             {
                   return this == &eng;
             }
+
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.shift(-_lag);
+                  _op.depends_on(probe);
+                  probe.shift(_lag);
+                  return false;
+            }
+
+            template <class Target, bool Lead> bool depends_on(const lagged_alias_probe<Target, Lead>& probe) const
+            {
+                  return (Lead ? _lag < 0 : _lag > 0) and _op.depends_on(probe.target());
+            }
+
+            const Op& op() const
+            {
+                  return _op;
+            }
+
+            int lag() const
+            {
+                  return _lag;
+            }
             
       protected:
             typename data_engine_traits<Op>::ref_type_t _op;
@@ -97,15 +292,79 @@ namespace tachy
 
             lagged_engine(const Op& op, int lag) : lagged_engine_base<NumType, Op>(op, lag) {}
             lagged_engine(const lagged_engine& other) : lagged_engine_base<NumType, Op>(other) {}
-                        
+
+            using lagged_engine_base<NumType, Op>::depends_on;
+
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  if (Checked)
+                        probe.check_lag(this->_lag);
+                  return lagged_engine_base<NumType, Op>::depends_on(probe);
+            }
+
             NumType operator[] (int idx) const
             {
                   return this->_op[lag_checking_policy<Checked>::lag(0, idx, this->_lag)]; // checking upper boundary is left for the operand itself
             }
 
+            // Only the first packs of a lagged operand need the boundary check (the prologue), the evaluation
+            // loops get the rest (the body) with Prologue off - a plain unchecked load from the operand
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return this->_op.get_packed(lag_checking_policy<Checked>::lag(0, idx, this->_lag));
+                  const int i = idx - this->_lag;
+                  if (Checked && Prologue && i < 0)
+                        return get_prologue_packed(i);
+                  return this->_op.template get_packed<Aligned, Prologue>(i);
+            }
+
+      private:
+            // lanes before the start of the operand repeat its first element
+            typename arch_traits_t::packed_t get_prologue_packed(int i) const
+            {
+                  if (i + arch_traits_t::stride <= 0)
+                        return arch_traits_t::set1(this->_op[0]);
+
+                  NumType lanes[arch_traits_t::stride];
+                  const NumType first = this->_op[0];
+                  int k = 0;
+                  for ( ; k < -i; ++k)
+                        lanes[k] = first;
+                  for ( ; k < arch_traits_t::stride; ++k)
+                        lanes[k] = this->_op[i + k];
+                  return arch_traits_t::loadu(lanes);
+            }
+      };
+
+      template <typename NumType, typename Op, bool Checked>
+      struct has_lagged_operand< lagged_engine<NumType, Op, Checked> >
+      {
+            enum { result = 1 };
+      };
+
+      // Splits a packed evaluation loop over the expression: the packs up to end() are read with the
+      // checks (get_packed<Aligned>), the rest with get_packed<Aligned, body>. Without lagged operands
+      // there is no prologue, and the body is the same instantiation as the checked reads
+      template <typename NumType, class Engine>
+      struct packed_prologue
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            enum { body = has_lagged_operand<Engine>::result == 0 };
+
+            // the first loop index of the body: the loop runs over [i_first, i_end) in packs,
+            // reading the expression at i_src + i
+            static int end(const Engine& eng, int i_src, int i_first, int i_end)
+            {
+                  if (not has_lagged_operand<Engine>::result)
+                        return i_first;
+                  lead_probe<NumType> probe;
+                  eng.depends_on(probe);
+                  const int n = probe.prologue() - i_src - i_first;
+                  if (n <= 0)
+                        return i_first;
+                  const int stride = arch_traits_t::stride;
+                  return std::min(i_end, i_first + stride*((n + stride - 1)/stride));
             }
       };
 }
@@ -9,7 +9,7 @@ namespace tachy
       template <typename NumType, class Engine, unsigned int Level>
       calc_vector<NumType, lagged_engine<NumType, Engine, true>, Level> lag_checked(unsigned int lag, const calc_vector<NumType, Engine, Level>& x)
       {
-            std::string hashed_id = x.cache().get_hash_key(std::string("LAGCK ") + x.get_id());
+            std::string hashed_id = x.cache().get_hash_key(std::string("LAGCK ") + x.get_id(), x.get_id());
             return calc_vector<NumType, lagged_engine<NumType, Engine, true>, Level>(hashed_id, x.get_start_date(), lagged_engine<NumType, Engine, true>(x.engine(), lag));
       }
       
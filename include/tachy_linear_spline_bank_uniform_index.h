@@ -0,0 +1,211 @@
+#if !defined(TACHY_LINEAR_SPLINE_BANK_UNIFORM_INDEX_H__INCLUDED)
+#define TACHY_LINEAR_SPLINE_BANK_UNIFORM_INDEX_H__INCLUDED
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "tachy_aligned_allocator.h"
+#include "tachy_linear_spline_uniform_index.h"
+
+namespace tachy
+{
+      // A bank of linear splines sharing their nodes' abscissas, e.g. per-pool multiples of one base spline.
+      // The uniform index is shared and the coefficients are stored bank-minor (all banks of one segment
+      // are contiguous and padded to the stride), so evaluating every bank at a common argument is one
+      // index lookup followed by aligned packed loads across the banks.
+      // Results are laid out time-major: res[t*get_padded_size() + k] is bank k at time t
+      template <typename NumType>
+      class linear_spline_bank_uniform_index
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+            typedef linear_spline_uniform_index<NumType, false> spline_t;
+            typedef std::vector<NumType, aligned_allocator<NumType, arch_traits_t::align> > storage_t;
+
+      private:
+            std::string _key;
+
+            spline_t _index; // the first spline of the bank, only used for its index
+            unsigned int _num_banks;
+            unsigned int _padded_size;
+            unsigned int _size; // number of segments
+
+            NumType* _a;
+            NumType* _b;
+
+            void allocate()
+            {
+                  _a = spline_util<NumType>::allocate(_size*_padded_size);
+                  _b = spline_util<NumType>::allocate(_size*_padded_size);
+            }
+
+            void clear()
+            {
+                  spline_util<NumType>::deallocate(_a);
+                  spline_util<NumType>::deallocate(_b);
+            }
+
+            void copy(const linear_spline_bank_uniform_index& other)
+            {
+                  _key = other._key;
+                  _index = other._index;
+                  _num_banks = other._num_banks;
+                  _padded_size = other._padded_size;
+                  _size = other._size;
+                  allocate();
+                  memcpy(_a, other._a, _size*_padded_size*sizeof(NumType));
+                  memcpy(_b, other._b, _size*_padded_size*sizeof(NumType));
+            }
+
+            static bool same_index(const linear_spline_uniform_index_base<NumType>& s1, const linear_spline_uniform_index_base<NumType>& s2)
+            {
+                  return s1._size == s2._size &&
+                        s1._idx_size == s2._idx_size &&
+                        s1._x0 == s2._x0 &&
+                        s1._dx == s2._dx &&
+                        0 == memcmp(s1._idx, s2._idx, s1._idx_size*sizeof(s1._idx[0]));
+            }
+
+            inline unsigned int get_index(NumType x) const
+            {
+                  return static_cast<const linear_spline_uniform_index_base<NumType>&>(_index).get_index(x);
+            }
+
+            inline typename arch_traits_t::index_t get_packed_index(const packed_t& x) const
+            {
+                  return static_cast<const linear_spline_uniform_index_base<NumType>&>(_index).get_packed_index(x);
+            }
+
+      public:
+            linear_spline_bank_uniform_index(const std::string& name, const std::vector<spline_t>& splines) :
+                  _key("LSBui_" + name),
+                  _num_banks(splines.size()),
+                  _padded_size(0),
+                  _size(0),
+                  _a(0),
+                  _b(0)
+            {
+                  if (splines.empty())
+                        TACHY_THROW("Empty spline bank " << name);
+                  _index = splines[0];
+                  for (unsigned int k = 1; k < _num_banks; ++k)
+                  {
+                        if (not same_index(splines[0], splines[k]))
+                              TACHY_THROW("Spline " << splines[k].get_id() << " does not share nodes with " << splines[0].get_id());
+                  }
+
+                  _padded_size = arch_traits_t::stride*((_num_banks + arch_traits_t::stride - 1)/arch_traits_t::stride);
+                  _size = splines[0].get_num_nodes() + 1;
+                  allocate();
+                  memset(_a, 0, _size*_padded_size*sizeof(NumType));
+                  memset(_b, 0, _size*_padded_size*sizeof(NumType));
+                  for (unsigned int k = 0; k < _num_banks; ++k)
+                  {
+                        const NumType* a = splines[k].get_intercepts();
+                        const NumType* b = splines[k].get_slopes();
+                        for (unsigned int j = 0; j < _size; ++j)
+                        {
+                              _a[j*_padded_size + k] = a[j];
+                              _b[j*_padded_size + k] = b[j];
+                        }
+                  }
+            }
+
+            linear_spline_bank_uniform_index(const linear_spline_bank_uniform_index& other) :
+                  _a(0),
+                  _b(0)
+            {
+                  copy(other);
+            }
+
+            linear_spline_bank_uniform_index& operator= (const linear_spline_bank_uniform_index& other)
+            {
+                  if (this != &other)
+                  {
+                        clear();
+                        copy(other);
+                  }
+                  return *this;
+            }
+
+            ~linear_spline_bank_uniform_index()
+            {
+                  clear();
+            }
+
+            std::string get_id() const
+            {
+                  return _key;
+            }
+
+            unsigned int get_num_banks() const
+            {
+                  return _num_banks;
+            }
+
+            unsigned int get_padded_size() const
+            {
+                  return _padded_size;
+            }
+
+            // value of bank k at x
+            inline NumType operator()(unsigned int k, NumType x) const
+            {
+                  unsigned int i = get_index(x)*_padded_size + k;
+                  return _a[i] + _b[i]*x;
+            }
+
+            // all banks at x: y must be aligned and hold get_padded_size() values
+            inline void apply(NumType x, NumType* y) const
+            {
+                  const unsigned int i = get_index(x)*_padded_size;
+                  const NumType* a = _a + i;
+                  const NumType* b = _b + i;
+                  const packed_t px = arch_traits_t::set1(x);
+                  for (unsigned int k = 0; k < _padded_size; k += arch_traits_t::stride)
+                        *(packed_t*)(y + k) = arch_traits_t::fmadd(px, arch_traits_t::loada(b + k), arch_traits_t::loada(a + k));
+            }
+
+            // all banks on a common argument
+            template <class Engine, unsigned int Level>
+            void apply(const calc_vector<NumType, Engine, Level>& x, storage_t& res) const
+            {
+                  const unsigned int n = x.size();
+                  res.resize(n*_padded_size);
+                  for (unsigned int t = 0; t < n; ++t)
+                        apply(x[t], &res[t*_padded_size]);
+            }
+
+            // bank k on its own argument x[k]; arguments are read from their first element on
+            template <class ArgVector>
+            void apply(const std::vector<ArgVector>& x, storage_t& res) const
+            {
+                  if (x.size() != _num_banks)
+                        TACHY_THROW("Incorrect number of arguments for spline bank " << _key << ": got " << x.size() << ", expected: " << _num_banks);
+                  unsigned int n = x.empty() ? 0 : x[0].size();
+                  for (unsigned int k = 1; k < _num_banks; ++k)
+                        n = std::min(n, x[k].size());
+
+                  res.resize(n*_padded_size);
+                  storage_t args(_padded_size, NumType(0));
+                  for (unsigned int t = 0; t < n; ++t)
+                  {
+                        for (unsigned int k = 0; k < _num_banks; ++k)
+                              args[k] = x[k][t];
+
+                        NumType* y = &res[t*_padded_size];
+                        for (unsigned int k = 0; k < _padded_size; k += arch_traits_t::stride)
+                        {
+                              const packed_t px = arch_traits_t::loada(&args[k]);
+                              typename arch_traits_t::index_t i = arch_traits_t::iadd(arch_traits_t::imul(get_packed_index(px), arch_traits_t::iset1(_padded_size)),
+                                                                                      arch_traits_t::isetinc(k));
+                              *(packed_t*)(y + k) = arch_traits_t::fmadd(px, arch_traits_t::gather(_b, i), arch_traits_t::gather(_a, i));
+                        }
+                  }
+            }
+      };
+}
+
+#endif // TACHY_LINEAR_SPLINE_BANK_UNIFORM_INDEX_H__INCLUDED
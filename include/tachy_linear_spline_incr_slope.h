@@ -116,8 +116,8 @@ namespace tachy
             calc_vector<NumType, functor_engine<NumType, ArgEngine, spline_t, Level>, Level> operator()(const calc_vector<NumType, ArgEngine, Level>& x) const
             {
                   typedef functor_engine<NumType, ArgEngine, spline_t, Level> engine_t;
-                  std::string id = _key + x.get_id();
-                  engine_t eng(x.engine(), *this);
+                  std::string id = x.cache().get_hash_key(_key + x.get_id(), x.get_id());
+                  engine_t eng(id, x.get_start_date(), x.engine(), *this, x.cache());
                   return calc_vector<NumType, engine_t, Level>(id, x.get_start_date(), eng, x.cache());
             }
       };
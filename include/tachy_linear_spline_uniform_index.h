@@ -11,6 +11,9 @@
 #include <algorithm>
 #include <numeric>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 #include <time.h>
 
@@ -23,8 +26,11 @@ namespace tachy
       template <typename NumType>
       class linear_spline_uniform_index_base : public cacheable
       {
+            template <typename> friend class linear_spline_bank_uniform_index; // shares the index of its splines
+
       public:
             typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef std::vector<int> segment_table_t;
             
       protected:
             std::string _key;
@@ -94,10 +100,11 @@ namespace tachy
                   static_copy(other._key, other);
                   if (_size > 0)
                   {
-                        _a = spline_util<NumType>::allocate(_size);
-                        _b = spline_util<NumType>::allocate(_size);
-                        memcpy(_a, other._a, _size*sizeof(NumType));
-                        memcpy(_b, other._b, _size*sizeof(NumType));
+                        // time dependent splines keep one slice of coefficients per time step
+                        _a = spline_util<NumType>::allocate(_size*_num_slices);
+                        _b = spline_util<NumType>::allocate(_size*_num_slices);
+                        memcpy(_a, other._a, _size*_num_slices*sizeof(NumType));
+                        memcpy(_b, other._b, _size*_num_slices*sizeof(NumType));
                   }
             }
 
@@ -265,6 +272,163 @@ namespace tachy
             {
                   return _init_type;
             }
+
+            // Segment indices for all elements of src (at least min_size entries, padded with 0). Engines
+            // evaluating this spline on src and on its lagged views within one statement share the table,
+            // which the statement keeps for the time of its loop (see common_subexpressions)
+            void fill_segment_table(const vector_engine<NumType>& src, unsigned int min_size, segment_table_t& segments) const
+            {
+                  const int n = src.size();
+                  const int n_packed = arch_traits_t::stride*((n + arch_traits_t::stride - 1)/arch_traits_t::stride);
+                  segments.assign(std::max<int>(min_size, n_packed), 0);
+                  for (int i = 0; i < n; i += arch_traits_t::stride) // vector storage is padded to the stride
+                  {
+                        typename arch_traits_t::index_t k = get_packed_index(src.get_packed(i));
+                        memcpy(&segments[i], &k, arch_traits_t::stride*sizeof(int));
+                  }
+            }
+      };
+
+      // Spline arguments whose segment indices can be shared: a vector and its (checked) lagged views
+      template <typename NumType, class Arg> struct segment_source;
+
+      template <typename NumType>
+      struct segment_source<NumType, vector_engine<NumType> >
+      {
+            static const vector_engine<NumType>& source(const vector_engine<NumType>& arg)
+            {
+                  return arg;
+            }
+
+            static int lead(const vector_engine<NumType>&)
+            {
+                  return 0;
+            }
+
+            static int position(const vector_engine<NumType>&, int idx)
+            {
+                  return idx;
+            }
+      };
+
+      template <typename NumType>
+      struct segment_source<NumType, lagged_engine<NumType, vector_engine<NumType>, true> >
+      {
+            typedef lagged_engine<NumType, vector_engine<NumType>, true> arg_t;
+
+            static const vector_engine<NumType>& source(const arg_t& arg)
+            {
+                  return arg.op();
+            }
+
+            static int lead(const arg_t& arg)
+            {
+                  return std::max(0, -arg.lag());
+            }
+
+            static int position(const arg_t& arg, int idx)
+            {
+                  return idx - arg.lag(); // negative when the pack straddles the start of the vector
+            }
+      };
+
+      // Level 0 engine for a spline evaluated on a vector or its lagged view: in the packed loop of a statement,
+      // the segments are looked up in the table shared with the other engines on the same vector; elsewhere
+      // they are computed from the argument as usual
+      template <typename NumType,
+                class Arg,
+                class Spline,
+                class FcnCallPolicy = simple_functor_call_policy<NumType, Arg, Spline> >
+      class spline_segment_engine
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef segment_source<NumType, Arg> source_t;
+
+            spline_segment_engine(const Arg& arg, const Spline& spline)
+                  : _arg(arg),
+                    _spline(spline),
+                    _segments(nullptr),
+                    _memo(nullptr)
+            {}
+            spline_segment_engine(const spline_segment_engine& other)
+                  : _arg(other._arg),
+                    _spline(other._spline),
+                    _segments(nullptr),
+                    _memo(nullptr)
+            {}
+
+            // element-wise evaluation is used when the argument is being assigned to (lag recursion),
+            // so it can't rely on the table computed upfront
+            NumType operator[] (unsigned int idx) const
+            {
+                  return FcnCallPolicy::call(idx, _arg, _spline);
+            }
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
+            {
+                  if (_memo)
+                        return _memo->template get<Aligned, Prologue>(*this, idx);
+                  return evaluate_packed<Aligned, Prologue>(idx);
+            }
+
+            template <bool Aligned, bool Prologue>
+            typename arch_traits_t::packed_t evaluate_packed(int idx) const
+            {
+                  const int pos = source_t::position(_arg, idx);
+                  if (nullptr == _segments or pos < 0) // no table, or the lanes are not contiguous in the vector
+                        return FcnCallPolicy::template call_packed<Aligned, Prologue>(idx, _arg, _spline);
+                  return _spline.apply_packed_segment(idx, _arg.template get_packed<Aligned, Prologue>(idx), arch_traits_t::iload(&(*_segments)[pos]));
+            }
+
+            unsigned int size() const
+            {
+                  return _arg.size();
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _arg.get_start_date();
+            }
+
+            int get_alignment() const
+            {
+                  return _arg.get_alignment();
+            }
+
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return _arg.depends_on(eng);
+            }
+
+            bool depends_on(const common_subexpressions<NumType>& cse) const
+            {
+                  cse.add_segments(_spline, source_t::source(_arg), _arg.size() + source_t::lead(_arg) + arch_traits_t::stride, _segments);
+                  return _arg.depends_on(cse);
+            }
+
+            template <class LeafProbe> bool depends_on(const loop_invariants<NumType, LeafProbe>& inv) const
+            {
+                  return not inv.add(*this, _memo) and _arg.depends_on(inv);
+            }
+
+      protected:
+            typename data_engine_traits<Arg>::ref_type_t _arg;
+            const Spline& _spline;
+            mutable const typename Spline::segment_table_t* _segments; // the table of the statement (see common_subexpressions)
+            mutable packed_memo<NumType>* _memo; // kept across passes over a pack (see loop_invariants)
+
+            spline_segment_engine& operator= (const spline_segment_engine&)
+            {
+                  return *this;
+            }
+      };
+
+      template <typename NumType, class Arg, class Spline, class FcnCallPolicy>
+      struct has_lagged_operand< spline_segment_engine<NumType, Arg, Spline, FcnCallPolicy> >
+      {
+            enum { result = has_lagged_operand<Arg>::result };
       };
 
       template <typename NumType, bool TimeDependent = false>
@@ -313,7 +477,12 @@ namespace tachy
 
             inline typename arch_traits_t::packed_t apply_packed(const typename arch_traits_t::packed_t& x) const
             {
-                  typename arch_traits_t::index_t i = base_t::get_packed_index(x);
+                  return apply_packed_segment(0, x, base_t::get_packed_index(x));
+            }
+
+            // same with segment indices found beforehand; the time index is ignored
+            inline typename arch_traits_t::packed_t apply_packed_segment(int, const typename arch_traits_t::packed_t& x, const typename arch_traits_t::index_t& i) const
+            {
                   return arch_traits_t::fmadd(x, arch_traits_t::gather(base_t::_b, i), arch_traits_t::gather(base_t::_a, i));
             }
             
@@ -321,7 +490,7 @@ namespace tachy
             calc_vector<NumType, functor_engine<NumType, ArgEngine, spline_t, Level>, Level> operator()(const calc_vector<NumType, ArgEngine, Level>& x) const
             {
                   typedef functor_engine<NumType, ArgEngine, spline_t, Level> engine_t;
-                  std::string id = base_t::_key + x.get_id();
+                  std::string id = x.cache().get_hash_key(base_t::_key + x.get_id(), x.get_id());
                   return calc_vector<NumType, engine_t, Level>(id, x.get_start_date(), engine_t(id, x.get_start_date(), x.engine(), *this, x.cache()), x.cache());
             }
 
@@ -332,38 +501,191 @@ namespace tachy
                   std::string id = base_t::_key + x.get_id();
                   return calc_vector<NumType, engine_t, 0>(id, x.get_start_date(), engine_t(x.engine(), *this), x.cache());
             }
+
+            calc_vector<NumType, spline_segment_engine<NumType, vector_engine<NumType>, spline_t>, 0> operator()(const calc_vector<NumType, vector_engine<NumType>, 0>& x) const
+            {
+                  return segment_call(x);
+            }
+
+            calc_vector<NumType, spline_segment_engine<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, spline_t>, 0> operator()(const calc_vector<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, 0>& x) const
+            {
+                  return segment_call(x);
+            }
+
+      private:
+            template <class ArgEngine>
+            calc_vector<NumType, spline_segment_engine<NumType, ArgEngine, spline_t>, 0> segment_call(const calc_vector<NumType, ArgEngine, 0>& x) const
+            {
+                  typedef spline_segment_engine<NumType, ArgEngine, spline_t> engine_t;
+                  std::string id = base_t::_key + x.get_id();
+                  return calc_vector<NumType, engine_t, 0>(id, x.get_start_date(), engine_t(x.engine(), *this), x.cache());
+            }
       };
 
       template <typename NumType>
       class linear_spline_uniform_index<NumType, true> : public linear_spline_uniform_index_base<NumType>
       {
-      private:
-            void resize(unsigned int mod_size)
-            {
-                  base_t::_num_slices = mod_size;
-                  base_t::_a = spline_util<NumType>::allocate(base_t::_size*base_t::_num_slices);
-                  base_t::_b = spline_util<NumType>::allocate(base_t::_size*base_t::_num_slices);
-            }
-            
       public:
             typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
             typedef linear_spline_uniform_index_base<NumType> base_t;
             typedef linear_spline_uniform_index<NumType, true> spline_t;
 
-            linear_spline_uniform_index()
+            // time slices are materialized in blocks of this many months
+            enum { slice_block = 32 };
+
+      private:
+            // Modulated coefficients are computed lazily, block by block, as evaluation reaches them:
+            // seasoned pools and shifted arguments rarely touch all of the modulation horizon, and only the
+            // blocks reached take memory. A block holds the intercepts, then the slopes, of its slices and of
+            // the first stride - 1 slices of the next block, so a pack never straddles two blocks. Block
+            // pointers are set once, under the lock, and don't move; times past the horizon use its last slice.
+            // The base coefficients stay in base_t. The modulation is copied in, block by block, so it can't be
+            // changed or released behind the spline's back; the copy of a block goes once its slices are in place
+            unsigned int _mod_size;
+            mutable std::atomic<unsigned int> _num_filled;
+            mutable std::mutex _fill_lock;
+            mutable std::vector<std::atomic<NumType*> > _blocks;
+            mutable std::vector<NumType*> _mod_blocks; // row j of block k starts at j*block_size(k)
+            std::vector<NumType> _knots;
+
+            unsigned int num_blocks() const
+            {
+                  return (_mod_size + slice_block - 1)/slice_block;
+            }
+
+            // the number of slices block k holds, the ones it shares with the next block included
+            unsigned int block_size(unsigned int k) const
+            {
+                  return std::min<unsigned int>(_mod_size, (k + 1)*slice_block + arch_traits_t::stride - 1) - k*slice_block;
+            }
+
+            void reset_blocks(unsigned int num_blocks)
+            {
+                  std::vector<std::atomic<NumType*> > blocks(num_blocks);
+                  for (unsigned int k = 0; k < num_blocks; ++k)
+                        blocks[k].store(0, std::memory_order_relaxed);
+                  _blocks.swap(blocks);
+                  _mod_blocks.assign(num_blocks, 0);
+            }
+
+            void clear_blocks()
+            {
+                  for (unsigned int k = 0; k < _blocks.size(); ++k)
+                  {
+                        NumType* coefs = _blocks[k].load(std::memory_order_relaxed);
+                        spline_util<NumType>::deallocate(coefs);
+                        spline_util<NumType>::deallocate(_mod_blocks[k]);
+                  }
+                  reset_blocks(0);
+            }
+
+            // complete copies of the blocks of other
+            void copy_blocks(const spline_t& other)
+            {
+                  _mod_size = other._mod_size;
+                  reset_blocks(other._blocks.size());
+                  const unsigned int n = base_t::_size;
+                  for (unsigned int k = 0; k < _blocks.size(); ++k)
+                  {
+                        NumType* coefs = spline_util<NumType>::allocate(2*n*block_size(k));
+                        memcpy(coefs, other.block(k), 2*n*block_size(k)*sizeof(NumType));
+                        _blocks[k].store(coefs, std::memory_order_relaxed);
+                  }
+                  _num_filled.store(_mod_size, std::memory_order_release);
+            }
+
+            void fill_slices(NumType* a, NumType* b, const NumType* mod, unsigned int num_slices) const
+            {
+                  const NumType* const orig_a = base_t::_a;
+                  const NumType* const orig_b = base_t::_b;
+                  const unsigned int n = base_t::_size;
+                  for (unsigned int t = 0; t < num_slices; ++t)
+                  {
+                        const unsigned int k = t*n;
+                        a[k+0] = b[k+0] = NumType(0);
+                        if (base_t::_init_type == spline_util<NumType>::SPLINE_INIT_FROM_LOCAL_SLOPES)
+                        {
+                              for (unsigned int j = 1; j < n; ++j)
+                                    b[k+j] = mod[(j-1)*num_slices + t]*orig_b[j];
+
+                              for (unsigned int j = 1; j < n; ++j)
+                                    a[k+j] = a[k+j-1] - _knots[j-1]*(b[k+j] - b[k+j-1]);
+                        }
+                        else // SPLINE_INIT_FROM_INCR_SLOPES
+                        {
+                              b[k+1] = mod[t]*orig_b[1];
+                              for (unsigned int j = 2; j < n; ++j)
+                                    b[k+j] = b[k+j-1] + mod[(j-1)*num_slices + t]*(orig_b[j] - orig_b[j-1]);
+
+                              a[k+1] = mod[t]*orig_a[1];
+                              for (unsigned int j = 2; j < n; ++j)
+                                    a[k+j] = a[k+j-1] + mod[(j-1)*num_slices + t]*(orig_a[j] - orig_a[j-1]);
+                        }
+                  }
+            }
+
+            // fills block k under the lock, unless a concurrent caller got there first
+            const NumType* fill_block(unsigned int k) const
+            {
+                  std::lock_guard<std::mutex> lock(_fill_lock);
+                  NumType* coefs = _blocks[k].load(std::memory_order_relaxed);
+                  if (coefs)
+                        return coefs;
+
+                  const unsigned int n = base_t::_size;
+                  const unsigned int size = block_size(k);
+                  coefs = spline_util<NumType>::allocate(2*n*size);
+                  fill_slices(coefs, coefs + n*size, _mod_blocks[k], size);
+                  spline_util<NumType>::deallocate(_mod_blocks[k]);
+                  _num_filled.store(_num_filled.load(std::memory_order_relaxed) + std::min<unsigned int>(slice_block, _mod_size - k*slice_block),
+                                    std::memory_order_relaxed);
+                  _blocks[k].store(coefs, std::memory_order_release);
+                  return coefs;
+            }
+
+            // the coefficients of block k, filled first if need be
+            inline const NumType* block(unsigned int k) const
+            {
+                  const NumType* coefs = _blocks[k].load(std::memory_order_acquire);
+                  return coefs ? coefs : fill_block(k);
+            }
+
+      public:
+            linear_spline_uniform_index() :
+                  _mod_size(1),
+                  _num_filled(1)
             {
                   base_t::_key = "DUMMY LSuiy";
             }
 
+            // a single slice, the base coefficients
             linear_spline_uniform_index(const std::string& name, const std::vector<typename spline_util<NumType>::xy_pair_t>& nodes, enum spline_util<NumType>::SPLINE_INIT_TYPE init_type) :
-                  base_t(name, nodes, init_type)
+                  base_t(name, nodes, init_type),
+                  _mod_size(1),
+                  _num_filled(1)
             {
                   base_t::_key = "LSuiy_" + name;
+                  reset_blocks(1);
+                  const unsigned int n = base_t::_size;
+                  NumType* coefs = spline_util<NumType>::allocate(2*n);
+                  memcpy(coefs, base_t::_a, n*sizeof(NumType));
+                  memcpy(coefs + n, base_t::_b, n*sizeof(NumType));
+                  _blocks[0].store(coefs, std::memory_order_relaxed);
             }
 
+            // copies are complete, so they don't carry the modulation along
             linear_spline_uniform_index(const spline_t& other) :
-                  base_t(other)
-            {}
+                  base_t(other),
+                  _mod_size(0),
+                  _num_filled(0)
+            {
+                  copy_blocks(other);
+            }
+
+            ~linear_spline_uniform_index()
+            {
+                  clear_blocks();
+            }
 
             template <class ModVector>
             static std::string generate_id(const std::string& base_id, const std::vector<ModVector>& modulation)
@@ -376,9 +698,12 @@ namespace tachy
                   return id.str();
             }
 
+            // The coefficients are computed on demand from a copy of the modulation taken here
             template <class ModVector>
             linear_spline_uniform_index(const linear_spline_uniform_index<NumType, false>& base,
-                                        const std::vector<ModVector>& modulation)
+                                        const std::vector<ModVector>& modulation) :
+                  _mod_size(0),
+                  _num_filled(0)
             {
                   if (modulation.size() != base.get_num_nodes())
                         TACHY_THROW("Incorrect modulation size: got " << modulation.size() << ", expected: " << base.get_num_nodes());
@@ -388,54 +713,60 @@ namespace tachy
                         if (mod->size() != mod_size)
                               TACHY_THROW("Modulation vector lengths are inconsistent: " << mod->size() << " vs " << mod_size);
                   }
+                  if (0 == mod_size)
+                        TACHY_THROW("Empty modulation vectors");
+
+                  base_t::copy(base);
+                  base_t::_key = spline_t::generate_id(base.get_id(), modulation);
+                  if (base_t::_init_type != spline_util<NumType>::SPLINE_INIT_FROM_LOCAL_SLOPES &&
+                      base_t::_init_type != spline_util<NumType>::SPLINE_INIT_FROM_INCR_SLOPES)
+                        TACHY_THROW("Modulation not supported for the spline type");
 
-                  const std::string key = spline_t::generate_id(base.get_id(), modulation);
-                  base_t::static_copy(key, base);
-                  resize(mod_size);
-                  const NumType* const orig_a = base.get_intercepts();
-                  const NumType* const orig_b = base.get_slopes();
-                  base_t::_init_type = base.get_init_type();
                   if (base_t::_init_type == spline_util<NumType>::SPLINE_INIT_FROM_LOCAL_SLOPES)
                   {
-                        std::vector<NumType> x(base_t::_size-2, 0.0);
-                        for (int j = 0, j_max = x.size(); j < j_max; ++j)
-                              x[j] = -(orig_a[j+2] - orig_a[j+1])/(orig_b[j+2] - orig_b[j+1]);
-                        for (int i = 0, k = 0; i < mod_size; ++i, k += base_t::_size)
-                        {
-                              base_t::_a[k+0] = base_t::_b[k+0] = NumType(0);
-
-                              for (int j = 1; j < base_t::_size; ++j)
-                                    base_t::_b[k+j] = modulation[j-1][i]*orig_b[j];
-
-                              for (int j = 1; j < base_t::_size; ++j)
-                                    base_t::_a[k+j] = base_t::_a[k+j-1] - x[j-2]*(base_t::_b[k+j] - base_t::_b[k+j-1]);
-                        }
+                        // recover the knots from the base spline: a[j+1] - a[j] = -x[j]*(b[j+1] - b[j])
+                        const NumType* const orig_a = base_t::_a;
+                        const NumType* const orig_b = base_t::_b;
+                        _knots.resize(base_t::_size-1, NumType(0));
+                        for (int j = 0, j_max = _knots.size(); j < j_max; ++j)
+                              _knots[j] = -(orig_a[j+1] - orig_a[j])/(orig_b[j+1] - orig_b[j]);
                   }
-                  else if (base_t::_init_type == spline_util<NumType>::SPLINE_INIT_FROM_INCR_SLOPES)
+
+                  _mod_size = mod_size;
+                  reset_blocks(num_blocks());
+                  for (unsigned int k = 0; k < _mod_blocks.size(); ++k)
                   {
-                        for (int i = 0, k = 0; i < mod_size; ++i, k += base_t::_size)
+                        const unsigned int t_first = k*slice_block;
+                        const unsigned int size = block_size(k);
+                        _mod_blocks[k] = spline_util<NumType>::allocate(modulation.size()*size);
+                        for (int j = 0, j_max = modulation.size(); j < j_max; ++j)
                         {
-                              base_t::_a[k+0] = base_t::_b[k+0] = NumType(0);
-                              
-                              base_t::_b[k+1] = modulation[0][i]*orig_b[1];
-                              for (int j = 2; j < base_t::_size; ++j)
-                                    base_t::_b[k+j] = base_t::_b[k+j-1] + modulation[j-1][i]*(orig_b[j] - orig_b[j-1]);
-
-                              base_t::_a[k+1] = modulation[0][i]*orig_a[1];
-                              for (int j = 2; j < base_t::_size; ++j)
-                                    base_t::_a[k+j] = base_t::_a[k+j-1] + modulation[j-1][i]*(orig_a[j] - orig_a[j-1]);
+                              for (unsigned int t = 0; t < size; ++t)
+                                    _mod_blocks[k][j*size + t] = modulation[j][t_first + t];
                         }
                   }
-                  else
-                        TACHY_THROW("Modulation not supported for the spline type");
             }
-            
+
+            // the number of slices in place
+            unsigned int get_num_slices() const
+            {
+                  return _num_filled.load(std::memory_order_acquire);
+            }
+
+            unsigned int get_mod_size() const
+            {
+                  return _mod_size;
+            }
+
             spline_t& operator= (const spline_t& other)
             {
                   if (this != &other)
                   {
+                        clear_blocks();
                         base_t::clear();
                         base_t::copy(other);
+                        std::vector<NumType>().swap(_knots);
+                        copy_blocks(other);
                   }
                   return *this;
             }
@@ -447,22 +778,55 @@ namespace tachy
             
             inline NumType operator()(int t, NumType x) const
             {
-                  unsigned int i = t*base_t::_size + base_t::get_index(x);
-                  return base_t::_a[i] + base_t::_b[i]*x;
+                  t = std::min<int>(t, _mod_size - 1);
+                  const unsigned int k = t/slice_block;
+                  const NumType* const a = block(k);
+                  const unsigned int i = (t - k*slice_block)*base_t::_size + base_t::get_index(x);
+                  return a[i] + a[block_size(k)*base_t::_size + i]*x;
             }
 
             inline typename arch_traits_t::packed_t apply_packed(int t, const typename arch_traits_t::packed_t& x) const
             {
-                  typename arch_traits_t::index_t i = arch_traits_t::iadd(arch_traits_t::imul(arch_traits_t::isetinc(t), arch_traits_t::iset1(base_t::_size)), base_t::get_packed_index(x));
-                  return arch_traits_t::fmadd(x, arch_traits_t::gather(base_t::_b, i), arch_traits_t::gather(base_t::_a, i));
+                  return apply_packed_segment(t, x, base_t::get_packed_index(x));
+            }
+
+            // same with segment indices found beforehand
+            inline typename arch_traits_t::packed_t apply_packed_segment(int t, const typename arch_traits_t::packed_t& x, const typename arch_traits_t::index_t& seg) const
+            {
+                  const unsigned int k = std::min<int>(t, _mod_size - 1)/slice_block;
+                  const int t_first = k*slice_block;
+                  const NumType* const a = block(k);
+                  typename arch_traits_t::index_t i = arch_traits_t::iadd(arch_traits_t::imul(arch_traits_t::imin(int(_mod_size - 1) - t_first, arch_traits_t::isetinc(t - t_first)),
+                                                                                            arch_traits_t::iset1(base_t::_size)),
+                                                                        seg);
+                  return arch_traits_t::fmadd(x, arch_traits_t::gather(a + block_size(k)*base_t::_size, i), arch_traits_t::gather(a, i));
             }
 
             template <class ArgEngine, unsigned int Level>
             calc_vector<NumType, functor_engine<NumType, ArgEngine, spline_t, Level, time_dep_functor_call_policy<NumType, ArgEngine, spline_t>, functor_obj_policy_ref<spline_t> >, Level> operator()(const calc_vector<NumType, ArgEngine, Level>& x) const
             {
                   typedef functor_engine<NumType, ArgEngine, spline_t, Level, time_dep_functor_call_policy<NumType, ArgEngine, spline_t>, functor_obj_policy_ref<spline_t> > engine_t;
+                  std::string id = x.cache().get_hash_key(base_t::_key + x.get_id(), x.get_id());
+                  return calc_vector<NumType, engine_t, Level>(id, x.get_start_date(), engine_t(id, x.get_start_date(), x.engine(), *this, x.cache()), x.cache());
+            }
+
+            calc_vector<NumType, spline_segment_engine<NumType, vector_engine<NumType>, spline_t, time_dep_functor_call_policy<NumType, vector_engine<NumType>, spline_t> >, 0> operator()(const calc_vector<NumType, vector_engine<NumType>, 0>& x) const
+            {
+                  return segment_call(x);
+            }
+
+            calc_vector<NumType, spline_segment_engine<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, spline_t, time_dep_functor_call_policy<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, spline_t> >, 0> operator()(const calc_vector<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, 0>& x) const
+            {
+                  return segment_call(x);
+            }
+
+      private:
+            template <class ArgEngine>
+            calc_vector<NumType, spline_segment_engine<NumType, ArgEngine, spline_t, time_dep_functor_call_policy<NumType, ArgEngine, spline_t> >, 0> segment_call(const calc_vector<NumType, ArgEngine, 0>& x) const
+            {
+                  typedef spline_segment_engine<NumType, ArgEngine, spline_t, time_dep_functor_call_policy<NumType, ArgEngine, spline_t> > engine_t;
                   std::string id = base_t::_key + x.get_id();
-                  return calc_vector<NumType, engine_t, Level>(id, x.get_start_date(), engine_t(x.engine(), *this), x.cache());
+                  return calc_vector<NumType, engine_t, 0>(id, x.get_start_date(), engine_t(x.engine(), *this), x.cache());
             }
       };
 }
@@ -35,6 +35,7 @@ namespace tachy
       private:
             const spline_t* _spline;
             cache_t* _cache;
+            std::string _key; // of the spline in the cache, invalidated with any of the modulation vectors
 
             bool _own_memory;
 
@@ -42,10 +43,9 @@ namespace tachy
             {
                   if (_own_memory && _spline)
                   {
-                        const std::string key = _spline->get_id();
-                        typename cache_t::cache_engine_t::const_iterator it = _cache->find(key);
+                        typename cache_t::cache_engine_t::const_iterator it = _cache->find(_key);
                         if (it == _cache->end())
-                              (*_cache)[key] = const_cast<spline_t*>(_spline);
+                              (*_cache)[_key] = const_cast<spline_t*>(_spline);
                         else
                               delete _spline;
                   }
@@ -67,8 +67,11 @@ namespace tachy
                         if (&mod->cache() != _cache)
                               TACHY_THROW("Modulation vector cache objects are inconsistent");
                   }
-                  const std::string key = spline_t::generate_id(base.get_id(), modulation);
-                  typename cache_t::cache_engine_t::const_iterator it = _cache->find(key);
+                  std::vector<std::string> mod_ids;
+                  for (typename std::vector<ModVector>::const_iterator mod = modulation.begin(); mod != modulation.end(); ++mod)
+                        mod_ids.push_back(mod->get_id());
+                  _key = _cache->get_hash_key(spline_t::generate_id(base.get_id(), modulation), mod_ids);
+                  typename cache_t::cache_engine_t::const_iterator it = _cache->find(_key);
                   if (it != _cache->end())
                   {
                         _spline = dynamic_cast<const spline_t*>(it->second);
@@ -84,6 +87,7 @@ namespace tachy
             mod_linear_spline_uniform_index(const mod_linear_spline_uniform_index& other) :
                   _spline(other._spline),
                   _cache(other._cache),
+                  _key(other._key),
                   _own_memory(false)
             {}
 
@@ -99,11 +103,22 @@ namespace tachy
                         clear();
                         _spline = other._spline;
                         _cache  = other._cache;
+                        _key    = other._key;
                         _own_memory = false;
                   }
                   return *this;
             }
 
+            const std::string& get_id() const
+            {
+                  return _key;
+            }
+
+            cache_t& cache() const
+            {
+                  return *_cache;
+            }
+
             inline NumType operator()(int t, NumType x) const
             {
                   return (*_spline)(t, x);
@@ -118,8 +133,19 @@ namespace tachy
             calc_vector<NumType, functor_engine<NumType, ArgEngine, spline_t, Level, time_dep_functor_call_policy<NumType, ArgEngine, spline_t>, functor_obj_policy_ref<spline_t> >, Level> operator()(const calc_vector<NumType, ArgEngine, Level>& x) const
             {
                   typedef functor_engine<NumType, ArgEngine, spline_t, Level, time_dep_functor_call_policy<NumType, ArgEngine, spline_t>, functor_obj_policy_ref<spline_t> > engine_t;
-                  std::string id = _spline->get_id() + x.get_id();
-                  return calc_vector<NumType, engine_t, Level>(id, x.get_start_date(), engine_t(x.engine(), *_spline), x.cache());
+                  std::string id = x.cache().get_hash_key(_spline->get_id() + x.get_id(), x, *this);
+                  return calc_vector<NumType, engine_t, Level>(id, x.get_start_date(), engine_t(id, x.get_start_date(), x.engine(), *_spline, x.cache()), x.cache());
+            }
+
+            // vectors and their lagged views share segment indices (see spline_segment_engine)
+            calc_vector<NumType, spline_segment_engine<NumType, vector_engine<NumType>, spline_t, time_dep_functor_call_policy<NumType, vector_engine<NumType>, spline_t> >, 0> operator()(const calc_vector<NumType, vector_engine<NumType>, 0>& x) const
+            {
+                  return (*_spline)(x);
+            }
+
+            calc_vector<NumType, spline_segment_engine<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, spline_t, time_dep_functor_call_policy<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, spline_t> >, 0> operator()(const calc_vector<NumType, lagged_engine<NumType, vector_engine<NumType>, true>, 0>& x) const
+            {
+                  return (*_spline)(x);
             }
       };
 }
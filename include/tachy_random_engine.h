@@ -2,39 +2,190 @@
 #define TACHY_RANDOM_ENGINE_H__INCLUDED
 
 #include <cmath>
+#include <cstdint>
 
 #include "tachy_arch_traits.h"
+#include "tachy_date.h"
 
 namespace tachy
 {
+      // Counter-based random numbers: the value at index t of a path is a pure function of (seed, path, t),
+      // so paths and the elements within them can be generated in any order, on any thread, with identical
+      // results, and a pack of values is generated directly at any index.
+      // Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11): 10 rounds
+      // of a multiply-xor bijection of a 128-bit counter keyed by 64 bits.
+      // The lanes of a pack are run through the rounds in lockstep, which the compiler vectorizes
+      template <int Lanes>
+      struct philox4x32
+      {
+            // on return, c[j][i] are 4 words of random bits for lane i
+            static inline void apply(uint32_t c[4][Lanes], uint32_t k0, uint32_t k1)
+            {
+                  for (int r = 0; r < 10; ++r, k0 += 0x9E3779B9U, k1 += 0xBB67AE85U)
+                  {
+                        for (int i = 0; i < Lanes; ++i)
+                        {
+                              const uint64_t p0 = uint64_t(0xD2511F53U)*c[0][i];
+                              const uint64_t p1 = uint64_t(0xCD9E8D57U)*c[2][i];
+                              const uint32_t c1 = c[1][i];
+                              const uint32_t c3 = c[3][i];
+                              c[0][i] = uint32_t(p1 >> 32) ^ c1 ^ k0;
+                              c[1][i] = uint32_t(p1);
+                              c[2][i] = uint32_t(p0 >> 32) ^ c3 ^ k1;
+                              c[3][i] = uint32_t(p0);
+                        }
+                  }
+            }
+      };
+
+      // bits to a uniform in [0, 1): 53 bits for double, 24 bits for float
+      template <typename NumType> struct random_bits;
+
+      template <> struct random_bits<double>
+      {
+            static inline double uniform(uint32_t hi, uint32_t lo)
+            {
+                  return (double(hi >> 5)*67108864.0 + double(lo >> 6))*(1.0/9007199254740992.0);
+            }
+      };
+
+      template <> struct random_bits<float>
+      {
+            static inline float uniform(uint32_t hi, uint32_t)
+            {
+                  return float(hi >> 8)*(1.0f/16777216.0f);
+            }
+      };
+
+      // Distributions turn the 4 random words of an element into its value
+      template <typename NumType>
+      class uniform_distribution
+      {
+      public:
+            uniform_distribution(NumType x0, NumType x1) :
+                  _x0(x0),
+                  _dx(x1 - x0)
+            {}
+
+            inline NumType operator()(uint32_t w0, uint32_t w1, uint32_t, uint32_t) const
+            {
+                  return _x0 + _dx*random_bits<NumType>::uniform(w0, w1);
+            }
+
+      private:
+            NumType _x0;
+            NumType _dx;
+      };
+
+      // Box-Muller on the two uniforms of an element
       template <typename NumType>
+      class normal_distribution
+      {
+      public:
+            normal_distribution(NumType mean, NumType sigma) :
+                  _mean(mean),
+                  _sigma(sigma)
+            {}
+
+            inline NumType operator()(uint32_t w0, uint32_t w1, uint32_t w2, uint32_t w3) const
+            {
+                  const NumType u1 = NumType(1) - random_bits<NumType>::uniform(w0, w1); // in (0, 1]
+                  const NumType u2 = random_bits<NumType>::uniform(w2, w3);
+                  return _mean + _sigma*std::sqrt(NumType(-2)*std::log(u1))*std::cos(NumType(6.283185307179586477)*u2);
+            }
+
+      private:
+            NumType _mean;
+            NumType _sigma;
+      };
+
+      // CalcVector engine for random paths - no storage, like the generator engines:
+      // the counter of element t is (t, path, 0, 0), the key is the seed
+      template <typename NumType, class Distribution = uniform_distribution<NumType> >
       class random_engine
       {
       public:
-            random_engine(NumType x0, NumType x1) : _mid(0.5*(x0 + x1)), _range(x1 - x0) {}
-            random_engine(const random_engine<NumType>& other) : _mid(other._mid), _range(other._range) {}
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            random_engine(const tachy_date& start_date, unsigned int n, uint64_t seed, uint32_t path, const Distribution& dist) :
+                  _dist(dist),
+                  _start_date(start_date),
+                  _size(n),
+                  _k0(uint32_t(seed)),
+                  _k1(uint32_t(seed >> 32)),
+                  _path(path)
+            {}
 
-            NumType operator[] (const unsigned int idx) const
+            random_engine(const random_engine& other) :
+                  _dist(other._dist),
+                  _start_date(other._start_date),
+                  _size(other._size),
+                  _k0(other._k0),
+                  _k1(other._k1),
+                  _path(other._path)
+            {}
+
+            random_engine& operator= (const random_engine& other) = delete;
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return _mid + _range*std::random();
+                  typename arch_traits_t::packed_t p;
+                  generate<arch_traits_t::stride>(idx, (NumType*)(&p));
+                  return p;
+            }
+
+            NumType operator[] (int idx) const
+            {
+                  NumType x;
+                  generate<1>(idx, &x);
+                  return x;
             }
 
             unsigned int size() const
             {
-                  return 0;
+                  return _size;
             }
 
-      private:
-            NumType _mid;
-            NumType _range;
+            tachy_date get_start_date() const
+            {
+                  return _start_date;
+            }
+
+            int get_alignment() const
+            {
+                  return packed_alignment<NumType>::any;
+            }
+
+            template <class SomeDataEngine> constexpr bool depends_on(const SomeDataEngine&) const
+            {
+                  return false;
+            }
+
+      protected:
+            Distribution _dist;
+            tachy_date   _start_date;
+            unsigned int _size;
+            uint32_t     _k0;
+            uint32_t     _k1;
+            uint32_t     _path;
 
-            // for consistency
-            random_engine& operator= (const random_engine& other)
+            template <int Lanes>
+            void generate(int idx, NumType* x) const
             {
-                  return *this;
+                  uint32_t c[4][Lanes];
+                  for (int i = 0; i < Lanes; ++i)
+                  {
+                        c[0][i] = uint32_t(idx + i);
+                        c[1][i] = _path;
+                        c[2][i] = 0;
+                        c[3][i] = 0;
+                  }
+                  philox4x32<Lanes>::apply(c, _k0, _k1);
+                  for (int i = 0; i < Lanes; ++i)
+                        x[i] = _dist(c[0][i], c[1][i], c[2][i], c[3][i]);
             }
       };
-      
 }
 
 #endif // TACHY_RANDOM_ENGINE_H__INCLUDED
@@ -0,0 +1,379 @@
+#if !defined(TACHY_ROLLING_WINDOW_ENGINE_H__INCLUDED)
+#define TACHY_ROLLING_WINDOW_ENGINE_H__INCLUDED
+
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "tachy_vector.h"
+
+namespace tachy
+{
+      // Trailing k-element windows: the value at i is taken over op[i-k+1] ... op[i], where the elements
+      // before the start of op repeat its first one - the same as adding up k lag_checked views of op.
+      // Each window computes the whole result upfront in O(1) per element: the operand is read with packed
+      // loads into a buffer extended at the front with k-1 copies of the first element, which the sums
+      // slide along in packed passes, and the extrema scan in scalar passes combined by a packed one
+
+      template <typename NumType>
+      struct rolling_window_util
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef std::vector<NumType, aligned_allocator<NumType, arch_traits_t::align> > storage_t;
+
+            // e[j] = op[max(0, j-k+1)] for j < size + k - 1 (returned), the buffer has room for a pack past its end
+            template <class Op>
+            static unsigned int extend(const Op& op, unsigned int k, storage_t& e)
+            {
+                  const unsigned int n = op.size();
+                  const unsigned int m = n ? n + k - 1 : 0;
+                  e.assign(m + arch_traits_t::stride, NumType(0));
+                  if (0 == n)
+                        return m;
+
+                  storage_t x(arch_traits_t::stride*((n + arch_traits_t::stride - 1)/arch_traits_t::stride));
+                  for (unsigned int i = 0; i < x.size(); i += arch_traits_t::stride)
+                        *(typename arch_traits_t::packed_t*)(&x[i]) = op.get_packed(i);
+                  std::fill(e.begin(), e.begin() + k - 1, x[0]);
+                  std::copy(x.begin(), x.begin() + n, e.begin() + k - 1);
+                  return m;
+            }
+      };
+
+      template <typename NumType>
+      struct rolling_sum_window
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename rolling_window_util<NumType>::storage_t storage_t;
+
+            static const char* symbol()
+            {
+                  return "RSUM_";
+            }
+
+            // Lane l of the running sum holds the window at i+l of the extended series e, and moves on to the one
+            // at i+l+stride by adding the elements coming in and subtracting those going out, one at a time, the
+            // rounding error of each addition kept apart (Knuth's two-sum): every element enters and leaves a sum
+            // once, so unlike a difference of prefix sums the error does not grow with the length of the series
+            // or the size of the elements gone by
+            template <class Op>
+            static void apply(vector_engine<NumType>& res, const Op& op, unsigned int k, NumType scale = NumType(1))
+            {
+                  typedef typename arch_traits_t::packed_t packed_t;
+
+                  storage_t e;
+                  rolling_window_util<NumType>::extend(op, k, e);
+                  const unsigned int n = res.size();
+                  if (0 == n)
+                        return;
+
+                  packed_t s = arch_traits_t::zero();
+                  packed_t c = arch_traits_t::zero();
+                  for (unsigned int j = 0; j < k; ++j)
+                        add(s, c, arch_traits_t::loadu(&e[j]));
+
+                  const packed_t f = arch_traits_t::set1(scale);
+                  for (unsigned int i = 0; ; i += arch_traits_t::stride)
+                  {
+                        res.set_packed(i, arch_traits_t::mul(f, arch_traits_t::add(s, c)));
+                        if (i + arch_traits_t::stride >= n)
+                              break;
+                        for (unsigned int j = i; j < i + arch_traits_t::stride; ++j)
+                        {
+                              add(s, c, arch_traits_t::loadu(&e[j+k]));
+                              add(s, c, arch_traits_t::sub(arch_traits_t::zero(), arch_traits_t::loadu(&e[j])));
+                        }
+                  }
+            }
+
+      private:
+            // s += x, the rounding error of the addition added to c
+            static inline void add(typename arch_traits_t::packed_t& s, typename arch_traits_t::packed_t& c, const typename arch_traits_t::packed_t& x)
+            {
+                  const typename arch_traits_t::packed_t t = arch_traits_t::add(s, x);
+                  const typename arch_traits_t::packed_t z = arch_traits_t::sub(t, s);
+                  c = arch_traits_t::add(c, arch_traits_t::add(arch_traits_t::sub(s, arch_traits_t::sub(t, z)), arch_traits_t::sub(x, z)));
+                  s = t;
+            }
+      };
+
+      template <typename NumType>
+      struct rolling_mean_window
+      {
+            static const char* symbol()
+            {
+                  return "RMEAN_";
+            }
+
+            template <class Op>
+            static void apply(vector_engine<NumType>& res, const Op& op, unsigned int k)
+            {
+                  rolling_sum_window<NumType>::apply(res, op, k, NumType(1)/k);
+            }
+      };
+
+      // van Herk/Gil-Werman: within blocks of k elements of the extended series, g holds the running
+      // extremum from the start of the block and h the one to its end, so the window at i is
+      // the extremum of h[i] and g[i+k-1]
+      template <typename NumType, class Extremum>
+      struct rolling_extremum_window
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename rolling_window_util<NumType>::storage_t storage_t;
+
+            template <class Op>
+            static void apply(vector_engine<NumType>& res, const Op& op, unsigned int k)
+            {
+                  storage_t g;
+                  const unsigned int m = rolling_window_util<NumType>::extend(op, k, g);
+                  storage_t h(g);
+                  for (unsigned int j = 1; j < m; ++j)
+                  {
+                        if (j%k)
+                              g[j] = Extremum::apply(g[j-1], g[j]);
+                  }
+                  for (int j = int(m) - 2; j >= 0; --j)
+                  {
+                        if ((j+1)%k)
+                              h[j] = Extremum::apply(h[j+1], h[j]);
+                  }
+
+                  for (unsigned int i = 0, n = res.size(); i < n; i += arch_traits_t::stride)
+                        res.set_packed(i, Extremum::apply_packed(arch_traits_t::loadu(&h[i]), arch_traits_t::loadu(&g[i+k-1])));
+            }
+      };
+
+      template <typename NumType>
+      struct rolling_max_window : public rolling_extremum_window<NumType, rolling_max_window<NumType> >
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            static const char* symbol()
+            {
+                  return "RMAX_";
+            }
+
+            static inline NumType apply(NumType x, NumType y)
+            {
+                  return std::max(x, y);
+            }
+
+            static inline typename arch_traits_t::packed_t apply_packed(const typename arch_traits_t::packed_t& x, const typename arch_traits_t::packed_t& y)
+            {
+                  return arch_traits_t::max(x, y);
+            }
+
+            using rolling_extremum_window<NumType, rolling_max_window<NumType> >::apply;
+      };
+
+      template <typename NumType>
+      struct rolling_min_window : public rolling_extremum_window<NumType, rolling_min_window<NumType> >
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            static const char* symbol()
+            {
+                  return "RMIN_";
+            }
+
+            static inline NumType apply(NumType x, NumType y)
+            {
+                  return std::min(x, y);
+            }
+
+            static inline typename arch_traits_t::packed_t apply_packed(const typename arch_traits_t::packed_t& x, const typename arch_traits_t::packed_t& y)
+            {
+                  return arch_traits_t::min(x, y);
+            }
+
+            using rolling_extremum_window<NumType, rolling_min_window<NumType> >::apply;
+      };
+
+      // CalcVector engine for rolling windows: the result is computed when the engine is created,
+      // and is cached at the operand's level
+      template <typename NumType, typename Op, class Window, unsigned int Level>
+      class rolling_window_engine
+      {
+      public:
+            typedef arch_traits<NumType, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            rolling_window_engine(const std::string& key, const Op& op, unsigned int k, calc_cache<NumType, Level>& cache) :
+                  _key(key),
+                  _res(dynamic_cast<vector_engine<NumType>*>(cache[key])),
+                  _reads(op)
+            {
+                  if (0 == _res)
+                  {
+                        _res = new vector_engine<NumType>(op.get_start_date(), op.size(), NumType(0));
+                        cache[key] = _res;
+                        TACHY_LOG("Cache " << cache.get_id() << ": calculating for " << key);
+                        Window::apply(*_res, op, k);
+                  }
+                  else
+                        TACHY_LOG("Cache " << cache.get_id() << ": using cached result for " << key);
+            }
+
+            rolling_window_engine(const rolling_window_engine& other) :
+                  _key(other._key),
+                  _res(other._res),
+                  _reads(other._reads)
+            {}
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
+            {
+                  return _res->template get_packed<Aligned, Prologue>(idx);
+            }
+
+            NumType operator[] (const unsigned int idx) const
+            {
+                  return (*_res)[idx];
+            }
+
+            unsigned int size() const
+            {
+                  return _res->size();
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _res->get_start_date();
+            }
+
+            int get_alignment() const
+            {
+                  return _res->get_alignment();
+            }
+
+            template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
+            {
+                  return _res and eng.depends_on(*_res);
+            }
+
+            bool depends_on(const vector_engine<NumType>& eng) const
+            {
+                  return _res == &eng;
+            }
+
+            // what the operands read when the result was computed
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.read(_reads);
+                  return false;
+            }
+
+      protected:
+            std::string             _key; // for debug only
+            vector_engine<NumType>* _res;
+            operand_reads<NumType>  _reads;
+
+            rolling_window_engine& operator= (const rolling_window_engine&)
+            {
+                  return *this;
+            }
+      };
+
+      // not cached: the result is owned by the engine and shared by its copies
+      template <typename NumType, typename Op, class Window>
+      class rolling_window_engine<NumType, Op, Window, 0>
+      {
+      public:
+            typedef arch_traits<NumType, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            rolling_window_engine(const Op& op, unsigned int k) :
+                  _res(new vector_engine<NumType>(op.get_start_date(), op.size(), NumType(0))),
+                  _reads(op)
+            {
+                  Window::apply(*_res, op, k);
+            }
+
+            rolling_window_engine(const rolling_window_engine& other) :
+                  _res(other._res),
+                  _reads(other._reads)
+            {}
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
+            {
+                  return _res->template get_packed<Aligned, Prologue>(idx);
+            }
+
+            NumType operator[] (const unsigned int idx) const
+            {
+                  return (*_res)[idx];
+            }
+
+            unsigned int size() const
+            {
+                  return _res->size();
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _res->get_start_date();
+            }
+
+            int get_alignment() const
+            {
+                  return _res->get_alignment();
+            }
+
+            template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
+            {
+                  return eng.depends_on(*_res);
+            }
+
+            bool depends_on(const vector_engine<NumType>& eng) const
+            {
+                  return _res.get() == &eng;
+            }
+
+            // what the operands read when the result was computed
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.read(_reads);
+                  return false;
+            }
+
+      protected:
+            std::shared_ptr<vector_engine<NumType> > _res;
+            operand_reads<NumType>                   _reads;
+
+            rolling_window_engine& operator= (const rolling_window_engine&)
+            {
+                  return *this;
+            }
+      };
+
+#define TACHY_ROLLING_WINDOW_PACK(WINDOW_TYPE, FUNC_NAME)                \
+      template <typename NumType, class Engine, unsigned int Level> \
+      calc_vector<NumType, rolling_window_engine<NumType, Engine, WINDOW_TYPE, Level>, Level> FUNC_NAME (const calc_vector<NumType, Engine, Level>& x, unsigned int k) \
+      { \
+            if (0 == k) \
+                  TACHY_THROW("Empty rolling window on " << x.get_id()); \
+            typedef rolling_window_engine<NumType, Engine, WINDOW_TYPE, Level> engine_t; \
+            std::ostringstream s; \
+            s << WINDOW_TYPE::symbol() << k << '_' << x.get_id(); \
+            std::string hashed_id = x.cache().get_hash_key(s.str(), x.get_id()); \
+            return calc_vector<NumType, engine_t, Level>(hashed_id, x.get_start_date(), engine_t(hashed_id, x.engine(), k, x.cache()), x.cache()); \
+      } \
+      \
+      template <typename NumType, class Engine> \
+      calc_vector<NumType, rolling_window_engine<NumType, Engine, WINDOW_TYPE, 0>, 0> FUNC_NAME (const calc_vector<NumType, Engine, 0>& x, unsigned int k) \
+      { \
+            if (0 == k) \
+                  TACHY_THROW("Empty rolling window on " << x.get_id()); \
+            typedef calc_cache<NumType, 0> cache_t; \
+            typedef rolling_window_engine<NumType, Engine, WINDOW_TYPE, 0> engine_t; \
+            return calc_vector<NumType, engine_t, 0>(cache_t::get_dummy_key(), x.get_start_date(), engine_t(x.engine(), k)); \
+      }
+
+// end of TACHY_ROLLING_WINDOW_PACK macro
+
+      TACHY_ROLLING_WINDOW_PACK(rolling_sum_window<NumType>, rolling_sum)
+      TACHY_ROLLING_WINDOW_PACK(rolling_mean_window<NumType>, rolling_mean)
+      TACHY_ROLLING_WINDOW_PACK(rolling_min_window<NumType>, rolling_min)
+      TACHY_ROLLING_WINDOW_PACK(rolling_max_window<NumType>, rolling_max)
+}
+
+#endif // TACHY_ROLLING_WINDOW_ENGINE_H__INCLUDED
@@ -50,6 +50,7 @@ namespace tachy
                   _x(other._x)
             {}
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int /* idx */) const
             {
                   return _x;
@@ -74,6 +75,11 @@ namespace tachy
             {
                   return tachy_date::min_date();
             }
+
+            int get_alignment() const
+            {
+                  return packed_alignment<NumType>::any;
+            }
             
             template <class SomeDataEngine> constexpr bool depends_on(const SomeDataEngine& eng) const
             {
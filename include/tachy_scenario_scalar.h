@@ -0,0 +1,250 @@
+#if !defined(TACHY_SCENARIO_SCALAR_H__INCLUDED)
+#define TACHY_SCENARIO_SCALAR_H__INCLUDED
+
+#include <algorithm>
+#include <vector>
+
+#include "tachy_arch_traits.h"
+#include "tachy_date.h"
+#include "tachy_exception.h"
+#include "tachy_vector.h"
+
+namespace tachy
+{
+      template <typename NumType> class scenario_scalar;
+
+      // Whether an expression reads the scenario scalar: passed to depends_on() of the expression, the probe
+      // matches only that scalar (see loop_invariants)
+      template <typename NumType>
+      class scenario_probe
+      {
+      public:
+            explicit scenario_probe(const scenario_scalar<NumType>& s) :
+                  _s(s)
+            {}
+
+            template <class SomeDataEngine> bool depends_on(const SomeDataEngine& eng) const
+            {
+                  return eng.depends_on(*this);
+            }
+
+            bool depends_on(const scenario_scalar<NumType>& s) const
+            {
+                  return &s == &_s;
+            }
+
+            bool depends_on(const vector_engine<NumType>&) const
+            {
+                  return false;
+            }
+
+      private:
+            const scenario_scalar<NumType>& _s;
+      };
+
+      // A scalar taking one of several values, one per scenario (shocks, parameter bumps): an expression
+      // built once over it is evaluated for any of them by selecting it - the expression holds the engine
+      // by reference. Like a scalar it has no dates of its own, so it only makes sense at Level 0, where
+      // nothing depending on it is cached; the cached operands of Level > 0 it is combined with are not
+      // affected by the selection and are computed once for all the scenarios
+      template <typename NumType>
+      class scenario_scalar
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            explicit scenario_scalar(const std::vector<NumType>& values) :
+                  _values(values),
+                  _selected(0)
+            {
+                  if (_values.empty())
+                        TACHY_THROW("No scenarios for a scenario scalar");
+                  _x = arch_traits_t::set1(_values[0]);
+            }
+
+            scenario_scalar(const scenario_scalar& other) :
+                  _values(other._values),
+                  _x(other._x),
+                  _selected(other._selected)
+            {}
+
+            scenario_scalar& operator= (const scenario_scalar& other) = delete;
+
+            void select(unsigned int k)
+            {
+                  if (k >= _values.size())
+                        TACHY_THROW("Scenario " << k << " out of " << _values.size());
+                  select_unchecked(k);
+            }
+
+            unsigned int selected() const
+            {
+                  return _selected;
+            }
+
+            unsigned int num_scenarios() const
+            {
+                  return _values.size();
+            }
+
+            NumType value(unsigned int k) const
+            {
+                  return _values[k];
+            }
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int /* idx */) const
+            {
+                  return _x;
+            }
+
+            NumType operator[] (int) const
+            {
+                  return _values[_selected];
+            }
+
+            unsigned int size() const
+            {
+                  return 0;
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return tachy_date::min_date();
+            }
+
+            int get_alignment() const
+            {
+                  return packed_alignment<NumType>::any;
+            }
+
+            template <class SomeDataEngine> constexpr bool depends_on(const SomeDataEngine&) const
+            {
+                  return false;
+            }
+
+            bool depends_on(const scenario_probe<NumType>& probe) const
+            {
+                  return probe.depends_on(*this);
+            }
+
+      protected:
+            // the packed scenario loop (see assign_scenarios_packed) only selects the scenarios it counts up to
+            void select_unchecked(unsigned int k)
+            {
+                  _selected = k;
+                  _x = arch_traits_t::set1(_values[k]);
+            }
+
+            template <bool Aligned, typename N, class Engine, unsigned int Level>
+            friend void assign_scenarios_packed(calc_vector<N, vector_engine<N>, 0>* const* results, const calc_vector<N, Engine, Level>& expr,
+                                                scenario_scalar<N>& scenarios, const common_subexpressions<N>& cse,
+                                                int i_tgt, int i_src, int i_first, int i_end);
+
+            std::vector<NumType> _values;
+            typename arch_traits_t::packed_t _x; // the selected value in every lane
+            unsigned int _selected;
+      };
+
+      // the packs of assign_scenarios from i_first up to i_end - the last one may spill into the storage padding
+      template <bool Aligned, typename NumType, class Engine, unsigned int Level>
+      void assign_scenarios_packed(calc_vector<NumType, vector_engine<NumType>, 0>* const* results, const calc_vector<NumType, Engine, Level>& expr,
+                                   scenario_scalar<NumType>& scenarios, const common_subexpressions<NumType>& cse,
+                                   int i_tgt, int i_src, int i_first, int i_end)
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            typedef packed_prologue<NumType, calc_vector<NumType, Engine, Level> > prologue_t;
+            const int i_body = prologue_t::end(expr, i_src, i_first, i_end);
+            int i = i_first;
+            for ( ; i < i_body; i += arch_traits_t::stride)
+            {
+                  for (unsigned int k = 0, k_max = scenarios.num_scenarios(); k < k_max; ++k)
+                  {
+                        scenarios.select_unchecked(k);
+                        cse.next_pass();
+                        results[k]->set_packed(i_tgt + i, expr.template get_packed<Aligned>(i_src + i));
+                  }
+            }
+            for ( ; i < i_end; i += arch_traits_t::stride)
+            {
+                  for (unsigned int k = 0, k_max = scenarios.num_scenarios(); k < k_max; ++k)
+                  {
+                        scenarios.select_unchecked(k);
+                        cse.next_pass();
+                        results[k]->set_packed(i_tgt + i, expr.template get_packed<Aligned, prologue_t::body>(i_src + i));
+                  }
+            }
+      }
+
+      // *results[k] = expr for every scenario k of s, in one pass over the dates: each pack of expr is evaluated
+      // for all the scenarios in turn, while the operands they share are in the cache. The pass is shared when
+      // the results are of the same dates and expr does not read any of them; otherwise the assignments are
+      // done one scenario after the other. The selected scenario of s is kept.
+      // The function nodes of expr (exp, log, functors, splines) which do not read s are evaluated once per pack
+      // for all the scenarios (see loop_invariants), up to the room of common_subexpressions; the arithmetic
+      // nodes are evaluated for every scenario, as is everything reading s. The cached operands of Level > 0
+      // are computed once for all the scenarios
+      template <typename NumType, class Engine, unsigned int Level>
+      void assign_scenarios(calc_vector<NumType, vector_engine<NumType>, 0>* const* results, const calc_vector<NumType, Engine, Level>& expr, calc_vector<NumType, scenario_scalar<NumType>, 0>& s)
+      {
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            scenario_scalar<NumType>& scenarios = s.engine();
+            const unsigned int selected = scenarios.selected();
+            const unsigned int num_scenarios = scenarios.num_scenarios();
+
+            bool shared = true;
+            for (unsigned int k = 0; k < num_scenarios and shared; ++k)
+            {
+                  shared = results[k]->get_start_date() == results[0]->get_start_date() and results[k]->size() == results[0]->size() and
+                        not expr.depends_on(results[k]->engine());
+            }
+            if (not shared)
+            {
+                  for (unsigned int k = 0; k < num_scenarios; ++k)
+                  {
+                        scenarios.select(k);
+                        *results[k] = expr;
+                  }
+                  scenarios.select(selected);
+                  return;
+            }
+
+            // as in the assignment of a single expression (see calc_vector<NumType, vector_engine<NumType>, 0>)
+            const int num_hist = expr.get_start_date() - results[0]->get_start_date();
+            const int i_tgt = std::max(0, num_hist);
+            const int i_src = std::max(0, -num_hist);
+            const int n_elems = std::min<int>(expr.size() - i_src, results[0]->size() - i_tgt);
+            if (0 < n_elems)
+            {
+                  const int n_peel = std::min(n_elems, (arch_traits_t::stride - i_tgt%arch_traits_t::stride)%arch_traits_t::stride);
+                  for (unsigned int k = 0; k < num_scenarios; ++k)
+                  {
+                        scenarios.select(k);
+                        for (int i = 0; i < n_peel; ++i)
+                              (*results[k])[i_tgt + i] = expr[i_src + i];
+                  }
+                  if (n_peel < n_elems)
+                  {
+                        const common_subexpressions<NumType> cse(expr);
+                        const scenario_probe<NumType> probe(scenarios);
+                        expr.depends_on(loop_invariants<NumType, scenario_probe<NumType> >(probe, cse));
+                        const bool aligned = packed_alignment<NumType>::is_aligned(expr.get_alignment(), i_src + n_peel);
+                        if (aligned)
+                              assign_scenarios_packed<true>(results, expr, scenarios, cse, i_tgt, i_src, n_peel, n_elems);
+                        else
+                              assign_scenarios_packed<false>(results, expr, scenarios, cse, i_tgt, i_src, n_peel, n_elems);
+                  }
+                  for (unsigned int k = 0; k < num_scenarios; ++k)
+                  {
+                        calc_vector<NumType, vector_engine<NumType>, 0>& res = *results[k];
+                        for (int i = i_tgt + n_elems, i_max = res.size(); i < i_max; ++i)
+                              res[i] = res[i_tgt + n_elems - 1];
+                  }
+            }
+            scenarios.select(selected);
+      }
+}
+
+#endif // TACHY_SCENARIO_SCALAR_H__INCLUDED
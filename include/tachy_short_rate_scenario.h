@@ -0,0 +1,360 @@
+#if !defined(TACHY_SHORT_RATE_SCENARIO_H__INCLUDED)
+#define TACHY_SHORT_RATE_SCENARIO_H__INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "tachy_aligned_allocator.h"
+#include "tachy_arch_traits.h"
+#include "tachy_random_engine.h"
+#include "tachy_brownian_bridge.h"
+#include "tachy_util.h"
+#include "tachy_date.h"
+#include "tachy_vector.h"
+
+namespace tachy
+{
+      // Interest rate scenarios simulated a pack of paths at a time, one path per lane: the short rate
+      // model and the mortgage rate model step all the lanes at once with packed arithmetic, and each
+      // path is then assigned to its result vector from a view of its lane (see lane_engine).
+      // Rates are in the units of the model parameters (e.g. percent), time steps are months
+
+      // Shock sources fill z[t*stride + i] with the standard normal shock of path first + i in month t
+
+      // pseudo-random shocks: the shock of path p in month t is element t of
+      // random_engine<NumType, normal_distribution<NumType> >(..., seed, p, normal_distribution<NumType>(0, 1))
+      template <typename NumType>
+      class philox_shocks
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            explicit philox_shocks(uint64_t seed) :
+                  _k0(uint32_t(seed)),
+                  _k1(uint32_t(seed >> 32)),
+                  _dist(NumType(0), NumType(1))
+            {}
+
+            void fill(uint32_t first, unsigned int n, NumType* z)
+            {
+                  for (unsigned int t = 0; t < n; ++t, z += arch_traits_t::stride)
+                  {
+                        uint32_t c[4][arch_traits_t::stride];
+                        for (int i = 0; i < arch_traits_t::stride; ++i)
+                        {
+                              c[0][i] = t;
+                              c[1][i] = first + i;
+                              c[2][i] = 0;
+                              c[3][i] = 0;
+                        }
+                        philox4x32<arch_traits_t::stride>::apply(c, _k0, _k1);
+                        for (int i = 0; i < arch_traits_t::stride; ++i)
+                              z[i] = _dist(c[0][i], c[1][i], c[2][i], c[3][i]);
+                  }
+            }
+
+      private:
+            uint32_t _k0;
+            uint32_t _k1;
+            normal_distribution<NumType> _dist;
+      };
+
+      // quasi-random shocks: the increments of unit variance Brownian paths over n months built from
+      // a Sobol sequence (see sobol_brownian_paths)
+      template <typename NumType>
+      class sobol_shocks
+      {
+      public:
+            sobol_shocks(unsigned int n, uint64_t seed = 0) :
+                  _paths(n, NumType(1), seed)
+            {}
+
+            void fill(uint32_t first, unsigned int n, NumType* z)
+            {
+                  if (_paths.size() < n)
+                        TACHY_THROW("Sobol shocks for " << _paths.size() << " months, " << n << " requested");
+                  _paths.pack_shocks(first, n, z);
+            }
+
+      private:
+            sobol_brownian_paths<NumType> _paths;
+      };
+
+      // Hull-White short rate with a constant long run level: dr = a*(theta - r)*dt + sigma*dW, stepped
+      // with its exact transition r' = theta + (r - theta)*exp(-a*dt) + sd*z - no discretization bias
+      template <typename NumType>
+      class hull_white_model
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+
+            // a and sigma are annual, the step is a month
+            hull_white_model(NumType r0, NumType a, NumType theta, NumType sigma) :
+                  _r0(r0)
+            {
+                  const NumType dt = NumType(1)/NumType(12);
+                  const NumType decay = a > NumType(0) ? std::exp(-a*dt) : NumType(1);
+                  const NumType var = a > NumType(0) ? (NumType(1) - decay*decay)/(NumType(2)*a) : dt;
+                  _decay = arch_traits_t::set1(decay);
+                  _drift = arch_traits_t::set1(theta*(NumType(1) - decay));
+                  _sd = arch_traits_t::set1(sigma*std::sqrt(var));
+            }
+
+            NumType initial() const
+            {
+                  return _r0;
+            }
+
+            inline packed_t step(const packed_t& r, const packed_t& z) const
+            {
+                  return arch_traits_t::fmadd(_sd, z, arch_traits_t::fmadd(_decay, r, _drift));
+            }
+
+      private:
+            NumType  _r0;
+            packed_t _decay;
+            packed_t _drift;
+            packed_t _sd;
+      };
+
+      // Cox-Ingersoll-Ross short rate: dr = kappa*(theta - r)*dt + sigma*sqrt(r)*dW, stepped with the full
+      // truncation Euler scheme (Lord, Koekkoek & van Dijk) - the drift and the diffusion see max(r, 0)
+      template <typename NumType>
+      class cir_model
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+
+            cir_model(NumType r0, NumType kappa, NumType theta, NumType sigma) :
+                  _r0(r0)
+            {
+                  const NumType dt = NumType(1)/NumType(12);
+                  _kappa_dt = arch_traits_t::set1(kappa*dt);
+                  _theta = arch_traits_t::set1(theta);
+                  _sigma_sqrt_dt = arch_traits_t::set1(sigma*std::sqrt(dt));
+            }
+
+            NumType initial() const
+            {
+                  return _r0;
+            }
+
+            inline packed_t step(const packed_t& r, const packed_t& z) const
+            {
+                  const packed_t rp = arch_traits_t::max(arch_traits_t::zero(), r);
+                  const packed_t x = arch_traits_t::fmadd(_kappa_dt, arch_traits_t::sub(_theta, rp), r);
+                  return arch_traits_t::fmadd(arch_traits_t::mul(_sigma_sqrt_dt, arch_traits_t::sqrt(rp)), z, x);
+            }
+
+      private:
+            NumType  _r0;
+            packed_t _kappa_dt;
+            packed_t _theta;
+            packed_t _sigma_sqrt_dt;
+      };
+
+      // Mortgage rate as a spread over the short rate, adjusting to it with a lag: the target is
+      // spread + beta*r, and each month the rate closes the fraction lambda of its gap to the target
+      // (lambda = 1 follows the target), never going below the floor
+      template <typename NumType>
+      class mortgage_rate_model
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+
+            mortgage_rate_model(NumType spread, NumType beta, NumType lambda = NumType(1), NumType floor = NumType(0)) :
+                  _spread(spread),
+                  _beta(beta),
+                  _floor(floor),
+                  _spread_packed(arch_traits_t::set1(spread)),
+                  _beta_packed(arch_traits_t::set1(beta)),
+                  _lambda_packed(arch_traits_t::set1(lambda)),
+                  _floor_packed(arch_traits_t::set1(floor))
+            {
+                  if (lambda <= NumType(0) || NumType(1) < lambda)
+                        TACHY_THROW("Mortgage rate adjustment speed out of (0, 1]: " << lambda);
+            }
+
+            NumType initial(NumType r) const
+            {
+                  return std::max(_floor, _spread + _beta*r);
+            }
+
+            inline packed_t step(const packed_t& m, const packed_t& r) const
+            {
+                  const packed_t target = arch_traits_t::fmadd(_beta_packed, r, _spread_packed);
+                  return arch_traits_t::max(_floor_packed, arch_traits_t::fmadd(_lambda_packed, arch_traits_t::sub(target, m), m));
+            }
+
+      private:
+            NumType  _spread;
+            NumType  _beta;
+            NumType  _floor;
+            packed_t _spread_packed;
+            packed_t _beta_packed;
+            packed_t _lambda_packed;
+            packed_t _floor_packed;
+      };
+
+      // Lane i of paths stored a pack at a time (element t at x[t*stride + i]) as a data engine: the
+      // packs of a path are gathered from the storage, so assigning it to a vector takes a gather and
+      // a packed store per pack. The storage must hold stride - 1 months past the size
+      template <typename NumType>
+      class lane_engine
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+
+            lane_engine(const tachy_date& start_date, unsigned int n, const NumType* x, unsigned int lane) :
+                  _x(x + lane),
+                  _offsets(arch_traits_t::imul(arch_traits_t::isetinc(0), arch_traits_t::iset1(arch_traits_t::stride))),
+                  _start_date(start_date),
+                  _size(n)
+            {}
+
+            lane_engine(const lane_engine& other) :
+                  _x(other._x),
+                  _offsets(other._offsets),
+                  _start_date(other._start_date),
+                  _size(other._size)
+            {}
+
+            lane_engine& operator= (const lane_engine& other) = delete;
+
+            template <bool Aligned = false, bool Prologue = true>
+            typename arch_traits_t::packed_t get_packed(int idx) const
+            {
+                  return arch_traits_t::gather(_x, arch_traits_t::iadd(arch_traits_t::iset1(idx*arch_traits_t::stride), _offsets));
+            }
+
+            NumType operator[] (int idx) const
+            {
+                  return _x[idx*arch_traits_t::stride];
+            }
+
+            unsigned int size() const
+            {
+                  return _size;
+            }
+
+            tachy_date get_start_date() const
+            {
+                  return _start_date;
+            }
+
+            int get_alignment() const
+            {
+                  return packed_alignment<NumType>::any;
+            }
+
+            template <class SomeDataEngine> constexpr bool depends_on(const SomeDataEngine&) const
+            {
+                  return false;
+            }
+
+      protected:
+            const NumType* _x;
+            typename arch_traits_t::index_t _offsets;
+            tachy_date   _start_date;
+            unsigned int _size;
+      };
+
+      // Element 0 of a path is the initial state, element t the state after t monthly steps, the step
+      // into month t taking the shock of month t-1. Paths only depend on their index, so any range of
+      // them can be generated, in any order
+      template <typename NumType, class ShortRateModel, class Shocks = philox_shocks<NumType> >
+      class short_rate_scenarios
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+            typedef std::vector<NumType, aligned_allocator<NumType, arch_traits_t::align> > storage_t;
+
+            short_rate_scenarios(const ShortRateModel& model, const mortgage_rate_model<NumType>& mortgage, const Shocks& shocks) :
+                  _model(model),
+                  _mortgage(mortgage),
+                  _shocks(shocks)
+            {}
+
+            // mortgage rates of paths first, ..., first + k - 1 into *mtg[0], ..., *mtg[k-1], over the size of each
+            template <class Vector>
+            void generate(uint32_t first, unsigned int k, Vector* const* mtg)
+            {
+                  generate(first, k, mtg, (Vector* const*)(0));
+            }
+
+            // and the short rates into *rate[0], ..., *rate[k-1]
+            template <class Vector, class RateVector>
+            void generate(uint32_t first, unsigned int k, Vector* const* mtg, RateVector* const* rate)
+            {
+                  unsigned int n = 0;
+                  for (unsigned int j = 0; j < k; ++j)
+                        n = std::max<unsigned int>(n, mtg[j]->size());
+                  if (rate)
+                  {
+                        for (unsigned int j = 0; j < k; ++j)
+                              n = std::max<unsigned int>(n, rate[j]->size());
+                  }
+                  if (0 == n)
+                        return;
+
+                  // packs start at multiples of stride, so a path is the same whichever range it is generated in
+                  for (uint32_t p = first - first % arch_traits_t::stride; p < first + k; p += arch_traits_t::stride)
+                  {
+                        simulate(p, n);
+                        const unsigned int i0 = p < first ? first - p : 0;
+                        const unsigned int i1 = std::min<unsigned int>(arch_traits_t::stride, first + k - p);
+                        for (unsigned int i = i0; i < i1; ++i)
+                        {
+                              scatter(_m, i, *mtg[p + i - first]);
+                              if (rate)
+                                    scatter(_r, i, *rate[p + i - first]);
+                        }
+                  }
+            }
+
+      private:
+            ShortRateModel              _model;
+            mortgage_rate_model<NumType> _mortgage;
+            Shocks                      _shocks;
+            storage_t                   _z; // shocks, then the paths are built in packs over months
+            storage_t                   _r;
+            storage_t                   _m;
+
+            void simulate(uint32_t p, unsigned int n)
+            {
+                  // the paths are read a pack of months at a time (see lane_engine)
+                  _z.resize(n*arch_traits_t::stride);
+                  _r.resize((n + arch_traits_t::stride - 1)*arch_traits_t::stride);
+                  _m.resize((n + arch_traits_t::stride - 1)*arch_traits_t::stride);
+                  if (1 < n)
+                        _shocks.fill(p, n - 1, &_z[0]);
+
+                  packed_t r = arch_traits_t::set1(_model.initial());
+                  packed_t m = arch_traits_t::set1(_mortgage.initial(_model.initial()));
+                  *(packed_t*)(&_r[0]) = r;
+                  *(packed_t*)(&_m[0]) = m;
+                  for (unsigned int t = 1; t < n; ++t)
+                  {
+                        r = _model.step(r, arch_traits_t::loada(&_z[(t-1)*arch_traits_t::stride]));
+                        m = _mortgage.step(m, r);
+                        *(packed_t*)(&_r[t*arch_traits_t::stride]) = r;
+                        *(packed_t*)(&_m[t*arch_traits_t::stride]) = m;
+                  }
+            }
+
+            template <class Vector>
+            static void scatter(const storage_t& x, unsigned int i, Vector& res)
+            {
+                  typedef calc_vector<NumType, lane_engine<NumType>, 0> lane_t;
+                  res = lane_t("lane", res.get_start_date(), lane_engine<NumType>(res.get_start_date(), res.size(), &x[0], i));
+            }
+      };
+}
+
+#endif // TACHY_SHORT_RATE_SCENARIO_H__INCLUDED
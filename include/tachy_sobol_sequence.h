@@ -0,0 +1,212 @@
+#if !defined(TACHY_SOBOL_SEQUENCE_H__INCLUDED)
+#define TACHY_SOBOL_SEQUENCE_H__INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "tachy_random_engine.h"
+#include "tachy_sobol_directions.h"
+#include "tachy_util.h"
+
+namespace tachy
+{
+      // Primitive polynomials over GF(2), as bit masks: bit k is the coefficient of x^k
+      struct gf2_polynomial
+      {
+            static unsigned int degree(uint32_t p)
+            {
+                  unsigned int s = 0;
+                  while (p >>= 1)
+                        ++s;
+                  return s;
+            }
+
+            // a*b mod p, a and b of lower degree than p
+            static uint32_t mulmod(uint32_t a, uint32_t b, uint32_t p)
+            {
+                  const uint32_t top = 1U << degree(p);
+                  uint32_t r = 0;
+                  for ( ; b; b >>= 1)
+                  {
+                        if (b & 1)
+                              r ^= a;
+                        a <<= 1;
+                        if (a & top)
+                              a ^= p;
+                  }
+                  return r;
+            }
+
+            // x^n mod p
+            static uint32_t xpow(uint32_t n, uint32_t p)
+            {
+                  uint32_t r = 1;
+                  uint32_t x = degree(p) > 1 ? 2 : 2 ^ p; // x mod p
+                  for ( ; n; n >>= 1, x = mulmod(x, x, p))
+                  {
+                        if (n & 1)
+                              r = mulmod(r, x, p);
+                  }
+                  return r;
+            }
+
+            // x generates the multiplicative group of GF(2^s): its order is 2^s - 1 and no less
+            static bool is_primitive(uint32_t p)
+            {
+                  const unsigned int s = degree(p);
+                  if (0 == s || 0 == (p & 1))
+                        return false;
+                  const uint32_t n = (1U << s) - 1;
+                  if (1 != xpow(n, p))
+                        return false;
+                  uint32_t m = n;
+                  for (uint32_t q = 2; q <= m; ++q)
+                  {
+                        if (m % q)
+                              continue;
+                        if (1 == xpow(n/q, p))
+                              return false;
+                        while (0 == m % q)
+                              m /= q;
+                  }
+                  return true;
+            }
+
+            // the first n primitive polynomials, by degree and then by value
+            static std::vector<uint32_t> primitive(unsigned int n)
+            {
+                  std::vector<uint32_t> res;
+                  res.reserve(n);
+                  for (uint32_t p = 3; res.size() < n; p += 2)
+                  {
+                        if (is_primitive(p))
+                              res.push_back(p);
+                  }
+                  return res;
+            }
+      };
+
+      // Sobol low-discrepancy sequence (Bratley & Fox, ACM TOMS 659), generated in Gray code order
+      // (Antonov & Saleev): point n+1 is point n with one direction number xor'ed in, in every dimension.
+      // The first dimension is van der Corput's sequence, the next ones use the primitive polynomials and
+      // initial direction numbers m_k of Joe & Kuo (see sobol_joe_kuo), chosen for the uniformity of the
+      // two-dimensional projections. Past the table, dimension d uses the d-th primitive polynomial with its
+      // m_k (odd, below 2^k) drawn from a Philox stream keyed by the seed - any such choice keeps the net
+      // properties of each dimension, only the cross-dimension uniformity is left to chance, as in randomized
+      // initialization (Jaeckel, "Monte Carlo Methods in Finance", 8.3). Point 0 is 0 in every dimension:
+      // the users mapping points to normals start from point 1 (see sobol_brownian_paths)
+      template <typename NumType>
+      class sobol_sequence
+      {
+      public:
+            enum { num_bits = 32 };
+
+            explicit sobol_sequence(unsigned int num_dims, uint64_t seed = 0) :
+                  _num_dims(num_dims),
+                  _v(num_bits*num_dims, 0)
+            {
+                  if (0 == num_dims)
+                        TACHY_THROW("Sobol sequence of no dimensions");
+                  for (unsigned int c = 0; c < num_bits; ++c)
+                        _v[c*_num_dims] = 1U << (num_bits - 1 - c);
+                  uint32_t m[num_bits];
+                  for (unsigned int d = 1; d < num_dims && d < sobol_joe_kuo::max_dims; ++d)
+                  {
+                        const uint16_t* row = sobol_joe_kuo::row(d);
+                        std::copy(row + 1, row + 1 + gf2_polynomial::degree(row[0]), m);
+                        init_dimension(d, row[0], m);
+                  }
+                  if (sobol_joe_kuo::max_dims < num_dims)
+                  {
+                        const std::vector<uint32_t> polys = gf2_polynomial::primitive(num_dims - 1);
+                        for (unsigned int d = sobol_joe_kuo::max_dims; d < num_dims; ++d)
+                        {
+                              for (unsigned int k = 0, s = gf2_polynomial::degree(polys[d-1]); k < s && k < num_bits; ++k)
+                              {
+                                    uint32_t c[4][1] = { { d }, { k }, { 0 }, { 0 } };
+                                    philox4x32<1>::apply(c, uint32_t(seed), uint32_t(seed >> 32));
+                                    m[k] = ((c[0][0] << 1) | 1) & ((2U << k) - 1); // m_{k+1}: odd, below 2^(k+1)
+                              }
+                              init_dimension(d, polys[d-1], m);
+                        }
+                  }
+            }
+
+            unsigned int get_num_dims() const
+            {
+                  return _num_dims;
+            }
+
+            // bits of point n in dimension d
+            uint32_t get_bits(uint32_t n, unsigned int d) const
+            {
+                  uint32_t x = 0;
+                  for (uint32_t g = n ^ (n >> 1), c = 0; g; g >>= 1, ++c)
+                  {
+                        if (g & 1)
+                              x ^= _v[c*_num_dims + d];
+                  }
+                  return x;
+            }
+
+            // points n0, ..., n0 + k - 1: u[d*k + j] is dimension d of point n0 + j, in (0, 1)
+            void points(uint32_t n0, unsigned int k, NumType* u) const
+            {
+                  std::vector<uint32_t> x(_num_dims);
+                  for (unsigned int d = 0; d < _num_dims; ++d)
+                        x[d] = get_bits(n0, d);
+                  for (unsigned int j = 0; j < k; ++j)
+                  {
+                        if (j)
+                        {
+                              // Gray codes of n and n+1 differ in the lowest set bit of n+1
+                              const uint32_t* v = &_v[ctz(n0 + j)*_num_dims];
+                              for (unsigned int d = 0; d < _num_dims; ++d)
+                                    x[d] ^= v[d];
+                        }
+                        for (unsigned int d = 0; d < _num_dims; ++d)
+                              u[d*k + j] = to_unit(x[d]);
+                  }
+            }
+
+            // the midpoint of the 2^-32 interval: never 0 or 1
+            static NumType to_unit(uint32_t x)
+            {
+                  return NumType((double(x) + 0.5)*(1.0/4294967296.0));
+            }
+
+      private:
+            unsigned int          _num_dims;
+            std::vector<uint32_t> _v; // direction numbers, _v[c*_num_dims + d] for bit c of the Gray code
+
+            static unsigned int ctz(uint32_t n)
+            {
+                  unsigned int c = 0;
+                  for ( ; 0 == (n & 1); n >>= 1)
+                        ++c;
+                  return c;
+            }
+
+            // m[0], ..., m[s-1] are the initial direction numbers m_1, ..., m_s of the polynomial p of degree s
+            void init_dimension(unsigned int d, uint32_t p, uint32_t (&m)[num_bits])
+            {
+                  const unsigned int s = gf2_polynomial::degree(p);
+                  // m_k = 2^s m_{k-s} ^ m_{k-s} ^ sum_{i=1}^{s-1} 2^i a_i m_{k-i}, where a_i is the coefficient of x^(s-i)
+                  for (unsigned int k = s; k < num_bits; ++k)
+                  {
+                        uint32_t x = m[k-s] ^ (m[k-s] << s);
+                        for (unsigned int i = 1; i < s; ++i)
+                        {
+                              if ((p >> (s - i)) & 1)
+                                    x ^= m[k-i] << i;
+                        }
+                        m[k] = x;
+                  }
+                  for (unsigned int c = 0; c < num_bits; ++c)
+                        _v[c*_num_dims + d] = m[c] << (num_bits - 1 - c);
+            }
+      };
+}
+
+#endif // TACHY_SOBOL_SEQUENCE_H__INCLUDED
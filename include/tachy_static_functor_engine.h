@@ -18,11 +18,12 @@ namespace tachy
 
             static_functor_engine(const std::string& key, const Op& op, calc_cache<NumType, Level>& cache) :
                   _key(key),
-                  _res(dynamic_cast<vector_engine<NumType>*>(cache[key]))
+                  _res(dynamic_cast<vector_engine<NumType>*>(cache[key])),
+                  _reads(op)
             {
                   if (0 == _res) // the expectation is: either it's cached - then it's size > 0, or it's not, then ptr is 0
                   {
-                        _res = new vector_engine<NumType>(op.size(), NumType(0));
+                        _res = new vector_engine<NumType>(op.get_start_date(), op.size(), NumType(0));
                         cache[key] = _res;
                         TACHY_LOG("Cache " << cache.get_id() << ": calculating for " << key);
                         func_t::apply(*_res, op);
@@ -34,7 +35,8 @@ namespace tachy
             }
 
             static_functor_engine(const static_functor_engine& other) :
-                  _res(other._res)
+                  _res(other._res),
+                  _reads(other._reads)
             {}
 
             ~static_functor_engine()
@@ -42,9 +44,10 @@ namespace tachy
                   TACHY_LOG("DEBUG: destroying static_functor_engine " << _key);
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return _res->get_packed(idx);
+                  return _res->template get_packed<Aligned, Prologue>(idx);
             }
 
             NumType operator[] (const unsigned int idx) const
@@ -61,6 +64,11 @@ namespace tachy
             {
                   return _res->get_start_date();
             }
+
+            int get_alignment() const
+            {
+                  return _res->get_alignment();
+            }
             
             template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
             {
@@ -71,10 +79,18 @@ namespace tachy
             {
                   return _res == &eng;
             }
-            
+
+            // what the operands read when the result was computed
+            bool depends_on(const lead_probe<NumType>& probe) const
+            {
+                  probe.read(_reads);
+                  return false;
+            }
+
       protected:
             std::string             _key; // for debug only
             vector_engine<NumType>* _res;
+            operand_reads<NumType>  _reads;
 
             static_functor_engine& operator= (const static_functor_engine& other )
             {
@@ -90,15 +106,26 @@ namespace tachy
             typedef StaticFunctor func_t;
 
             static_functor_engine(const Op& op)
-                  : _op(op)
+                  : _op(op),
+                    _memo(nullptr)
             {}
             static_functor_engine(const static_functor_engine& other)
-                  : _op(other._op)
+                  : _op(other._op),
+                    _memo(nullptr)
             {}
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return func_t::apply_packed(_op.get_packed(idx));
+                  if (_memo)
+                        return _memo->template get<Aligned, Prologue>(*this, idx);
+                  return evaluate_packed<Aligned, Prologue>(idx);
+            }
+
+            template <bool Aligned, bool Prologue>
+            typename arch_traits_t::packed_t evaluate_packed(int idx) const
+            {
+                  return func_t::apply_packed(_op.template get_packed<Aligned, Prologue>(idx));
             }
 
             NumType operator[] (const unsigned int idx) const
@@ -115,6 +142,11 @@ namespace tachy
             {
                   return _op.get_start_date();
             }
+
+            int get_alignment() const
+            {
+                  return _op.get_alignment();
+            }
             
             template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
             {
@@ -125,9 +157,25 @@ namespace tachy
             {
                   return &_op == &eng;
             }
+
+            bool depends_on(const common_subexpressions<NumType>& cse) const
+            {
+                  return not cse.add(*this, _memo) and _op.depends_on(cse);
+            }
+
+            template <class LeafProbe> bool depends_on(const loop_invariants<NumType, LeafProbe>& inv) const
+            {
+                  return not inv.add(*this, _memo) and _op.depends_on(inv);
+            }
+
+            bool same_as(const static_functor_engine& other) const
+            {
+                  return same_operand(_op, other._op);
+            }
             
       protected:
             typename data_engine_traits<Op>::ref_type_t _op;
+            mutable packed_memo<NumType>* _memo; // shared with the same nodes of the statement, or kept across passes (see common_subexpressions)
 
             static_functor_engine& operator= (const static_functor_engine& other )
             {
@@ -165,9 +213,10 @@ namespace tachy
                   delete _cached_vector;
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return func_t::apply_packed(_op.get_packed(idx));
+                  return func_t::apply_packed(_op.template get_packed<Aligned, Prologue>(idx));
             }
 
             NumType operator[] (int idx) const
@@ -184,6 +233,11 @@ namespace tachy
             {
                   return _op.get_start_date();
             }
+
+            int get_alignment() const
+            {
+                  return _op.get_alignment();
+            }
             
             const static_functor_engine<NumType, Op, StaticFunctor, Level>& get_cached_engine() const
             {
@@ -225,6 +279,24 @@ namespace tachy
             typedef static_functor_engine_delayed_cache<NumType, Op, StaticFunctor, Level> const& ref_type_t;
       };
 
+      template <typename NumType, class Op, class StaticFunctor>
+      struct has_lagged_operand< static_functor_engine<NumType, Op, StaticFunctor, 0> >
+      {
+            enum { result = has_lagged_operand<Op>::result };
+      };
+
+      template <typename NumType, class Op, class StaticFunctor>
+      bool same_operand(const static_functor_engine<NumType, Op, StaticFunctor, 0>& x, const static_functor_engine<NumType, Op, StaticFunctor, 0>& y)
+      {
+            return &x == &y or x.same_as(y);
+      }
+
+      template <typename NumType, class Op, class StaticFunctor, unsigned int Level>
+      struct has_lagged_operand< static_functor_engine_delayed_cache<NumType, Op, StaticFunctor, Level> >
+      {
+            enum { result = has_lagged_operand<Op>::result };
+      };
+
       // Some specific static functors
       template <typename NumType>
       struct exp_static_functor
@@ -236,8 +308,8 @@ namespace tachy
             static inline void apply(Res& y, const Op& x)
             {
                   unsigned int sz = y.size();
-                  for (unsigned int i = 0; i < sz; ++i)
-                        y[i] = std::exp(x[i]);
+                  for (unsigned int i = 0; i < sz; i += arch_traits_t::stride)
+                        y.set_packed(i, apply_packed(x.get_packed(i)));
             }
 
             static inline packed_t apply_packed(const packed_t& x)
@@ -261,8 +333,8 @@ namespace tachy
             static inline void apply(Res& y, const Op& x)
             {
                   unsigned int sz = y.size();
-                  for (unsigned int i = 0; i < sz; ++i)
-                        y[i] = std::log(x[i]);
+                  for (unsigned int i = 0; i < sz; i += arch_traits_t::stride)
+                        y.set_packed(i, apply_packed(x.get_packed(i)));
             }
 
             static inline packed_t apply_packed(const packed_t& x)
@@ -286,8 +358,8 @@ namespace tachy
             static inline void apply(Res& y, const Op& x)
             {
                   unsigned int sz = y.size();
-                  for (unsigned int i = 0; i < sz; ++i)
-                        y[i] = -x[i];
+                  for (unsigned int i = 0; i < sz; i += arch_traits_t::stride)
+                        y.set_packed(i, apply_packed(x.get_packed(i)));
             }
 
             static inline packed_t apply_packed(const packed_t& x)
@@ -311,8 +383,8 @@ namespace tachy
             static inline void apply(Res& y, const Op& x)
             {
                   unsigned int sz = y.size();
-                  for (unsigned int i = 0; i < sz; ++i)
-                        y[i] = std::abs(x[i]);
+                  for (unsigned int i = 0; i < sz; i += arch_traits_t::stride)
+                        y.set_packed(i, apply_packed(x.get_packed(i)));
             }
 
             static inline packed_t apply_packed(const packed_t& x)
@@ -331,7 +403,7 @@ namespace tachy
       calc_vector<NumType, static_functor_engine_delayed_cache<NumType, Engine, FUNC_TYPE, Level>, Level> FUNC_NAME (const calc_vector<NumType, Engine, Level>& x) \
       { \
             typedef static_functor_engine_delayed_cache<NumType, Engine, FUNC_TYPE, Level> engine_t; \
-            std::string hashed_id = x.cache().get_hash_key(std::string(#SYMBOL) + x.get_id()); \
+            std::string hashed_id = x.cache().get_hash_key(std::string(#SYMBOL) + x.get_id(), x.get_id()); \
             return calc_vector<NumType, engine_t, Level>(hashed_id, x.get_start_date(), engine_t(hashed_id, x.engine(), x.cache()), x.cache() ); \
       } \
       \
@@ -361,7 +433,7 @@ namespace tachy
             typedef cache_chooser<(unsigned int)(cache_t::cache_level) == Level1, calc_cache<NumType, Level1>, calc_cache<NumType,Level2> > cache_chooser_t; \
             cache_t& cache = cache_chooser_t::choose(x.cache(), y.cache()); \
             typedef op_engine<NumType, typename data_engine_traits<Eng1>::cached_engine_t, FUNC_TYPE, typename data_engine_traits<Eng2>::cached_engine_t, take_min<Level1, Level2>::result> engine_t; \
-            std::string id = cache.get_hash_key(std::string(#SYMBOL) + x.get_id() + std::string("_") + y.get_id()); \
+            std::string id = cache.get_hash_key(std::string(#SYMBOL) + x.get_id() + std::string("_") + y.get_id(), x, y); \
             TACHY_LOG("Doing delayed cache calculations on " << id); \
             const typename data_engine_traits<Eng1>::cached_engine_t& eng_x = do_cache(x.engine()); \
             const typename data_engine_traits<Eng2>::cached_engine_t& eng_y = do_cache(y.engine()); \
@@ -374,7 +446,7 @@ namespace tachy
             typedef calc_cache<NumType, Level> cache_t; \
             cache_t& cache = x.cache();                               \
             typedef op_engine_delayed_cache<NumType, Eng1, FUNC_TYPE, Eng2, Level> engine_t; \
-            std::string id = cache.get_hash_key(std::string(#SYMBOL) + x.get_id() + std::string("_") + y.get_id()); \
+            std::string id = cache.get_hash_key(std::string(#SYMBOL) + x.get_id() + std::string("_") + y.get_id(), x.get_id(), y.get_id()); \
             return calc_vector<NumType, engine_t, Level>(id, x.get_start_date(), x.engine(), y.engine(), cache); \
       } \
       \
@@ -393,7 +465,7 @@ namespace tachy
       calc_vector<NumType, op_engine_delayed_cache<NumType, scalar<NumType>, FUNC_TYPE, Eng, Level>, Level> FUNC_NAME (const NumType& x, const calc_vector<NumType, Eng, Level>& y) \
       { \
             std::string x_id = scalar<NumType>::get_id(x); \
-            std::string hashed_id = y.cache().get_hash_key(std::string(#SYMBOL) + x_id + std::string("_") + y.get_id()); \
+            std::string hashed_id = y.cache().get_hash_key(std::string(#SYMBOL) + x_id + std::string("_") + y.get_id(), y.get_id()); \
             typedef op_engine_delayed_cache<NumType, scalar<NumType>, FUNC_TYPE, Eng, Level> engine_t; \
             engine_t eng(hashedId, scalar<NumType>(x), y.engine(), y.cache()); \
             return calc_vector<NumType, engine_t, Level>(hashed_id, y.get_start_date(), eng, y.cache()); \
@@ -403,7 +475,7 @@ namespace tachy
       calc_vector<NumType, op_engine_delayed_cache<NumType, Eng, FUNC_TYPE, scalar<NumType>, Level>, Level> FUNC_NAME (const calc_vector<NumType, Eng, Level>& x, const NumType& y) \
       { \
             std::string y_id = scalar<NumType>::get_id(y); \
-            std::string hashed_id = x.cache().get_hash_key(std::string(#SYMBOL) + x.get_id() + std::string("_") + y_id); \
+            std::string hashed_id = x.cache().get_hash_key(std::string(#SYMBOL) + x.get_id() + std::string("_") + y_id, x.get_id()); \
             typedef op_engine_delayed_cache<NumType, Eng, FUNC_TYPE, scalar<NumType>, Level> engine_t; \
             engine_t eng(hashed_id, x.engine(), scalar<NumType>(y), x.cache()); \
             return calc_vector<NumType, engine_t, Level>(hashedId, x.get_start_date(), eng, x.cache()); \
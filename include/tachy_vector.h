@@ -12,9 +12,12 @@
 #include "tachy_vector_engine.h"
 #include "tachy_lagged_engine.h"
 #include "tachy_time_shift.h"
+#include "tachy_common_subexpression.h"
 
 namespace tachy
 {
+      template <typename NumType> class scalar;
+
       // this is the generic template used for Level > 0 and DataEngine distinct from vector
       // for Level == 0 and for DataEngine = std::vector there will be separate specializations later on
       // -- the idea is to enable proxy/caching savings for both speed and memory
@@ -76,9 +79,15 @@ namespace tachy
             ~calc_vector()
             {}
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return _engine.get_packed(idx);
+                  return _engine.template get_packed<Aligned, Prologue>(idx);
+            }
+
+            int get_alignment() const
+            {
+                  return _engine.get_alignment();
             }
 
             NumType operator[] (int idx) const
@@ -94,7 +103,7 @@ namespace tachy
             const calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, Level> operator[](const time_shift& shift) const
             {
                   typedef lagged_engine<NumType, data_engine_t, true> engine_t;
-                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK_") + _id);
+                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK_") + _id, _id);
                   engine_t eng(_engine, -shift.get_time_shift()); // because lag already implies a "-"
                   return calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, Level>(hashed_id, get_start_date(), eng, _cache);
             }
@@ -227,11 +236,9 @@ namespace tachy
                   const typename cache_t::cache_engine_t::const_iterator k = _cache.find(_id);
                   if (k == _cache.end())
                   {
-                        unsigned int sz = other.size();
-                        _engine = new data_engine_t(other.get_start_date(), sz);
+                        _engine = new data_engine_t(other.get_start_date(), other.size());
                         // in a c'tor everything is copied, including history
-                        for (int i = 0; i < sz; ++i)
-                              (*_engine)[i] = other[i];
+                        _engine->assign_packed(other);
                   }
                   else
                   {
@@ -282,7 +289,7 @@ namespace tachy
                         TACHY_THROW("calc_vector: trying to assign to a pre-cached object (" << _id << ")");
                   }
 
-                  if (_engine.is_guarded() and other.depends_on(_engine))
+                  if (has_lagged_operand<OtherDataEngine>::result and other.depends_on(lagged_alias_probe<data_engine_t>(*_engine)))
                   {
                         TACHY_THROW("calc_vector: trying to assign to a guarded level > 0 object (" << _id << ")");
                   }
@@ -326,6 +333,39 @@ namespace tachy
             }
 #endif
 
+            // in place OpType with other, for the compound assignment operators (see tachy_expression.h):
+            // the elements at the dates of other are updated in one packed pass, the others are kept.
+            // Same restrictions as the assignment operator - cached and guarded vectors are not to be changed
+            template <class OpType, class OtherDataEngine, unsigned int OtherLevel>
+            calc_vector& update(const calc_vector<NumType, OtherDataEngine, OtherLevel>& other)
+            {
+                  TACHY_LOG("calc_vector (L>0): V updating: " << _id << " with " << other.get_id());
+
+                  if (_cache.find(_id) != _cache.end())
+                        TACHY_THROW("calc_vector: trying to update a pre-cached object (" << _id << ")");
+                  if (has_lagged_operand<OtherDataEngine>::result and other.depends_on(lagged_alias_probe<data_engine_t>(*_engine)))
+                        TACHY_THROW("calc_vector: trying to update a guarded level > 0 object (" << _id << ")");
+
+                  const int num_hist = other.get_start_date() - get_start_date();
+                  const int i_tgt = std::max(0, num_hist);
+                  const int i_src = std::max(0, -num_hist);
+                  const int n_elems = std::min<int>(other.size() - i_src, size() - i_tgt);
+                  if (0 < n_elems)
+                        _engine->template update_packed<OpType>(other, i_tgt, i_src, n_elems);
+                  return *this;
+            }
+
+            template <class OpType>
+            calc_vector& update(const scalar<NumType>& x)
+            {
+                  TACHY_LOG("calc_vector (L>0): V updating: " << _id << " with a scalar");
+
+                  if (_cache.find(_id) != _cache.end())
+                        TACHY_THROW("calc_vector: trying to update a pre-cached object (" << _id << ")");
+                  _engine->template update_packed<OpType>(x, 0, 0, size());
+                  return *this;
+            }
+
             ~calc_vector()
             {
                   if (_own_engine)
@@ -351,9 +391,15 @@ namespace tachy
                         TACHY_THROW("Trying to reset a previously cached vector " << _id);
             }
             
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return _engine->get_packed(idx); // *(typename arch_traits_t::packed_t*)(&(*_engine)[idx]);
+                  return _engine->template get_packed<Aligned, Prologue>(idx);
+            }
+
+            int get_alignment() const
+            {
+                  return _engine->get_alignment();
             }
 
             void set_packed(int idx, typename arch_traits_t::packed_t& value)
@@ -374,7 +420,7 @@ namespace tachy
             const calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, Level> operator[](const time_shift& shift) const
             {
                   typedef lagged_engine<NumType, data_engine_t, true> engine_t;
-                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK_") + _id);
+                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK_") + _id, _id);
                   engine_t eng(*_engine, -shift.get_time_shift()); // because lag already implies a "-"
                   return calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, Level>(hashed_id, get_start_date(), eng, _cache);
             }
@@ -426,12 +472,12 @@ namespace tachy
 
             template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
             {
-                  return eng.depends_on(_engine);
+                  return eng.depends_on(*_engine);
             }
             
             bool depends_on(const data_engine_t& eng) const
             {
-                  return &_engine == &eng;
+                  return _engine == &eng;
             }
             
             // cache can be labelled mutable,
@@ -538,14 +584,20 @@ namespace tachy
                   return *this;
             }
 
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return _engine.get_packed(idx);
+                  return _engine.template get_packed<Aligned, Prologue>(idx);
+            }
+
+            int get_alignment() const
+            {
+                  return _engine.get_alignment();
             }
 
             const calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, 0> operator[](const time_shift& shift) const
             {
-                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK ") + _id);
+                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK ") + _id, _id);
                   return calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, 0>(hashed_id, get_start_date(), lagged_engine<NumType, data_engine_t, true>(_engine, -shift.get_time_shift()));
             }
       
@@ -654,8 +706,7 @@ namespace tachy
             {
                   TACHY_LOG("calc_vector (L=0): c-5V: Creating (different engine): " << _id << " from " << other.get_id() << "<" << OtherLevel << ">");
                   _id = other.get_id();
-                  for ( int i = 0, i_last = _engine.size(); i < i_last; ++i )
-                        _engine[i] = other[i];
+                  _engine.assign_packed(other);
             }
 
             template <class OtherDataEngine>
@@ -664,8 +715,7 @@ namespace tachy
             {
                   TACHY_LOG("calc_vector (L=0): c-6V: Creating (different engine): " << _id << " from " << other.get_id() << "<" << cache_t::cache_level << ">");
                   _id = other.get_id();
-                  for ( int i = 0, i_last = _engine.size(); i < i_last; ++i )
-                        _engine[i] = other[i];
+                  _engine.assign_packed(other);
             }
 
             calc_vector(const std::string& id, const tachy_date& date, const unsigned int size) :
@@ -717,65 +767,126 @@ namespace tachy
                   int i_tgt = std::max(0, num_hist);
                   int i_src = std::max(0, -num_hist);
                   int n_elems = std::min<int>(other.size() - i_src, size() - i_tgt);
-                  if (_engine.is_guarded() and other.depends_on(_engine))
+                  if (has_lagged_operand<OtherDataEngine>::result and other.depends_on(lagged_alias_probe<data_engine_t>(_engine)))
                   {
                         int i = 0;
                         for ( ; i < n_elems; ++i)
                               _engine[i_tgt + i] = other[i_src + i];
-                        for (i += i_tgt; i < _engine.size(); ++i)
+                        for (i += i_tgt; i < int(_engine.size()); ++i)
                               _engine[i] = _engine[i_tgt + n_elems - 1];                                    
                   }
                   else
                   {
-                        // offsets - sizes of non-vectorizable front pieces
-                        int offset_tgt = i_tgt%arch_traits_t::stride;
-                        int offset_src = i_src%arch_traits_t::stride;
-                        // at this point one of i_src, i_tgt MUST be 0
-                        // which implies that one of offsets MUST ALSO be 0
-                        // Conversely, if one of the offsets is non-0 - then its starting index is non-0 as well
-                        // and therefore the other starting index is 0
-                        int i = 0;
-                        if (offset_tgt == offset_src) // both are 0
-                        {
-                              for ( ; i < n_elems; i += arch_traits_t::stride)
-                                    set_packed(i_tgt + i, other.get_packed(i_src + i));
-                        }
-                        else if (offset_tgt > 0) // i_src == 0 and offset_src == 0
-                        {
-                              int i_tgt_adj = i_tgt - offset_tgt + arch_traits_t::stride;
-                              int n_max = n_elems - arch_traits_t::stride;
-                              for ( ; i < n_max; i += arch_traits_t::stride)
-                                    set_packed(i_tgt_adj + i, other.get_packed(i));
-                              for (int j = 0; j < n_max; ++j)
-                                    _engine[i_tgt + j] = _engine[i_tgt_adj + j];
-                        }
-                        else if (offset_src > 0) // i_tgt == 0 and offset_tgt == 0
-                        {
-                              int i_src_adj = i_src - offset_src;
-                              for (i = arch_traits_t::stride; i < n_elems; i += arch_traits_t::stride)
-                                    set_packed(i, other.get_packed(i_src_adj + i));
-                              for (int j = 0, j_max = n_elems - arch_traits_t::stride; j < j_max; ++j)
-                                    _engine[offset_src + j] = _engine[arch_traits_t::stride + j];
-                              for (int j = 0; j < offset_src; ++j)
-                                    _engine[j] = other[i_src + j];
-                        }
-                        // tail end processing is the same for all
-                        for ( ; i < n_elems; ++i)
-                              _engine[i_tgt+i] = other[i_src+i];
-                        for (i += i_tgt; i < _engine.size(); ++i)
+                        // at this point one of i_src, i_tgt MUST be 0: a target starting off a multiple of the stride
+                        // is peeled up to its first aligned index, a source starting off it is read with unaligned loads;
+                        // the last pack may spill into the storage padding of both
+                        const int n_peel = std::min(n_elems, (arch_traits_t::stride - i_tgt%arch_traits_t::stride)%arch_traits_t::stride);
+                        for (int i = 0; i < n_peel; ++i)
+                              _engine[i_tgt + i] = other[i_src + i];
+                        if (n_peel < n_elems)
+                              copy_packed(other, i_tgt, i_src, n_peel, n_elems);
+                        for (int i = i_tgt + n_elems, i_max = _engine.size(); i < i_max; ++i)
                               _engine[i] = _engine[i_tgt + n_elems - 1];
-                  }                  
+                  }
                   return *this;
             }
 
+            // in place OpType with other, for the compound assignment operators (see tachy_expression.h):
+            // the elements at the dates of other are updated in one packed pass, the others are kept.
+            // As in the assignment, lags of this vector in other see the elements already updated
+            template <class OpType, class OtherDataEngine, unsigned int OtherLevel>
+            self_t& update(const calc_vector<NumType, OtherDataEngine, OtherLevel>& other)
+            {
+                  TACHY_LOG("calc_vector (L=0): V updating: " << _id << " with " << other.get_id());
+
+                  const int num_hist = other.get_start_date() - get_start_date();
+                  const int i_tgt = std::max(0, num_hist);
+                  const int i_src = std::max(0, -num_hist);
+                  const int n_elems = std::min<int>(other.size() - i_src, size() - i_tgt);
+                  if (has_lagged_operand<OtherDataEngine>::result and other.depends_on(lagged_alias_probe<data_engine_t>(_engine)))
+                  {
+                        for (int i = 0; i < n_elems; ++i)
+                              _engine[i_tgt + i] = OpType::apply(_engine[i_tgt + i], other[i_src + i]);
+                  }
+                  else if (0 < n_elems)
+                        _engine.template update_packed<OpType>(other, i_tgt, i_src, n_elems);
+                  return *this;
+            }
+
+            template <class OpType>
+            self_t& update(const scalar<NumType>& x)
+            {
+                  TACHY_LOG("calc_vector (L=0): V updating: " << _id << " with a scalar");
+
+                  _engine.template update_packed<OpType>(x, 0, 0, size());
+                  return *this;
+            }
+
+            // the assignment for the inputs of other changed from date dt on: only the elements from the first date
+            // other can change at are reassigned - dt, or earlier by the longest lead other reads its vectors through,
+            // the ones before are kept. Lags of this vector in other read the kept elements as they are.
+            // Returns that first date, for the assignments reading this vector in turn
+            template <class OtherDataEngine, unsigned int OtherLevel>
+            tachy_date assign_from(const tachy_date& dt, const calc_vector<NumType, OtherDataEngine, OtherLevel>& other)
+            {
+                  TACHY_LOG("calc_vector (L=0): V assigning from " << dt.as_uint() << ": " << _id << " = " << other.get_id());
+
+                  lead_probe<NumType> probe;
+                  other.depends_on(probe);
+                  const tachy_date from = dt - probe.max_lead();
+
+                  const int num_hist = other.get_start_date() - get_start_date();
+                  const int i_tgt = std::max(0, num_hist);
+                  const int i_src = std::max(0, -num_hist);
+                  const int n_elems = std::min<int>(other.size() - i_src, size() - i_tgt);
+                  const int i_from = std::max(0, from - get_start_date());
+                  const int i_first = std::max(0, i_from - i_tgt);
+                  if (i_first < n_elems)
+                        assign_range(other, i_tgt + i_first, i_src + i_first, n_elems - i_first);
+                  if (0 < n_elems)
+                  {
+                        for (int i = std::max(i_from, i_tgt + n_elems), i_max = _engine.size(); i < i_max; ++i)
+                              _engine[i] = _engine[i_tgt + n_elems - 1];
+                  }
+                  return from;
+            }
+
+            // elements i_tgt + i become other[i_src + i] for i < n, as in the assignment, for the statements
+            // evaluated a range at a time (see vector_tie): the elements past them are kept, so the last pack
+            // only spills over when the rest of it is the storage padding
+            template <class OtherDataEngine, unsigned int OtherLevel>
+            void assign_range(const calc_vector<NumType, OtherDataEngine, OtherLevel>& other, int i_tgt, int i_src, int n)
+            {
+                  if (has_lagged_operand<OtherDataEngine>::result and other.depends_on(lagged_alias_probe<data_engine_t>(_engine)))
+                  {
+                        for (int i = 0; i < n; ++i)
+                              _engine[i_tgt + i] = other[i_src + i];
+                        return;
+                  }
+                  const int n_peel = std::min(n, (arch_traits_t::stride - i_tgt%arch_traits_t::stride)%arch_traits_t::stride);
+                  const int n_packed = i_tgt + n == int(size()) ? n : n_peel + (n - n_peel)/arch_traits_t::stride*arch_traits_t::stride;
+                  for (int i = 0; i < n_peel; ++i)
+                        _engine[i_tgt + i] = other[i_src + i];
+                  if (n_peel < n_packed)
+                        copy_packed(other, i_tgt, i_src, n_peel, n_packed);
+                  for (int i = std::max(n_peel, n_packed); i < n; ++i)
+                        _engine[i_tgt + i] = other[i_src + i];
+            }
+
             void reset(const tachy_date& new_start_date, unsigned int new_size)
             {
                   _engine.reset(new_start_date, new_size);
             }
             
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  return _engine.get_packed(idx); // *(typename arch_traits_t::packed_t*)(&_engine[idx]);
+                  return _engine.template get_packed<Aligned, Prologue>(idx);
+            }
+
+            int get_alignment() const
+            {
+                  return _engine.get_alignment();
             }
 
             void set_packed(int idx, typename arch_traits_t::packed_t value)
@@ -795,7 +906,7 @@ namespace tachy
 
             const calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, 0> operator[](const time_shift& shift) const
             {
-                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK ") + _id);
+                  std::string hashed_id = cache().get_hash_key(std::string("LAGCK ") + _id, _id);
                   return calc_vector<NumType, lagged_engine<NumType, data_engine_t, true>, 0>(hashed_id, get_start_date(), lagged_engine<NumType, data_engine_t, true>(_engine, -shift.get_time_shift()));
             }
       
@@ -863,6 +974,37 @@ namespace tachy
       protected:
             std::string   _id;
             data_engine_t _engine;
+
+      private:
+            // packed copy of other[i_src + i] into [i_tgt + i] for i from i_first up to i_end,
+            // i_tgt + i_first must be a multiple of the stride
+            template <class OtherCalcVector>
+            void copy_packed(const OtherCalcVector& other, int i_tgt, int i_src, int i_first, int i_end)
+            {
+                  common_subexpressions<NumType> cse(other);
+                  if (packed_alignment<NumType>::is_aligned(other.get_alignment(), i_src + i_first))
+                        copy_packed_as<true>(other, i_tgt, i_src, i_first, i_end);
+                  else
+                        copy_packed_as<false>(other, i_tgt, i_src, i_first, i_end);
+            }
+
+            template <bool Aligned, class OtherCalcVector>
+            void copy_packed_as(const OtherCalcVector& other, int i_tgt, int i_src, int i_first, int i_end)
+            {
+                  typedef packed_prologue<NumType, OtherCalcVector> prologue_t;
+                  const int i_body = prologue_t::end(other, i_src, i_first, i_end);
+                  int i = i_first;
+                  for ( ; i < i_body; i += arch_traits_t::stride)
+                        set_packed(i_tgt + i, other.template get_packed<Aligned>(i_src + i));
+                  for ( ; i < i_end; i += arch_traits_t::stride)
+                        set_packed(i_tgt + i, other.template get_packed<Aligned, prologue_t::body>(i_src + i));
+            }
+      };
+
+      template <typename NumType, class DataEngine, unsigned int Level>
+      struct has_lagged_operand< calc_vector<NumType, DataEngine, Level> >
+      {
+            enum { result = has_lagged_operand<DataEngine>::result };
       };
 }
 
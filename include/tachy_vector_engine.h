@@ -1,17 +1,22 @@
 #if !defined(TACHY_VECTOR_ENGINE_H__INCLUDED)
 #define TACHY_VECTOR_ENGINE_H__INCLUDED
 
+#include <algorithm>
 #include <vector>
-#include <unordered_set>
 
 #include "tachy_arch_traits.h"
 #include "tachy_aligned_allocator.h"
 #include "tachy_cacheable.h"
+#include "tachy_common_subexpression.h"
 #include "tachy_date.h"
 #include "tachy_lagged_engine.h"
 
 namespace tachy
 {
+      // The storage is padded past size() so that any pack starting at a valid index is within it:
+      // packed kernels process whole vectors without scalar tails, reading and writing the padding
+      // as needed. The padding is zeroed whenever the storage is (re)sized, its values are otherwise
+      // whatever the last packed kernel left there, and are never part of the results
       template <typename NumType>
       class vector_engine : public cacheable
       {
@@ -21,22 +26,30 @@ namespace tachy
             typedef std::vector<NumType, allocator_t> storage_t;
 
             vector_engine(const tachy_date& start_date, const std::vector<NumType>& data) :
-                  _data(data.begin(), data.end()),
+                  _data(padded_size(data.size()), NumType(0)),
+                  _size(data.size()),
                   _start_date(start_date)
-            {}
+            {
+                  std::copy(data.begin(), data.end(), _data.begin());
+            }
 
             vector_engine(const vector_engine& other) : cacheable(other),
                   _data(other._data),
-                  _start_date(other._start_date) // no need to copy _guard because storage is not shared between this and other
+                  _size(other._size),
+                  _start_date(other._start_date)
             {}
 
             vector_engine(const tachy_date& start_date, unsigned int size, NumType value) :
-                  _data(size, value),
+                  _data(padded_size(size), NumType(0)),
+                  _size(size),
                   _start_date(start_date)
-            {}
+            {
+                  std::fill(_data.begin(), _data.begin() + size, value);
+            }
 
             vector_engine(const tachy_date& start_date, unsigned int size) :
-                  _data(size, NumType(0)),
+                  _data(padded_size(size), NumType(0)),
+                  _size(size),
                   _start_date(start_date)
             {}
 
@@ -54,31 +67,80 @@ namespace tachy
                   if (&other != this)
                   {
                         _data = other._data;
+                        _size = other._size;
                         _start_date = other._start_date;
-                        // _guard is unchanged (not sure it's right: but generally _guard is a specific instance, not values it contains)
                   }
                   return *this;
             }
 
             vector_engine& operator= (const std::vector<NumType>& src)
             {
-                  int delta = src.size() - size();
-                  if (delta > 0)
-                        _data.resize(_data.size() + delta, NumType(0));
-                  copy(src.begin(), src.end(), begin());
+                  if (src.size() > size())
+                        resize_storage(src.size());
+                  std::copy(src.begin(), src.end(), begin());
+                  return *this;
+            }
+
+            // storage length for n elements: a multiple of the stride, with room for a whole pack at n-1
+            static unsigned int padded_size(unsigned int n)
+            {
+                  return arch_traits_t::stride*((n + 2*arch_traits_t::stride - 2)/arch_traits_t::stride);
             }
 
+            // the storage is aligned, so the aligned load is safe at multiples of the stride -
+            // the evaluators decide which one to use based on get_alignment() of the whole expression
+            template <bool Aligned = false, bool Prologue = true>
             typename arch_traits_t::packed_t get_packed(int idx) const
             {
-                  // can this be improved? or is it faster to go with unaligned load than to branch?
-                  return arch_traits_t::loadu(&_data[idx]);
+                  return Aligned ? arch_traits_t::loada(&_data[idx]) : arch_traits_t::loadu(&_data[idx]);
             }
 
+            // idx must be a multiple of the stride
             void set_packed(int idx, typename arch_traits_t::packed_t value)
             {
                   *(typename arch_traits_t::packed_t*)(&_data[idx]) = value;
             }
-      
+
+            int get_alignment() const
+            {
+                  return 0;
+            }
+
+            // evaluates eng over the whole vector with packed operations -
+            // the last pack may spill into the storage padding
+            template <class Engine>
+            void assign_packed(const Engine& eng)
+            {
+                  common_subexpressions<NumType> cse(eng);
+                  if (packed_alignment<NumType>::is_aligned(eng.get_alignment(), 0))
+                        fill_packed<true>(eng);
+                  else
+                        fill_packed<false>(eng);
+            }
+
+            // in place OpType: element i_tgt + i becomes OpType::apply(element i_tgt + i, eng[i_src + i]) for i < n,
+            // with packed operations from the first multiple of the stride on - the elements past i_tgt + n are
+            // kept, so the last pack only spills over when the rest of it is the storage padding
+            template <class OpType, class Engine>
+            void update_packed(const Engine& eng, int i_tgt, int i_src, int n)
+            {
+                  const int n_peel = std::min(n, (arch_traits_t::stride - i_tgt%arch_traits_t::stride)%arch_traits_t::stride);
+                  const int n_packed = i_tgt + n == int(_size) ? n : n_peel + (n - n_peel)/arch_traits_t::stride*arch_traits_t::stride;
+                  for (int i = 0; i < n_peel; ++i)
+                        _data[i_tgt + i] = OpType::apply(_data[i_tgt + i], eng[i_src + i]);
+                  if (n_peel < n_packed)
+                  {
+                        common_subexpressions<NumType> cse(eng);
+                        const bool aligned = packed_alignment<NumType>::is_aligned(eng.get_alignment(), i_src + n_peel);
+                        if (aligned)
+                              update_packed_as<OpType, true>(eng, i_tgt, i_src, n_peel, n_packed);
+                        else
+                              update_packed_as<OpType, false>(eng, i_tgt, i_src, n_peel, n_packed);
+                  }
+                  for (int i = std::max(n_peel, n_packed); i < n; ++i)
+                        _data[i_tgt + i] = OpType::apply(_data[i_tgt + i], eng[i_src + i]);
+            }
+
             NumType operator[] (int idx) const
             {
                   return _data[idx];
@@ -101,7 +163,7 @@ namespace tachy
             
             unsigned int size() const
             {
-                  return _data.size();
+                  return _size;
             }
 
             typename storage_t::const_iterator begin() const
@@ -116,12 +178,12 @@ namespace tachy
 
             typename storage_t::const_iterator end() const
             {
-                  return _data.end();
+                  return _data.begin() + _size;
             }
 
             typename storage_t::iterator end()
             {
-                  return _data.end();
+                  return _data.begin() + _size;
             }
 
             NumType front() const
@@ -136,12 +198,12 @@ namespace tachy
 
             NumType back() const
             {
-                  return _data.back();
+                  return _data[_size-1];
             }
 
             NumType& back()
             {
-                  return _data.back();
+                  return _data[_size-1];
             }
 
             tachy_date get_start_date() const
@@ -159,7 +221,7 @@ namespace tachy
                               _data[i-diff] = _data[i];
                         // ... and adjusting the tail as necessary
                         unsigned int old_size = size();
-                        _data.resize(new_size, NumType(0));
+                        resize_storage(new_size);
                         // ... zero out the tail
                         for (int i = std::max<int>(0, old_size - diff); i < new_size; ++i)
                               _data[i] = NumType(0);
@@ -167,47 +229,65 @@ namespace tachy
                   else if (diff < 0) // new date is earlier - add 0's
                   {
                         diff = -diff; // for clarity
-                        _data.resize(new_size, NumType(0));
+                        resize_storage(new_size);
                         for (int i = new_size-1; i >= diff; --i)
                               _data[i] = _data[i-diff];
                         for (int i = 0; i < diff; ++i)
                               _data[i] = NumType(0);
                   }
                   else if (new_size != size()) // same start date, simply resize
-                        _data.resize(new_size, NumType(0));
+                        resize_storage(new_size);
                   _start_date = new_start_date;
             }
 
-            void set_assign_guard(const lagged_engine_base<NumType, vector_engine<NumType>>& eng) const
+            template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
             {
-                  _guard.insert(&eng);
+                  return eng.depends_on(*this);
             }
-
-            void release_assign_guard(const lagged_engine_base<NumType, vector_engine<NumType>>& eng) const
+            
+            bool depends_on(const vector_engine& eng) const
             {
-                  _guard.erase(&eng);
+                  return this == &eng;
             }
 
-            bool is_guarded() const
+      private:
+            // keeps the first min(size(), n) values, zeroes the rest of the storage including the padding
+            void resize_storage(unsigned int n)
             {
-                  return not _guard.empty();
+                  const unsigned int n_kept = std::min(_size, n);
+                  _data.resize(padded_size(n));
+                  std::fill(_data.begin() + n_kept, _data.end(), NumType(0));
+                  _size = n;
             }
 
-            template <class SomeOtherDataEngine> bool depends_on(const SomeOtherDataEngine& eng) const
+            template <bool Aligned, class Engine>
+            void fill_packed(const Engine& eng)
             {
-                  return eng.depends_on(*this);
+                  typedef packed_prologue<NumType, Engine> prologue_t;
+                  const int i_max = size();
+                  const int i_body = prologue_t::end(eng, 0, 0, i_max);
+                  int i = 0;
+                  for ( ; i < i_body; i += arch_traits_t::stride)
+                        set_packed(i, eng.template get_packed<Aligned>(i));
+                  for ( ; i < i_max; i += arch_traits_t::stride)
+                        set_packed(i, eng.template get_packed<Aligned, prologue_t::body>(i));
             }
-            
-            bool depends_on(const vector_engine& eng) const
+
+            template <class OpType, bool Aligned, class Engine>
+            void update_packed_as(const Engine& eng, int i_tgt, int i_src, int i_first, int i_end)
             {
-                  return this == &eng;
+                  typedef packed_prologue<NumType, Engine> prologue_t;
+                  const int i_body = prologue_t::end(eng, i_src, i_first, i_end);
+                  int i = i_first;
+                  for ( ; i < i_body; i += arch_traits_t::stride)
+                        set_packed(i_tgt + i, OpType::apply_packed(get_packed<true>(i_tgt + i), eng.template get_packed<Aligned>(i_src + i)));
+                  for ( ; i < i_end; i += arch_traits_t::stride)
+                        set_packed(i_tgt + i, OpType::apply_packed(get_packed<true>(i_tgt + i), eng.template get_packed<Aligned, prologue_t::body>(i_src + i)));
             }
 
-      private:
-            storage_t  _data;
-            tachy_date _start_date;
-
-            mutable std::unordered_set<const lagged_engine_base<NumType, vector_engine<NumType>>*> _guard;
+            storage_t    _data;
+            unsigned int _size;
+            tachy_date   _start_date;
       };
 }
 
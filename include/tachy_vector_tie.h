@@ -0,0 +1,253 @@
+#if !defined(TACHY_VECTOR_TIE_H__INCLUDED)
+#define TACHY_VECTOR_TIE_H__INCLUDED
+
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "tachy_arch_traits.h"
+#include "tachy_common_subexpression.h"
+#include "tachy_lagged_engine.h"
+#include "tachy_vector.h"
+
+namespace tachy
+{
+      // Several stored vectors assigned at once: tie(a, b, c) = std::make_tuple(expr_a, expr_b, expr_c)
+      // is a = expr_a; b = expr_b; c = expr_c; in one packed loop over the common dates - each pack of
+      // all the expressions is evaluated before any of it is stored, so the leaves they share are loaded
+      // once, and so are the functions they share (see common_subexpressions).
+      // The loop is shared when the outputs are distinct vectors of the same dates, the expressions are of
+      // the same dates too, and none of them reads any of the outputs; otherwise the assignments are done
+      // one after the other, as written.
+      // Statements reading the outputs of each other can be evaluated a tile of months at a time instead,
+      // tie(a, b, c).tiled(48) = ...: each statement in turn over the tile, then the next tile, so that the
+      // values passed from one statement to the next are still in the cache when read. It gives the same
+      // results as long as no statement reads an output at a date of another tile before it is due - the
+      // earlier outputs ahead of the date (through a lead), the later ones behind it (through a lag); if
+      // any does, the assignments are done one after the other.
+      // The expressions are built before any of them is assigned, so whatever they compute as they are built
+      // (rolling windows, cached nodes) sees the outputs as they were before: a statement reading an earlier
+      // output through such a node would not get its new values, and the assignment throws
+      template <typename NumType, unsigned int N>
+      class vector_tie
+      {
+      public:
+            typedef arch_traits<NumType, ACTIVE_ARCH_TYPE> arch_traits_t;
+            typedef typename arch_traits_t::packed_t packed_t;
+            typedef calc_vector<NumType, vector_engine<NumType>, 0> vector_t;
+
+            explicit vector_tie(vector_t* const (&outputs)[N]) :
+                  _tile(0)
+            {
+                  std::copy(outputs, outputs + N, _out);
+            }
+
+            // months per tile, rounded up to whole packs - 0 for the assignments one after the other
+            vector_tie& tiled(unsigned int months)
+            {
+                  _tile = months;
+                  return *this;
+            }
+
+            template <class... Exprs>
+            vector_tie& operator= (const std::tuple<Exprs...>& exprs)
+            {
+                  static_assert(sizeof...(Exprs) == N, "one expression per tied vector");
+                  assign(exprs, std::make_index_sequence<N>());
+                  return *this;
+            }
+
+      private:
+            vector_t*    _out[N];
+            unsigned int _tile;
+
+            template <class Tuple, std::size_t... I>
+            void assign(const Tuple& exprs, std::index_sequence<I...>)
+            {
+                  int checked[] = { (check_eager_reads(I, std::get<I>(exprs)), 0)... };
+                  (void)checked;
+
+                  const bool shared = same_dates(std::get<I>(exprs)...) and distinct_outputs();
+                  const bool reads_outputs[] = { shared and reads_any_output(std::get<I>(exprs))... };
+                  if (not shared or std::find(reads_outputs, reads_outputs + N, true) != reads_outputs + N)
+                  {
+                        const bool across_tiles[] = { 0 == _tile or reads_across_tiles(I, std::get<I>(exprs))... };
+                        if (distinct_outputs() and std::find(across_tiles, across_tiles + N, true) == across_tiles + N)
+                              assign_tiled(exprs, std::index_sequence<I...>());
+                        else
+                        {
+                              int done[] = { (*_out[I] = std::get<I>(exprs), 0)... };
+                              (void)done;
+                        }
+                        return;
+                  }
+
+                  // as in the assignment of a single expression (see calc_vector<NumType, vector_engine<NumType>, 0>)
+                  const auto& first = std::get<0>(exprs);
+                  const int num_hist = first.get_start_date() - _out[0]->get_start_date();
+                  const int i_tgt = std::max(0, num_hist);
+                  const int i_src = std::max(0, -num_hist);
+                  const int n_elems = std::min<int>(first.size() - i_src, _out[0]->size() - i_tgt);
+                  if (n_elems <= 0)
+                        return;
+
+                  const int n_peel = std::min(n_elems, (arch_traits_t::stride - i_tgt%arch_traits_t::stride)%arch_traits_t::stride);
+                  for (int i = 0; i < n_peel; ++i)
+                  {
+                        int done[] = { ((*_out[I])[i_tgt + i] = std::get<I>(exprs)[i_src + i], 0)... };
+                        (void)done;
+                  }
+                  if (n_peel < n_elems)
+                  {
+                        common_subexpressions<NumType> cse(std::get<I>(exprs)...);
+                        const bool aligned[] = { packed_alignment<NumType>::is_aligned(std::get<I>(exprs).get_alignment(), i_src + n_peel)... };
+                        const bool all_aligned = std::find(aligned, aligned + N, false) == aligned + N;
+                        if (all_aligned)
+                              fill_packed<true, I...>(exprs, i_tgt, i_src, n_peel, n_elems);
+                        else
+                              fill_packed<false, I...>(exprs, i_tgt, i_src, n_peel, n_elems);
+                  }
+                  for (unsigned int k = 0; k < N; ++k)
+                  {
+                        vector_t& out = *_out[k];
+                        for (int i = i_tgt + n_elems, i_max = out.size(); i < i_max; ++i)
+                              out[i] = out[i_tgt + n_elems - 1];
+                  }
+            }
+
+            template <std::size_t K, class Tuple>
+            using prologue_t = packed_prologue<NumType, typename std::decay<typename std::tuple_element<K, Tuple>::type>::type>;
+
+            template <bool Aligned, std::size_t... I, class Tuple>
+            void fill_packed(const Tuple& exprs, int i_tgt, int i_src, int i_first, int i_end)
+            {
+                  // the prologue runs up to where the last of the statements leaves its own
+                  const int i_ends[] = { prologue_t<I, Tuple>::end(std::get<I>(exprs), i_src, i_first, i_end)... };
+                  const int i_body = *std::max_element(i_ends, i_ends + N);
+                  int i = i_first;
+                  for ( ; i < i_body; i += arch_traits_t::stride)
+                  {
+                        const packed_t values[] = { std::get<I>(exprs).template get_packed<Aligned>(i_src + i)... };
+                        for (unsigned int k = 0; k < N; ++k)
+                              _out[k]->set_packed(i_tgt + i, values[k]);
+                  }
+                  for ( ; i < i_end; i += arch_traits_t::stride)
+                  {
+                        const packed_t values[] = { std::get<I>(exprs).template get_packed<Aligned, prologue_t<I, Tuple>::body>(i_src + i)... };
+                        for (unsigned int k = 0; k < N; ++k)
+                              _out[k]->set_packed(i_tgt + i, values[k]);
+                  }
+            }
+
+            template <class Tuple, std::size_t... I>
+            void assign_tiled(const Tuple& exprs, std::index_sequence<I...>)
+            {
+                  // the tiles cover the dates of all the outputs, counted from the start date of the first one
+                  int offset[N];
+                  int i_begin = 0;
+                  int i_end = 0;
+                  for (unsigned int k = 0; k < N; ++k)
+                  {
+                        offset[k] = _out[k]->get_start_date() - _out[0]->get_start_date();
+                        i_begin = std::min(i_begin, offset[k]);
+                        i_end = std::max<int>(i_end, offset[k] + _out[k]->size());
+                  }
+                  const int tile = arch_traits_t::stride*((_tile + arch_traits_t::stride - 1)/arch_traits_t::stride);
+                  for (int i = i_begin; i < i_end; i += tile)
+                  {
+                        int done[] = { (assign_tile(*_out[I], std::get<I>(exprs), i - offset[I], tile), 0)... };
+                        (void)done;
+                  }
+            }
+
+            // the elements lo, ..., lo + n - 1 of the assignment of expr to out
+            template <class Expr>
+            static void assign_tile(vector_t& out, const Expr& expr, int lo, int n)
+            {
+                  const int num_hist = expr.get_start_date() - out.get_start_date();
+                  const int i_tgt = std::max(0, num_hist);
+                  const int i_src = std::max(0, -num_hist);
+                  const int n_elems = std::min<int>(expr.size() - i_src, out.size() - i_tgt);
+                  if (n_elems <= 0)
+                        return;
+                  const int i_first = std::max(lo, i_tgt);
+                  const int i_last = std::min(lo + n, i_tgt + n_elems);
+                  if (i_first < i_last)
+                        out.assign_range(expr, i_first, i_src + i_first - i_tgt, i_last - i_first);
+                  for (int i = std::max(lo, i_tgt + n_elems), i_max = std::min<int>(lo + n, out.size()); i < i_max; ++i)
+                        out[i] = out[i_tgt + n_elems - 1];
+            }
+
+            // whether statement k reads an output at a date of another tile before it is due: a later output
+            // behind the date would have its new values there, an earlier one ahead of it would not have them yet
+            template <class Expr>
+            bool reads_across_tiles(unsigned int k, const Expr& expr) const
+            {
+                  for (unsigned int j = 0; j < N; ++j)
+                  {
+                        if ((k < j and expr.depends_on(lagged_alias_probe<vector_engine<NumType> >(_out[j]->engine()))) or
+                            (j < k and expr.depends_on(lagged_alias_probe<vector_engine<NumType>, true>(_out[j]->engine()))))
+                              return true;
+                  }
+                  return false;
+            }
+
+            // statement k must not read an earlier output through a node computed as it was built
+            template <class Expr>
+            void check_eager_reads(unsigned int k, const Expr& expr) const
+            {
+                  if (0 == k)
+                        return;
+                  lead_probe<NumType> probe;
+                  expr.depends_on(probe);
+                  for (unsigned int j = 0; j < k; ++j)
+                  {
+                        if (probe.reads_eagerly(_out[j]->engine()))
+                              TACHY_THROW("Tied statement " << k << " reads output " << j << " through a node computed before the assignment");
+                  }
+            }
+
+            template <class Expr, class... Exprs>
+            bool same_dates(const Expr& first, const Exprs&... rest) const
+            {
+                  for (unsigned int k = 1; k < N; ++k)
+                  {
+                        if (_out[k]->get_start_date() != _out[0]->get_start_date() or _out[k]->size() != _out[0]->size())
+                              return false;
+                  }
+                  const bool same[] = { true, (rest.get_start_date() == first.get_start_date() and rest.size() == first.size())... };
+                  return std::find(same, same + sizeof(same)/sizeof(same[0]), false) == same + sizeof(same)/sizeof(same[0]);
+            }
+
+            bool distinct_outputs() const
+            {
+                  for (unsigned int k = 1; k < N; ++k)
+                  {
+                        if (std::find(_out, _out + k, _out[k]) != _out + k)
+                              return false;
+                  }
+                  return true;
+            }
+
+            template <class Expr>
+            bool reads_any_output(const Expr& expr) const
+            {
+                  for (unsigned int k = 0; k < N; ++k)
+                  {
+                        if (expr.depends_on(_out[k]->engine()))
+                              return true;
+                  }
+                  return false;
+            }
+      };
+
+      template <typename NumType, class... Vectors>
+      vector_tie<NumType, 1 + sizeof...(Vectors)> tie(calc_vector<NumType, vector_engine<NumType>, 0>& x, Vectors&... rest)
+      {
+            calc_vector<NumType, vector_engine<NumType>, 0>* const outputs[] = { &x, &rest... };
+            return vector_tie<NumType, 1 + sizeof...(Vectors)>(outputs);
+      }
+}
+
+#endif // TACHY_VECTOR_TIE_H__INCLUDED
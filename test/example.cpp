@@ -25,17 +25,6 @@ typedef double real_t;
 
 /*****---------------------------------------- Sun Mar  2 2014 ----------*****/
 
-static void random(real_t x0, real_t x1, tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 0>& vec)
-{
-      unsigned int iMax = vec.size();
-      real_t xc = 0.5*(x0 + x1);
-      real_t dx = 0.5*(x1 - x0);
-      for (unsigned int i = 0; i < iMax; ++i)
-            vec[i] = real_t(xc + dx*double(random())/RAND_MAX);
-}
-
-/*****---------------------------------------- Sun Mar  2 2014 ----------*****/
-
 struct Model
 {
       const unsigned int nProj;
@@ -285,7 +274,7 @@ public:
 
 typedef tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 0> CVec0_t;
 typedef tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 2> CVec2_t;
-typedef tachy::calc_vector<real_t, tachy::iota_engine<real_t>, 2> AgeVec2_t;
+typedef tachy::calc_vector<real_t, tachy::generator_engine<real_t, tachy::geometric_generator<real_t> >, 2> DecayVec2_t;
 
 void runAll(const Model& model, const vector<Pool*>& collateral, const tachy::tachy_date& projDate, int numPaths)
 {
@@ -294,18 +283,35 @@ void runAll(const Model& model, const vector<Pool*>& collateral, const tachy::ta
       PmtCalc pmtCalc(120);
 
       int numHist = 360;
-      CVec0_t mtg("mtgRate", projDate - numHist, nProj);
-      for (int i = 0; i < numHist; ++i)
-            mtg[i] = 4.51;
-      
+
       char pathKey[16];
 
       long unsigned int ut = 0;
       struct timeval tv;
-      
+
+      // Hull-White short rate and a lagged mortgage rate spread, in percent; the scenarios are generated
+      // a pack of paths at a time straight into the mtg vectors of the pack
+      const unsigned int packSize = tachy::arch_traits<real_t, tachy::ACTIVE_ARCH_TYPE>::stride;
+#if defined(TACHY_EXAMPLE_PSEUDO_RANDOM_RATES)
+      typedef tachy::philox_shocks<real_t> Shocks_t;
+      Shocks_t shocks(20130510);
+#else
+      typedef tachy::sobol_shocks<real_t> Shocks_t;
+      Shocks_t shocks(nProj, 20130510);
+#endif
+      tachy::short_rate_scenarios<real_t, tachy::hull_white_model<real_t>, Shocks_t> scenarios(tachy::hull_white_model<real_t>(2.76, 0.1, 3.5, 1.0),
+                                                                                               tachy::mortgage_rate_model<real_t>(1.75, 1.0, 0.25, 0.01),
+                                                                                               shocks);
+      vector<CVec0_t> mtgPack(packSize, CVec0_t("mtgRate", projDate - numHist, nProj));
+      vector<CVec0_t*> mtgPackPtrs;
+      for (unsigned int i = 0; i < packSize; ++i)
+            mtgPackPtrs.push_back(&mtgPack[i]);
+
       for (int nthPath = 0; nthPath < numPaths; ++nthPath)
       {
-            random(0.01, 5.0, mtg);
+            if (0 == nthPath % packSize)
+                  scenarios.generate(nthPath, std::min<unsigned int>(packSize, numPaths - nthPath), &mtgPackPtrs[0]);
+            const CVec0_t& mtg = mtgPack[nthPath % packSize];
 
             memset(pathKey, '\0', sizeof(pathKey));
             sprintf(pathKey, "%d", nthPath + 1);
@@ -338,28 +344,29 @@ void runAll(const Model& model, const vector<Pool*>& collateral, const tachy::ta
                   pmtCalc.calcInvPmts(wouldBeInvPmts2, mtg[t-2] + p->dFee);
                   pmtCalc.calcInvPmts(wouldBeInvPmts3, mtg[t-2] + p->dFee + p->elbow);
 
-                  pmtRatio1 = actPmts*wouldBeInvPmts1 - model.eiOffset;
-                  pmtRatio2 = actPmts*wouldBeInvPmts2 - model.eiOffset;
-                  pmtRatio3 = actPmts*wouldBeInvPmts3 - model.eiOffset;
-
-                  // here the lib detects that the destination vector
-                  // is present on the right hand side with a lag,
-                  // so it will disable vectorization
+                  // the ratios and the burnout are computed 64 months at a time, so that
+                  // the ratios are still in the cache when the burnout reads them;
+                  // here the lib detects that the burnout is present on the right hand side
+                  // with a lag, so it will disable vectorization of that statement
                   burnout[0] = 0.0;
-                  burnout = 0.98*burnout[t-1] + tachy::max(0.0, tachy::min(pmtRatio1, 0.2));
+                  tachy::tie(pmtRatio1, pmtRatio2, pmtRatio3, burnout).tiled(64) = std::make_tuple(actPmts*wouldBeInvPmts1 - model.eiOffset,
+                                                                                                   actPmts*wouldBeInvPmts2 - model.eiOffset,
+                                                                                                   actPmts*wouldBeInvPmts3 - model.eiOffset,
+                                                                                                   0.98*burnout[t-1] + tachy::max(0.0, tachy::min(pmtRatio1, 0.2)));
 
-                  AgeVec2_t wala("wala", projDate, AgeVec2_t::data_engine_t(projDate, p->wala, p->wam), *p);
+                  // exp(-age/36) without storage: exp(-wala/36)*exp(-1/36)^t
+                  DecayVec2_t seasoning("seasoning", projDate, DecayVec2_t::data_engine_t(projDate, p->wam, tachy::geometric_generator<real_t>(exp(-p->wala/36.0), exp(-1.0/36.0))), *p);
 
                   std::vector<CVec2_t> modulation;
                   modulation.reserve(model.baseRefi.get_num_nodes());
                   for (int i = 0; i < model.baseRefi.get_num_nodes(); ++i)
                   {
-                        CVec2_t a_mod = 1.0/(1.0 + i)*(1.0 + 0.2*exp(-wala/36.0))*(1.0 - actAmort/200000.0);
+                        CVec2_t a_mod = 1.0/(1.0 + i)*(1.0 + 0.2*seasoning)*(1.0 - actAmort/200000.0);
                         modulation.push_back(a_mod);
                   }
                   tachy::mod_linear_spline_uniform_index<real_t, 2U> adjRefi(model.baseRefi, modulation);
 
-                  smrRefi = (1.0 - 0.25*exp(1.0 - actAmort/200000.0))*(1.0 + 0.2*exp(-wala/36.0))*(0.6*adjRefi(pmtRatio3) + 0.4*adjRefi(pmtRatio3[t+1]) - 1.0)*exp(0.25*burnout);
+                  smrRefi = (1.0 - 0.25*exp(1.0 - actAmort/200000.0))*(1.0 + 0.2*seasoning)*(0.6*adjRefi(pmtRatio3) + 0.4*adjRefi(pmtRatio3[t+1]) - 1.0)*exp(0.25*burnout);
 
                   // other pieces of total smm can be done similarly
             }
@@ -7,20 +7,32 @@
 #include <cstdlib>
 #include <stdexcept>
 #include <limits>
+#include <type_traits>
 
 #include "tachy_arch_traits.h"
 #include "tachy_aligned_allocator.h"
 #include "tachy_vector_engine.h"
 #include "tachy_iota_engine.h"
+#include "tachy_generator_engine.h"
+#include "tachy_random_engine.h"
+#include "tachy_sobol_directions.h"
+#include "tachy_sobol_sequence.h"
+#include "tachy_brownian_bridge.h"
+#include "tachy_short_rate_scenario.h"
 #include "tachy_lagged_engine.h"
 #include "tachy_vector.h"
 #include "tachy_expression.h"
 #include "tachy_static_functor_engine.h"
+#include "tachy_vector_tie.h"
+#include "tachy_scenario_scalar.h"
+#include "tachy_rolling_window_engine.h"
 #include "tachy_spline_util.h"
 #include "tachy_linear_spline_incr_slope.h"
 #include "tachy_linear_spline_uniform.h"
 #include "tachy_linear_spline_uniform_index.h"
 #include "tachy_mod_linear_spline_uniform.h"
+#include "tachy_linear_spline_bank_uniform_index.h"
+#include "tachy_bilinear_surface_uniform_index.h"
 #include "tachy_date.h"
 
 class tachy_date_test : public CxxTest::TestSuite
@@ -73,7 +85,28 @@ public:
             TS_ASSERT_EQUALS(tachy::tachy_date(200612), dt[2] + m[2]);
             TS_ASSERT_EQUALS(tachy::tachy_date(201705), dt[3] + m[3]);
 
-            TS_ASSERT_THROWS(dt[1] + 100000, tachy::exception);
+            TS_ASSERT(not (dt[1] + 100000).is_valid());
+            TS_ASSERT(not (dt[1] - 24000).is_valid());
+      }
+
+      void test_dates_index()
+      {
+            TS_TRACE("test_dates_index");
+
+            static_assert(tachy::tachy_date::min_date() + 24 - tachy::tachy_date::min_date() == 24, "constexpr date arithmetic");
+            static_assert((tachy::tachy_date::from_index(12*2017 + 4) + 9).as_uint() == 201802, "constexpr date arithmetic");
+
+            tachy::tachy_date dt(201705);
+            TS_ASSERT_EQUALS(12*2017 + 4, dt.index());
+            TS_ASSERT_EQUALS(dt, tachy::tachy_date::from_index(dt.index()));
+            TS_ASSERT_EQUALS(tachy::tachy_date(101), tachy::tachy_date::min_date());
+            TS_ASSERT_EQUALS(200001U, (tachy::tachy_date(199912) + 1).as_uint());
+            TS_ASSERT_EQUALS(199912U, (tachy::tachy_date(200001) - 1).as_uint());
+            TS_ASSERT_EQUALS(200001U, (++tachy::tachy_date(199912)).as_uint());
+            TS_ASSERT(tachy::tachy_date(199912) < tachy::tachy_date(200001));
+            TS_ASSERT(tachy::tachy_date(200001) >= tachy::tachy_date(199912));
+            TS_ASSERT_THROWS(tachy::tachy_date(200013), tachy::exception);
+            TS_ASSERT_THROWS(tachy::tachy_date(200000), tachy::exception);
       }
 
 };
@@ -655,6 +688,40 @@ public:
                   }
             }
       }
+
+      void test_padding()
+      {
+            TS_TRACE("test_padding");
+
+            typedef engine_t::arch_traits_t arch_traits_t;
+            const unsigned int stride = arch_traits_t::stride;
+
+            for (unsigned int n = 1; n <= 3*stride; ++n)
+            {
+                  TS_ASSERT_EQUALS(0U, engine_t::padded_size(n)%stride);
+                  TS_ASSERT(engine_t::padded_size(n) >= n + stride - 1);
+
+                  engine_t eng(tachy::tachy_date(dt), vector_t(src.begin(), src.begin() + n));
+                  TS_ASSERT_EQUALS(n, eng.size());
+                  TS_ASSERT_EQUALS(src[n-1], eng.back());
+
+                  // a pack starting at the last element is within the storage, its padding lanes are zeroed
+                  arch_traits_t::packed_t z = eng.get_packed(n-1);
+                  TS_ASSERT_EQUALS(src[n-1], ((real_t*)&z)[0]);
+                  for (unsigned int k = 1; k < stride; ++k)
+                        TS_ASSERT_EQUALS(0.0, ((real_t*)&z)[k]);
+
+                  // shrinking clears what is left behind
+                  if (n > 1)
+                  {
+                        eng.set_packed(0, arch_traits_t::set1(1.0));
+                        eng.reset(tachy::tachy_date(dt), n-1);
+                        z = eng.get_packed(0);
+                        for (unsigned int k = 0; k < stride; ++k)
+                              TS_ASSERT_EQUALS(k + 1 < n ? 1.0 : 0.0, ((real_t*)&z)[k]);
+                  }
+            }
+      }
 };
 
 class tachy_iota_engine_test : public CxxTest::TestSuite
@@ -694,6 +761,463 @@ public:
       }
 };
 
+class tachy_generator_engine_test : public CxxTest::TestSuite
+{
+private:
+      typedef double real_t;
+      typedef tachy::arch_traits<real_t, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+
+      // every value, scalar and packed from every index
+      template <class Engine>
+      static void check(const Engine& eng, const std::vector<real_t>& expected, real_t delta)
+      {
+            TS_ASSERT_EQUALS(expected.size(), eng.size());
+            for (int i = 0; i < eng.size(); ++i)
+            {
+                  TS_ASSERT_DELTA(expected[i], eng[i], delta);
+                  if (i + arch_traits_t::stride <= eng.size())
+                  {
+                        arch_traits_t::packed_t z = eng.get_packed(i);
+                        for (int j = 0; j < arch_traits_t::stride; ++j)
+                              TS_ASSERT_DELTA(expected[i+j], ((real_t*)&z)[j], delta);
+                  }
+            }
+      }
+
+public:
+
+      void test_generators()
+      {
+            TS_TRACE("test_generators");
+
+            const tachy::tachy_date dt(201703);
+            const unsigned int n = 361;
+            std::vector<real_t> expected(n);
+
+            for (int i = 0; i < n; ++i)
+                  expected[i] = 4.5;
+            check(tachy::generator_engine<real_t, tachy::constant_generator<real_t> >(dt, n, tachy::constant_generator<real_t>(4.5)), expected, 0.0);
+
+            // seasoning: min(age/30, 1) from age 7 on
+            for (int i = 0; i < n; ++i)
+                  expected[i] = std::min((7.0 + i)/30.0, 1.0);
+            check(tachy::generator_engine<real_t, tachy::affine_generator<real_t> >(dt, n, tachy::affine_generator<real_t>(7.0/30.0, 1.0/30.0, 0.0, 1.0)), expected, 1e-14);
+            TS_ASSERT_THROWS(tachy::affine_generator<real_t>(0.0, 1.0, 1.0, 0.0), tachy::exception);
+
+            for (int i = 0; i < n; ++i)
+                  expected[i] = i < 25 ? 0.1 : 0.3;
+            check(tachy::generator_engine<real_t, tachy::step_generator<real_t> >(dt, n, tachy::step_generator<real_t>(25, 0.1, 0.3)), expected, 0.0);
+
+            for (int i = 0; i < n; ++i)
+                  expected[i] = 2.0*std::pow(0.98, i);
+            check(tachy::generator_engine<real_t, tachy::geometric_generator<real_t> >(dt, n, tachy::geometric_generator<real_t>(2.0, 0.98)), expected, 1e-14);
+      }
+
+      void test_generator_vectors()
+      {
+            TS_TRACE("test_generator_vectors");
+
+            typedef tachy::calc_cache<real_t, 2U> cache_t;
+            typedef tachy::calc_vector<real_t, tachy::generator_engine<real_t, tachy::geometric_generator<real_t> >, 2U> decay_vector_t;
+            typedef tachy::calc_vector<real_t, tachy::generator_engine<real_t, tachy::affine_generator<real_t> >, 0U> ramp_vector_t;
+
+            const tachy::tachy_date dt(201703);
+            const unsigned int n = 123;
+            std::vector<real_t> src(n);
+            for (int i = 0; i < n; ++i)
+                  src[i] = real_t(random())/RAND_MAX;
+
+            cache_t cache("pool");
+            tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 2U> x("x", dt, src, cache, true);
+            decay_vector_t decay("decay", dt, decay_vector_t::data_engine_t(dt, n, tachy::geometric_generator<real_t>(1.0, 0.98)), cache);
+            tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 0U> r = x*decay + 1.0;
+            for (int i = 0; i < n; ++i)
+                  TS_ASSERT_DELTA(src[i]*std::pow(0.98, i) + 1.0, r[i], 1e-14);
+
+            // generators align on dates like any other vector
+            ramp_vector_t ramp("ramp", dt + 2, ramp_vector_t::data_engine_t(dt + 2, n, tachy::affine_generator<real_t>(0.0, 1.0)));
+            tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 0U> y("y", dt, src);
+            tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 0U> u = y*ramp;
+            TS_ASSERT_EQUALS(dt + 2, u.get_start_date());
+            for (int i = 0; i < n - 2; ++i)
+                  TS_ASSERT_DELTA(src[i+2]*i, u[i], 1e-14);
+      }
+};
+
+class tachy_random_engine_test : public CxxTest::TestSuite
+{
+private:
+      typedef double real_t;
+      typedef tachy::arch_traits<real_t, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+      typedef tachy::random_engine<real_t> uniform_engine_t;
+      typedef tachy::random_engine<real_t, tachy::normal_distribution<real_t> > normal_engine_t;
+
+public:
+
+      void test_philox()
+      {
+            TS_TRACE("test_philox");
+
+            // known answers from the reference implementation (Random123)
+            uint32_t c[4][2] = { { 0U, 0x243f6a88U }, { 0U, 0x85a308d3U }, { 0U, 0x13198a2eU }, { 0U, 0x03707344U } };
+            tachy::philox4x32<2>::apply(c, 0U, 0U);
+            TS_ASSERT_EQUALS(0x6627e8d5U, c[0][0]);
+            TS_ASSERT_EQUALS(0xe169c58dU, c[1][0]);
+            TS_ASSERT_EQUALS(0xbc57ac4cU, c[2][0]);
+            TS_ASSERT_EQUALS(0x9b00dbd8U, c[3][0]);
+
+            uint32_t d[4][1] = { { 0x243f6a88U }, { 0x85a308d3U }, { 0x13198a2eU }, { 0x03707344U } };
+            tachy::philox4x32<1>::apply(d, 0xa4093822U, 0x299f31d0U);
+            TS_ASSERT_EQUALS(0xd16cfe09U, d[0][0]);
+            TS_ASSERT_EQUALS(0x94fdccebU, d[1][0]);
+            TS_ASSERT_EQUALS(0x5001e420U, d[2][0]);
+            TS_ASSERT_EQUALS(0x24126ea1U, d[3][0]);
+      }
+
+      void test_reproducible_paths()
+      {
+            TS_TRACE("test_reproducible_paths");
+
+            const tachy::tachy_date dt(201703);
+            const unsigned int n = 360;
+            const uint64_t seed = 20170301;
+            uniform_engine_t u1(dt, n, seed, 1, tachy::uniform_distribution<real_t>(0.01, 5.0));
+            uniform_engine_t u1_again(dt, n, seed, 1, tachy::uniform_distribution<real_t>(0.01, 5.0));
+            uniform_engine_t u2(dt, n, seed, 2, tachy::uniform_distribution<real_t>(0.01, 5.0));
+            uniform_engine_t u1_other_seed(dt, n, seed + 1, 1, tachy::uniform_distribution<real_t>(0.01, 5.0));
+
+            // packs at any index, in any order, match the scalar values
+            int num_same = 0;
+            for (int i = n - arch_traits_t::stride; i >= 0; i -= 3)
+            {
+                  arch_traits_t::packed_t z = u1.get_packed(i);
+                  for (int j = 0; j < arch_traits_t::stride; ++j)
+                        TS_ASSERT_EQUALS(u1_again[i+j], ((real_t*)&z)[j]);
+                  num_same += u1[i] == u2[i];
+                  num_same += u1[i] == u1_other_seed[i];
+            }
+            TS_ASSERT_EQUALS(0, num_same);
+
+            tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 0U> x("x", dt, n);
+            x = tachy::calc_vector<real_t, uniform_engine_t, 0U>("rates", dt, u1);
+            for (int i = 0; i < n; ++i)
+            {
+                  TS_ASSERT_DELTA(u1[i], x[i], 1e-14); // u1[i] may be kept in extended precision on x87
+                  TS_ASSERT(0.01 <= x[i] && x[i] < 5.0);
+            }
+      }
+
+      void test_distributions()
+      {
+            TS_TRACE("test_distributions");
+
+            const tachy::tachy_date dt(201703);
+            const unsigned int n = 100000;
+            uniform_engine_t u(dt, n, 42, 7, tachy::uniform_distribution<real_t>(0.0, 1.0));
+            normal_engine_t z(dt, n, 42, 7, tachy::normal_distribution<real_t>(1.0, 2.0));
+
+            real_t su = 0.0, su2 = 0.0, sz = 0.0, sz2 = 0.0;
+            for (int i = 0; i < n; i += arch_traits_t::stride)
+            {
+                  arch_traits_t::packed_t pu = u.get_packed(i);
+                  arch_traits_t::packed_t pz = z.get_packed(i);
+                  for (int j = 0; j < arch_traits_t::stride; ++j)
+                  {
+                        const real_t x = ((real_t*)&pu)[j];
+                        const real_t y = ((real_t*)&pz)[j];
+                        TS_ASSERT(0.0 <= x && x < 1.0);
+                        su += x;
+                        su2 += x*x;
+                        sz += y;
+                        sz2 += y*y;
+                  }
+            }
+            // within 5 standard errors
+            TS_ASSERT_DELTA(0.5, su/n, 5.0*std::sqrt(1.0/12.0/n));
+            TS_ASSERT_DELTA(1.0/12.0, su2/n - (su/n)*(su/n), 5.0*std::sqrt(1.0/180.0/n));
+            TS_ASSERT_DELTA(1.0, sz/n, 5.0*2.0/std::sqrt(n));
+            TS_ASSERT_DELTA(4.0, sz2/n - (sz/n)*(sz/n), 5.0*4.0*std::sqrt(2.0/n));
+      }
+};
+
+class tachy_sobol_test : public CxxTest::TestSuite
+{
+private:
+      typedef double real_t;
+      typedef tachy::arch_traits<real_t, tachy::ACTIVE_ARCH_TYPE> arch_traits_t;
+
+public:
+
+      void test_primitive_polynomials()
+      {
+            TS_TRACE("test_primitive_polynomials");
+
+            // x+1, x^2+x+1, x^3+x+1, x^3+x^2+1, x^4+x+1, x^4+x^3+1, x^5+x^2+1, ...
+            const uint32_t expected[] = { 3, 7, 11, 13, 19, 25, 37, 41, 47, 55, 59, 61 };
+            std::vector<uint32_t> p = tachy::gf2_polynomial::primitive(12);
+            for (int i = 0; i < 12; ++i)
+                  TS_ASSERT_EQUALS(expected[i], p[i]);
+            TS_ASSERT(not tachy::gf2_polynomial::is_primitive(21)); // x^4+x^2+1 = (x^2+x+1)^2
+            TS_ASSERT(not tachy::gf2_polynomial::is_primitive(31)); // x^4+x^3+x^2+x+1 has order 5
+
+            // the Joe-Kuo table lists the same polynomials in the same order, with m_k odd and below 2^k
+            p = tachy::gf2_polynomial::primitive(tachy::sobol_joe_kuo::max_dims - 1);
+            for (unsigned int d = 1; d < tachy::sobol_joe_kuo::max_dims; ++d)
+            {
+                  const uint16_t* row = tachy::sobol_joe_kuo::row(d);
+                  TS_ASSERT_EQUALS(p[d-1], row[0]);
+                  for (unsigned int k = 1, s = tachy::gf2_polynomial::degree(row[0]); k <= s; ++k)
+                        TS_ASSERT(1 == (row[k] & 1) && row[k] < (1U << k));
+            }
+      }
+
+      void test_sobol_points()
+      {
+            TS_TRACE("test_sobol_points");
+
+            const unsigned int num_dims = 12;
+            const unsigned int m = 10;
+            const unsigned int n = 1U << m;
+            tachy::sobol_sequence<real_t> s(num_dims, 20130510);
+
+            TS_ASSERT_EQUALS(0U, s.get_bits(0, 0));
+            TS_ASSERT_EQUALS(0x80000000U, s.get_bits(1, 0));
+            TS_ASSERT_EQUALS(0xC0000000U, s.get_bits(2, 0));
+            TS_ASSERT_EQUALS(0x40000000U, s.get_bits(3, 0));
+
+            // the points of the reference implementation with the Joe-Kuo direction numbers
+            tachy::sobol_sequence<real_t> s360(tachy::sobol_joe_kuo::max_dims);
+            TS_ASSERT_EQUALS(0x20000000U, s360.get_bits(5, 2));
+            TS_ASSERT_EQUALS(0x72000000U, s360.get_bits(100, 359));
+            TS_ASSERT_EQUALS(0xC4C00000U, s360.get_bits(1000, 100));
+
+            // each dimension puts exactly one of the first 2^m points in each interval [i/2^m, (i+1)/2^m)
+            for (unsigned int d = 0; d < num_dims; ++d)
+            {
+                  std::vector<int> count(n, 0);
+                  for (uint32_t i = 0; i < n; ++i)
+                        ++count[s.get_bits(i, d) >> (32 - m)];
+                  TS_ASSERT_EQUALS(n, std::count(count.begin(), count.end(), 1));
+            }
+
+            // the first two dimensions make a (0, m, 2)-net: one point in each 2^-k by 2^(k-m) box
+            for (unsigned int k = 0; k <= m; ++k)
+            {
+                  std::vector<int> count(n, 0);
+                  for (uint32_t i = 0; i < n; ++i)
+                  {
+                        // the leading k bits of dimension 0 and m-k bits of dimension 1, as 64-bit shifts by up to 32
+                        const uint64_t x0 = uint64_t(s.get_bits(i, 0)) >> (32 - k);
+                        const uint64_t x1 = uint64_t(s.get_bits(i, 1)) >> (32 - (m - k));
+                        ++count[(x0 << (m - k)) | x1];
+                  }
+                  TS_ASSERT_EQUALS(n, std::count(count.begin(), count.end(), 1));
+            }
+
+            // Gray code increments from any starting point match the direct computation
+            const unsigned int k = 37;
+            std::vector<real_t> u(num_dims*k);
+            s.points(1000, k, &u[0]);
+            for (unsigned int d = 0; d < num_dims; ++d)
+            {
+                  for (unsigned int j = 0; j < k; ++j)
+                  {
+                        TS_ASSERT_EQUALS(s.to_unit(s.get_bits(1000 + j, d)), u[d*k + j]);
+                        TS_ASSERT(0.0 < u[d*k + j] && u[d*k + j] < 1.0);
+                  }
+            }
+      }
+
+      void test_brownian_bridge()
+      {
+            TS_TRACE("test_brownian_bridge");
+
+            TS_ASSERT_DELTA(1.959963984540054, tachy::inverse_normal_cdf(0.975), 1e-14);
+            TS_ASSERT_DELTA(-2.326347874040841, tachy::inverse_normal_cdf(0.01), 1e-14);
+            TS_ASSERT_EQUALS(0.0, tachy::inverse_normal_cdf(0.5));
+
+            // the bridge is linear in the normals: with unit vectors in, the levels are the columns of
+            // a square root of the covariance sigma^2*min(s, t)
+            const unsigned int n = 13;
+            const real_t sigma = 0.3;
+            tachy::brownian_bridge<real_t> b(n, sigma);
+            tachy::sobol_brownian_paths<real_t>::storage_t z(n*arch_traits_t::stride), w(n*arch_traits_t::stride);
+            std::vector<std::vector<real_t> > col(n, std::vector<real_t>(n));
+            for (unsigned int i = 0; i < n; ++i)
+            {
+                  for (unsigned int j = 0; j < z.size(); ++j)
+                        z[j] = i == j/arch_traits_t::stride ? 1.0 : 0.0;
+                  b.transform((const arch_traits_t::packed_t*)(&z[0]), (arch_traits_t::packed_t*)(&w[0]));
+                  for (unsigned int t = 0; t < n; ++t)
+                        col[i][t] = w[t*arch_traits_t::stride];
+            }
+            for (unsigned int s = 0; s < n; ++s)
+            {
+                  for (unsigned int t = 0; t < n; ++t)
+                  {
+                        real_t c = 0.0;
+                        for (unsigned int i = 0; i < n; ++i)
+                              c += col[i][s]*col[i][t];
+                        TS_ASSERT_DELTA(sigma*sigma*(std::min(s, t) + 1), c, 1e-12);
+                  }
+            }
+      }
+
+      void test_sobol_brownian_paths()
+      {
+            TS_TRACE("test_sobol_brownian_paths");
+
+            const unsigned int n = 24;
+            const unsigned int num_paths = 4096;
+            tachy::sobol_brownian_paths<real_t> paths(n, 0.1, 42);
+            tachy::sobol_brownian_paths<real_t> paths_again(n, 0.1, 42);
+
+            std::vector<real_t> w(n), dw(n), w_again(n);
+            real_t s = 0.0, s2 = 0.0;
+            for (uint32_t p = 0; p < num_paths; ++p)
+            {
+                  paths.levels(p, w);
+                  paths.shocks(p, dw);
+                  real_t x = 0.0;
+                  for (unsigned int t = 0; t < n; ++t)
+                  {
+                        x += dw[t];
+                        TS_ASSERT_DELTA(w[t], x, 1e-14);
+                  }
+                  s += w[n-1];
+                  s2 += w[n-1]*w[n-1];
+
+                  // paths do not depend on the order they are generated in
+                  paths_again.levels(num_paths - 1 - p, w_again);
+                  paths_again.levels(p, w_again);
+                  for (unsigned int t = 0; t < n; ++t)
+                        TS_ASSERT_EQUALS(w[t], w_again[t]);
+            }
+            // quasi-random: the moments at the horizon are much closer than 1/sqrt(num_paths)
+            TS_ASSERT_DELTA(0.0, s/num_paths, 1e-3);
+            TS_ASSERT_DELTA(0.01*n, s2/num_paths, 0.01*n*1e-2);
+
+            // point 0 is not a path: the mean shocks over the first 2^k paths are within a few 1/2^k of 0
+            for (unsigned int k = 6; k <= 12; ++k)
+            {
+                  tachy::sobol_brownian_paths<real_t> unit_paths(n, 1.0);
+                  std::vector<real_t> mean(n, 0.0);
+                  for (uint32_t p = 0; p < (1U << k); ++p)
+                  {
+                        unit_paths.shocks(p, dw);
+                        for (unsigned int t = 0; t < n; ++t)
+                              mean[t] += dw[t];
+                  }
+                  for (unsigned int t = 0; t < n; ++t)
+                        TS_ASSERT_DELTA(0.0, mean[t], 4.0);
+            }
+      }
+};
+
+class tachy_short_rate_scenario_test : public CxxTest::TestSuite
+{
+private:
+      typedef double real_t;
+      typedef tachy::calc_vector<real_t, tachy::vector_engine<real_t>, 0U> vec_t;
+      typedef tachy::hull_white_model<real_t> hull_white_t;
+
+public:
+
+      void test_deterministic_paths()
+      {
+            TS_TRACE("test_deterministic_paths");
+
+            // without volatility the short rate decays to the long run level, the mortgage rate follows it
+            const tachy::tachy_date dt(201703);
+            const unsigned int n = 120;
+            tachy::short_rate_scenarios<real_t, hull_white_t> s(hull_white_t(1.0, 0.5, 4.0, 0.0),
+                                                                 tachy::mortgage_rate_model<real_t>(1.5, 1.0), tachy::philox_shocks<real_t>(1));
+            vec_t mtg("mtg", dt, n), rate("rate", dt, n);
+            vec_t* pm = &mtg;
+            vec_t* pr = &rate;
+            s.generate(0, 1, &pm, &pr);
+            for (unsigned int t = 0; t < n; ++t)
+            {
+                  const real_t r = 4.0 - 3.0*std::exp(-0.5*t/12.0);
+                  TS_ASSERT_DELTA(r, rate[t], 1e-12);
+                  TS_ASSERT_DELTA(1.5 + r, mtg[t], 1e-12);
+            }
+
+            // a lagged mortgage rate closes half its gap to the target each month
+            tachy::short_rate_scenarios<real_t, hull_white_t> lagged(hull_white_t(3.0, 0.5, 3.0, 0.0),
+                                                                      tachy::mortgage_rate_model<real_t>(1.5, 2.0, 0.5), tachy::philox_shocks<real_t>(1));
+            lagged.generate(0, 1, &pm);
+            for (unsigned int t = 0; t < n; ++t)
+                  TS_ASSERT_DELTA(7.5, mtg[t], 1e-12);
+      }
+
+      void test_shocks()
+      {
+            TS_TRACE("test_shocks");
+
+            // the same normals as the random engine
+            const tachy::tachy_date dt(201703);
+            const unsigned int n = 60;
+            const real_t sigma = 0.8;
+            tachy::short_rate_scenarios<real_t, hull_white_t> s(hull_white_t(2.0, 0.0, 0.0, sigma),
+                                                                 tachy::mortgage_rate_model<real_t>(0.0, 1.0, 1.0, -100.0), tachy::philox_shocks<real_t>(20170301));
+            std::vector<vec_t> mtg(11, vec_t("mtg", dt, n));
+            std::vector<vec_t*> pm;
+            for (unsigned int j = 0; j < mtg.size(); ++j)
+                  pm.push_back(&mtg[j]);
+            s.generate(5, pm.size(), &pm[0]);
+            for (unsigned int j = 0; j < mtg.size(); ++j)
+            {
+                  tachy::random_engine<real_t, tachy::normal_distribution<real_t> > z(dt, n, 20170301, 5 + j, tachy::normal_distribution<real_t>(0.0, 1.0));
+                  real_t r = 2.0;
+                  for (unsigned int t = 0; t < n; ++t)
+                  {
+                        TS_ASSERT_DELTA(r, mtg[j][t], 1e-12);
+                        r += sigma*std::sqrt(1.0/12.0)*z[t];
+                  }
+            }
+      }
+
+      void test_hull_white_moments()
+      {
+            TS_TRACE("test_hull_white_moments");
+
+            // paths do not depend on the range they are generated in, and their distribution
+            // at the horizon is normal with the exact mean and variance
+            const tachy::tachy_date dt(201703);
+            const unsigned int n = 121;
+            const unsigned int num_paths = 4096;
+            const real_t a = 0.2, theta = 5.0, sigma = 1.2, r0 = 2.0;
+            tachy::short_rate_scenarios<real_t, hull_white_t, tachy::sobol_shocks<real_t> > s(hull_white_t(r0, a, theta, sigma),
+                                                                                             tachy::mortgage_rate_model<real_t>(0.0, 1.0, 1.0, -100.0),
+                                                                                             tachy::sobol_shocks<real_t>(n, 42));
+            std::vector<vec_t> mtg(num_paths, vec_t("mtg", dt, n));
+            std::vector<vec_t*> pm;
+            for (unsigned int j = 0; j < mtg.size(); ++j)
+                  pm.push_back(&mtg[j]);
+            s.generate(0, num_paths, &pm[0]);
+
+            vec_t x("x", dt, n);
+            vec_t* px = &x;
+            real_t m = 0.0, m2 = 0.0;
+            for (unsigned int j = 0; j < num_paths; ++j)
+            {
+                  if (0 == j%97)
+                  {
+                        s.generate(j, 1, &px);
+                        for (unsigned int t = 0; t < n; ++t)
+                              TS_ASSERT_EQUALS(mtg[j][t], x[t]);
+                  }
+                  m += mtg[j][n-1];
+                  m2 += mtg[j][n-1]*mtg[j][n-1];
+            }
+            m /= num_paths;
+            const real_t h = 10.0; // years
+            TS_ASSERT_DELTA(theta + (r0 - theta)*std::exp(-a*h), m, 1e-2);
+            TS_ASSERT_DELTA(sigma*sigma*(1.0 - std::exp(-2.0*a*h))/(2.0*a), m2/num_paths - m*m, 2e-2);
+      }
+};
+
 class tachy_lagged_engine_test : public CxxTest::TestSuite
 {
 private:
@@ -874,6 +1398,76 @@ public:
             TS_TRACE("test_set_history");
       }
 
+      void test_packed_boundary()
+      {
+            TS_TRACE("test_packed_boundary");
+
+            vector_t v0("v0", tachy::tachy_date(date), src);
+            vector_t r("r", tachy::tachy_date(date), src.size());
+            tachy::time_shift t;
+
+            // lags shorter and longer than a pack: the first packs straddle the start of v0
+            for (int dt = 1; dt < 11; dt += 3)
+            {
+                  r = 0.5*v0[t-dt] + v0;
+                  for (int i = 0; i < r.size(); ++i)
+                  {
+                        const real_t expected = 0.5*src[std::max(0, i-dt)] + src[i];
+                        TS_ASSERT_DELTA(expected, r[i], 2.0*std::abs(expected)*std::numeric_limits<real_t>::epsilon());
+                  }
+            }
+
+            // nested lags: the checked reads reach as far as their sum, the packs past it are unchecked
+            for (int dt = 1; dt < 11; dt += 3)
+            {
+                  tachy::lead_probe<real_t> probe;
+                  (v0 + v0[t-dt])[t-2].depends_on(probe);
+                  TS_ASSERT_EQUALS(dt + 2, probe.prologue());
+
+                  r = (v0 + v0[t-dt])[t-2];
+                  for (int i = 0; i < r.size(); ++i)
+                  {
+                        const int j = std::max(0, i-2);
+                        const real_t expected = src[j] + src[std::max(0, j-dt)];
+                        TS_ASSERT_DELTA(expected, r[i], 2.0*std::abs(expected)*std::numeric_limits<real_t>::epsilon());
+                  }
+            }
+      }
+
+      template <class Engine>
+      static bool has_lags(const tachy::calc_vector<real_t, Engine, 0U>&)
+      {
+            return tachy::has_lagged_operand<Engine>::result;
+      }
+
+      void test_alias_analysis()
+      {
+            TS_TRACE("test_alias_analysis");
+
+            vector_t x("x", tachy::tachy_date(date), src);
+            vector_t y("y", tachy::tachy_date(date), src);
+            tachy::time_shift t;
+
+            TS_ASSERT(not has_lags(x + 2.0*y));
+            TS_ASSERT(not has_lags(tachy::exp(x)*y));
+            TS_ASSERT(has_lags(x[t-1]));
+            TS_ASSERT(has_lags(2.0*tachy::exp(x + y[t-2])));
+
+            // only lagged reads of the target itself make the assignment recursive
+            typedef tachy::lagged_alias_probe<engine_t> probe_t;
+            TS_ASSERT(not (x + 2.0*y[t-1]).depends_on(probe_t(x.engine())));
+            TS_ASSERT(not (x + 2.0*x[t+1]).depends_on(probe_t(x.engine())));
+            TS_ASSERT((y + 2.0*x[t-1]).depends_on(probe_t(x.engine())));
+
+            x = 0.5*x[t-1] + y[t-1];
+            real_t expected = src[0];
+            for (int i = 0; i < x.size(); ++i)
+            {
+                  expected = 0.5*expected + src[std::max(0, i-1)];
+                  TS_ASSERT_DELTA(expected, x[i], 2.0*std::abs(expected)*std::numeric_limits<real_t>::epsilon());
+            }
+      }
+
       void test_assign_guard()
       {
             vector_t v0("v0", tachy::tachy_date(date), src);
@@ -1053,6 +1647,128 @@ public:
             TS_ASSERT_EQUALS(3, num_cached);
       }
 
+      void test_cache_invalidation()
+      {
+            TS_TRACE("test_cache_invalidation");
+
+            const real_t delta = 5.0*std::numeric_limits<real_t>::epsilon();
+            cache_t cache("c0");
+            std::string a_id, b_id;
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), src[1], cache, true);
+                  cached_vector_t v("v", tachy::tachy_date(date), src[2], cache, true);
+            }
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), cache);
+                  cached_vector_t v("v", tachy::tachy_date(date), cache);
+                  cached_vector_t a = exp(u)*v;
+                  cached_vector_t b = 2.0*v + 1.0;
+                  a_id = a.get_id();
+                  b_id = b.get_id();
+            }
+            TS_ASSERT(cache.has_key(a_id));
+            TS_ASSERT(cache.has_key(b_id));
+
+            // only u and what is computed from it go
+            TS_ASSERT_EQUALS(2u, cache.invalidate("u"));
+            TS_ASSERT(not cache.has_key("u"));
+            TS_ASSERT(not cache.has_key(a_id));
+            TS_ASSERT(cache.has_key("v"));
+            TS_ASSERT(cache.has_key(b_id));
+            TS_ASSERT_EQUALS(0u, cache.invalidate("u"));
+
+            // and are recomputed from the new u
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), src[3], cache, true);
+            }
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), cache);
+                  cached_vector_t v("v", tachy::tachy_date(date), cache);
+                  cached_vector_t a = exp(u)*v;
+                  TS_ASSERT_EQUALS(a_id, a.get_id());
+                  for (int i = 0; i < a.size(); ++i)
+                        TS_ASSERT_DELTA(std::exp(src[3][i])*src[2][i], a[i], std::max(1.0, std::abs(a[i]))*delta);
+            }
+            TS_ASSERT(cache.has_key(a_id));
+
+            TS_ASSERT_EQUALS(3u, cache.invalidate("v"));
+            TS_ASSERT(cache.has_key("u"));
+      }
+
+      void test_cache_invalidation_mixed_levels()
+      {
+            TS_TRACE("test_cache_invalidation_mixed_levels");
+
+            typedef tachy::calc_cache<real_t, 2U> cache2_t;
+            typedef tachy::calc_vector<real_t, engine_t, cache2_t::cache_level> cached2_vector_t;
+
+            const real_t delta = 5.0*std::numeric_limits<real_t>::epsilon();
+            cache_t cache1("c1");
+            std::string p_id;
+            {
+                  cache2_t cache2("c2");
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), src[1], cache2, true);
+                        cached_vector_t v("v", tachy::tachy_date(date), src[2], cache1, true);
+                  }
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), cache2);
+                        cached_vector_t v("v", tachy::tachy_date(date), cache1);
+                        cached_vector_t p = u*v; // cached at Level 1
+                        p_id = p.get_id();
+                  }
+                  TS_ASSERT(cache1.has_key(p_id));
+
+                  // invalidating the Level 2 input reaches the Level 1 node
+                  TS_ASSERT_EQUALS(2u, cache2.invalidate("u"));
+                  TS_ASSERT(not cache1.has_key(p_id));
+                  TS_ASSERT(cache1.has_key("v"));
+
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), src[3], cache2, true);
+                  }
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), cache2);
+                        cached_vector_t v("v", tachy::tachy_date(date), cache1);
+                        cached_vector_t p = u*v;
+                        TS_ASSERT_EQUALS(p_id, p.get_id());
+                        for (int i = 0; i < p.size(); ++i)
+                              TS_ASSERT_DELTA(src[3][i]*src[2][i], p[i], std::max(1.0, std::abs(p[i]))*delta);
+                  }
+                  TS_ASSERT(cache1.has_key(p_id));
+
+                  // clearing the Level 1 cache drops the edges into it, and they are recorded again on reuse
+                  cache1.clear();
+                  TS_ASSERT_EQUALS(1u, cache2.invalidate("u"));
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), src[1], cache2, true);
+                        cached_vector_t v("v", tachy::tachy_date(date), src[2], cache1, true);
+                  }
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), cache2);
+                        cached_vector_t v("v", tachy::tachy_date(date), cache1);
+                        cached_vector_t p = u*v;
+                        TS_ASSERT_EQUALS(p_id, p.get_id());
+                  }
+                  TS_ASSERT_EQUALS(2u, cache2.invalidate("u"));
+                  TS_ASSERT(not cache1.has_key(p_id));
+
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), src[1], cache2, true);
+                  }
+                  {
+                        cached2_vector_t u("u", tachy::tachy_date(date), cache2);
+                        cached_vector_t v("v", tachy::tachy_date(date), cache1);
+                        cached_vector_t p = u*v;
+                  }
+                  TS_ASSERT(cache1.has_key(p_id));
+            }
+
+            // the Level 2 cache is gone along with its edges
+            TS_ASSERT_EQUALS(2u, cache1.invalidate("v"));
+            TS_ASSERT(not cache1.has_key(p_id));
+      }
+
       void test_static_functors()
       {
             TS_TRACE("test_static_functors");
@@ -1078,22 +1794,55 @@ public:
                   TS_ASSERT_EQUALS(std::abs(src[1][i]), r[i]);
       }
 
-      void test_static_posneg_functors()
+      void test_cached_static_functors()
       {
-            TS_TRACE("test_static_posneg_functors");
+            TS_TRACE("test_cached_static_functors");
 
-            vector_t x("x", tachy::tachy_date(date), src[1]);
+            cache_t cache("c0");
+            cached_vector_t u("u", tachy::tachy_date(date), src[1], cache, false);
+            vector_t x("x", tachy::tachy_date(date), src[2]);
             vector_t r("r", tachy::tachy_date(date), src[0]);
 
-            r = exp(max(0.0, x));
+            const real_t delta = 5.0*std::numeric_limits<real_t>::epsilon();
 
-            for (int i = 0; i < r.size(); ++i)
-                  TS_ASSERT_EQUALS(std::exp(std::max(0.0, src[1][i])), r[i]);
-      }
+            // the functor results are materialized in the cache before adding x
+            for (int k = 0; k < 2; ++k)
+            {
+                  r = exp(u) + x;
+                  for (int i = 0; i < r.size(); ++i)
+                        TS_ASSERT_DELTA(std::exp(src[1][i]) + src[2][i], r[i], std::max(1.0, std::abs(r[i]))*delta);
 
-      void test_size_queries()
-      {
-            TS_TRACE("test_size_queries");
+                  r = log(1.5 + 0.5*u) - x;
+                  for (int i = 0; i < r.size(); ++i)
+                        TS_ASSERT_DELTA(std::log(1.5 + 0.5*src[1][i]) - src[2][i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+                  r = abs(u)*x;
+                  for (int i = 0; i < r.size(); ++i)
+                        TS_ASSERT_DELTA(std::abs(src[1][i])*src[2][i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+            }
+
+            cached_vector_t y = exp(u);
+            TS_ASSERT_EQUALS(src[1].size(), y.size());
+            for (int i = 0; i < y.size(); ++i)
+                  TS_ASSERT_DELTA(std::exp(src[1][i]), y[i], std::max(1.0, std::abs(y[i]))*delta);
+      }
+
+      void test_static_posneg_functors()
+      {
+            TS_TRACE("test_static_posneg_functors");
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t r("r", tachy::tachy_date(date), src[0]);
+
+            r = exp(max(0.0, x));
+
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_EQUALS(std::exp(std::max(0.0, src[1][i])), r[i]);
+      }
+
+      void test_size_queries()
+      {
+            TS_TRACE("test_size_queries");
       }
 
       void test_shifted_ops()
@@ -1118,6 +1867,570 @@ public:
             for (int i = 0; i < u.size(); ++i)
                   TS_ASSERT_DELTA(x[i+shift] + y[i], u[i], delta);
       }
+
+      void test_shifted_assignment()
+      {
+            TS_TRACE("test_shifted_assignment");
+
+            const int stride = tachy::arch_traits<real_t, tachy::ACTIVE_ARCH_TYPE>::stride;
+
+            // sources starting before and after the target, in and out of phase with the stride
+            for (int shift = -2*stride; shift <= 2*stride; ++shift)
+            {
+                  vector_t x("x", tachy::tachy_date(date), src[1]);
+                  vector_t y("y", tachy::tachy_date(date) + shift, src[2]);
+
+                  x = 2.0*y;
+                  const int i_tgt = std::max(0, shift);
+                  const int i_src = std::max(0, -shift);
+                  const int n_elems = std::min<int>(src[2].size() - i_src, x.size() - i_tgt);
+                  for (int i = 0; i < i_tgt; ++i)
+                        TS_ASSERT_EQUALS(src[1][i], x[i]);
+                  for (int i = 0; i < n_elems; ++i)
+                        TS_ASSERT_EQUALS(2.0*src[2][i_src + i], x[i_tgt + i]);
+                  for (int i = i_tgt + n_elems; i < x.size(); ++i)
+                        TS_ASSERT_EQUALS(2.0*src[2][i_src + n_elems - 1], x[i]);
+            }
+      }
+
+      void test_aligned_ops()
+      {
+            TS_TRACE("test_aligned_ops");
+
+            typedef tachy::packed_alignment<real_t> align_t;
+            const int stride = align_t::arch_traits_t::stride;
+            const real_t delta = 2.0*std::numeric_limits<real_t>::epsilon();
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            tachy::time_shift t;
+
+            TS_ASSERT_EQUALS(0, (x + 2.0*x).get_alignment());
+            TS_ASSERT_EQUALS(int(align_t::any), tachy::scalar<real_t>(2.0).get_alignment());
+
+            // operands shifted by dates or lags, in and out of phase with the stride
+            for (int shift = 1; shift <= 2*stride; ++shift)
+            {
+                  vector_t y("y", tachy::tachy_date(date) + shift, src[2]);
+                  const int phase = shift%stride;
+
+                  TS_ASSERT_EQUALS(phase ? int(align_t::mixed) : 0, (x + y).get_alignment());
+                  TS_ASSERT_EQUALS((stride - phase)%stride, (2.0*x[t-shift]).get_alignment());
+
+                  vector_t u = x + y;
+                  for (int i = 0; i < u.size(); ++i)
+                        TS_ASSERT_DELTA(src[1][i+shift] + src[2][i], u[i], std::max(1.0, std::abs(u[i]))*delta);
+
+                  vector_t r("r", tachy::tachy_date(date), src[0]);
+                  r = x[t-shift]*x[t-stride] - x;
+                  for (int i = 0; i < r.size(); ++i)
+                  {
+                        const real_t expected = src[1][std::max(0, i-shift)]*src[1][std::max(0, i-stride)] - src[1][i];
+                        TS_ASSERT_DELTA(expected, r[i], std::max(1.0, std::abs(expected))*delta);
+                  }
+            }
+      }
+
+      void test_mixed_start_dates()
+      {
+            TS_TRACE("test_mixed_start_dates");
+
+            const real_t delta = 2.0*std::numeric_limits<real_t>::epsilon();
+            tachy::time_shift t;
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date), src[2]);
+            vector_t z("z", tachy::tachy_date(date) + 3, src[3]);
+
+            vector_t r("r", tachy::tachy_date(date), src[0]);
+            r = x*y - 2.0*x[t-1];
+            for (int i = 0; i < r.size(); ++i)
+            {
+                  const real_t expected = src[1][i]*src[2][i] - 2.0*src[1][std::max(0, i-1)];
+                  TS_ASSERT_DELTA(expected, r[i], std::max(1.0, std::abs(expected))*delta);
+            }
+
+            vector_t u = x*(tachy::max(0.0, y - z) + 1.0);
+            TS_ASSERT_EQUALS(z.get_start_date(), u.get_start_date());
+            for (int i = 0; i < u.size(); ++i)
+            {
+                  const real_t expected = src[1][i+3]*(std::max(0.0, src[2][i+3] - src[3][i]) + 1.0);
+                  TS_ASSERT_DELTA(expected, u[i], std::max(1.0, std::abs(expected))*delta);
+            }
+
+            // the lazily cached operations align operands of different start dates as well
+            cache_t cache("the_cache");
+            cached_vector_t cx("cx", tachy::tachy_date(date), src[1], cache, true);
+            cached_vector_t cy("cy", tachy::tachy_date(date), src[2], cache, true);
+            cached_vector_t cz("cz", tachy::tachy_date(date) + 3, src[3], cache, true);
+            vector_t v = (cx + cy) - cz;
+            for (int i = 0; i < v.size(); ++i)
+            {
+                  const real_t expected = src[1][i+3] + src[2][i+3] - src[3][i];
+                  TS_ASSERT_DELTA(expected, v[i], std::max(1.0, std::abs(expected))*delta);
+            }
+      }
+
+      void test_compound_assignment()
+      {
+            TS_TRACE("test_compound_assignment");
+
+            const int stride = tachy::arch_traits<real_t, tachy::ACTIVE_ARCH_TYPE>::stride;
+            const real_t delta = 2.0*std::numeric_limits<real_t>::epsilon();
+            tachy::time_shift t;
+
+            // sources starting before and after the target, ending before it: only the common dates change
+            std::vector<real_t> short_src(src[2].begin(), src[2].begin() + 37);
+            for (int shift = -2*stride; shift <= 2*stride; ++shift)
+            {
+                  vector_t x("x", tachy::tachy_date(date), src[1]);
+                  vector_t y("y", tachy::tachy_date(date) + shift, short_src);
+                  vector_t z("z", tachy::tachy_date(date) + shift, src[3]);
+
+                  x += y;
+                  x *= 2.0*z - 1.0;
+                  const int i_tgt = std::max(0, shift);
+                  const int i_src = std::max(0, -shift);
+                  for (int i = 0; i < x.size(); ++i)
+                  {
+                        const int j = i - i_tgt + i_src;
+                        real_t expected = src[1][i];
+                        if (i_tgt <= i && j < short_src.size())
+                              expected += short_src[j];
+                        if (i_tgt <= i && j < src[3].size())
+                              expected *= 2.0*src[3][j] - 1.0;
+                        TS_ASSERT_DELTA(expected, x[i], std::max(1.0, std::abs(expected))*delta);
+                  }
+            }
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date), src[2]);
+            x -= y;
+            x /= y;
+            x += 1.0;
+            x /= 2.0;
+            for (int i = 0; i < x.size(); ++i)
+            {
+                  const real_t expected = ((src[1][i] - src[2][i])/src[2][i] + 1.0)/2.0;
+                  TS_ASSERT_DELTA(expected, x[i], std::max(1.0, std::abs(expected))*delta);
+            }
+
+            // the destination in the expression: unshifted reads see the old values, lags the new ones
+            vector_t s("s", tachy::tachy_date(date), src[1]);
+            s *= s + y;
+            s += s[t-1];
+            real_t sum = src[1][0]*(src[1][0] + src[2][0]); // the lag is checked: s[0] is added to itself
+            for (int i = 0; i < s.size(); ++i)
+            {
+                  sum += src[1][i]*(src[1][i] + src[2][i]);
+                  TS_ASSERT_DELTA(sum, s[i], std::max(1.0, std::abs(sum))*4.0*(i+1)*delta);
+            }
+
+            // cached vectors are not to be changed, the others are updated in place
+            cache_t cache("the_cache");
+            cached_vector_t cx("cx", tachy::tachy_date(date), src[1], cache, true);
+            cached_vector_t cy("cy", tachy::tachy_date(date), src[2], cache, false);
+            {
+                  cached_vector_t cw("cw", tachy::tachy_date(date), src[3], cache, true);
+            }
+            cached_vector_t cw("cw", tachy::tachy_date(date), cache); // proxy to the cached one
+            TS_ASSERT_THROWS(cw += cx, tachy::exception);
+            TS_ASSERT_THROWS(cw *= 2.0, tachy::exception);
+            cy -= cx*cy;
+            cy *= 3.0;
+            for (int i = 0; i < cy.size(); ++i)
+            {
+                  const real_t expected = 3.0*(src[2][i] - src[1][i]*src[2][i]);
+                  TS_ASSERT_DELTA(expected, cy[i], std::max(1.0, std::abs(expected))*delta);
+            }
+      }
+
+      void test_scalar_folding()
+      {
+            TS_TRACE("test_scalar_folding");
+
+            const real_t delta = 4.0*std::numeric_limits<real_t>::epsilon();
+            tachy::time_shift t;
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t r("r", tachy::tachy_date(date), src[0]);
+
+            // chains of scalar operations are a single node
+            typedef decltype(6.0*x) folded_times_t;
+            typedef decltype(-1.0 + x) folded_plus_t;
+            TS_ASSERT((std::is_same<folded_times_t, decltype(2.0*(3.0*x))>::value));
+            TS_ASSERT((std::is_same<folded_times_t, decltype((x*2.0)*3.0)>::value));
+            TS_ASSERT((std::is_same<folded_times_t, decltype(x/0.5*3.0)>::value));
+            TS_ASSERT((std::is_same<folded_plus_t, decltype((1.0 + x) - 2.0)>::value));
+            TS_ASSERT((std::is_same<folded_plus_t, decltype(1.0 + (x + 2.0) - 0.5)>::value));
+
+            r = x/0.5*3.0;
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(6.0*src[1][i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+            r = 1.0 + (x + 2.0) - 0.5;
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(src[1][i] + 2.5, r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+            // lags of the target keep the assignment guarded
+            r = x;
+            r = 0.5*(r[t-1]*2.0) + 1.0;
+            for (int i = 1; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(r[i-1] + 1.0, r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+            // the folded nodes are cached under the same key as the single operation
+            cache_t cache("the_cache");
+            cached_vector_t cx("cx", tachy::tachy_date(date), src[1], cache, true);
+            TS_ASSERT_EQUALS((6.0*cx).get_id(), (2.0*(cx*3.0)).get_id());
+            TS_ASSERT_EQUALS((2.0 + cx).get_id(), (cx - 1.0 + 3.0).get_id());
+            vector_t v = 2.0*(cx*3.0) - 1.0;
+            for (int i = 0; i < v.size(); ++i)
+                  TS_ASSERT_DELTA(6.0*src[1][i] - 1.0, v[i], std::max(1.0, std::abs(v[i]))*delta);
+      }
+
+      void test_fma_fusion()
+      {
+            TS_TRACE("test_fma_fusion");
+
+            const real_t delta = 4.0*std::numeric_limits<real_t>::epsilon();
+            tachy::time_shift t;
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date), src[2]);
+            vector_t z("z", tachy::tachy_date(date) + 3, src[3]);
+            vector_t r("r", tachy::tachy_date(date), src[0]);
+
+            // products added or subtracted are a single fused node
+            typedef tachy::fma_engine<real_t, engine_t, engine_t, engine_t, tachy::OpMulAdd<real_t>, 0> fma_engine_t;
+            typedef tachy::fma_engine<real_t, engine_t, engine_t, engine_t, tachy::OpMulSub<real_t>, 0> fms_engine_t;
+            TS_ASSERT((std::is_same<tachy::calc_vector<real_t, fma_engine_t, 0>, decltype(x*y + z)>::value));
+            TS_ASSERT((std::is_same<tachy::calc_vector<real_t, fma_engine_t, 0>, decltype(z + x*y)>::value));
+            TS_ASSERT((std::is_same<tachy::calc_vector<real_t, fms_engine_t, 0>, decltype(x*y - z)>::value));
+            TS_ASSERT((std::is_same<decltype(1.0 + 0.2*x), decltype(0.2*x - 1.0)>::value));
+
+            // operands of different start dates are aligned as in the separate operations
+            vector_t u = x*y + z;
+            TS_ASSERT_EQUALS(z.get_start_date(), u.get_start_date());
+            TS_ASSERT_EQUALS(src[3].size() - 3, u.size());
+            for (int i = 0; i < u.size(); ++i)
+                  TS_ASSERT_DELTA(src[1][i+3]*src[2][i+3] + src[3][i], u[i], std::max(1.0, std::abs(u[i]))*delta);
+            u = x*y - z*x;
+            for (int i = 0; i < u.size(); ++i)
+                  TS_ASSERT_DELTA(src[1][i+3]*src[2][i+3] - src[3][i]*src[1][i+3], u[i], std::max(1.0, std::abs(u[i]))*delta);
+            r = 0.2*x - 1.0;
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(0.2*src[1][i] - 1.0, r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+            // lags of the target keep the assignment guarded
+            r = x;
+            r = r[t-1]*y + x;
+            for (int i = 1; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(r[i-1]*src[2][i] + src[1][i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+            // the fused nodes are cached under the key of the separate operations, prefixed
+            cache_t cache("the_cache");
+            cached_vector_t cx("cx", tachy::tachy_date(date), src[1], cache, true);
+            cached_vector_t cy("cy", tachy::tachy_date(date), src[2], cache, true);
+            cached_vector_t cz("cz", tachy::tachy_date(date), src[3], cache, true);
+            TS_ASSERT_EQUALS((cx*cy + cz).get_id(), cache.get_hash_key(std::string("FMA_") + cache.get_hash_key(std::string("cx*cy")) + "+cz"));
+            TS_ASSERT_DIFFERS((cx*cy + cz).get_id(), cache.get_hash_key(cache.get_hash_key(std::string("cx*cy")) + "+cz"));
+            vector_t v = cz - cx*cy + 1.0;
+            vector_t w = cx*cy - cz;
+            for (int i = 0; i < v.size(); ++i)
+            {
+                  TS_ASSERT_DELTA(src[3][i] - src[1][i]*src[2][i] + 1.0, v[i], std::max(1.0, std::abs(v[i]))*delta);
+                  TS_ASSERT_DELTA(src[1][i]*src[2][i] - src[3][i], w[i], std::max(1.0, std::abs(w[i]))*delta);
+            }
+      }
+
+      void test_common_subexpressions()
+      {
+            TS_TRACE("test_common_subexpressions");
+
+            const real_t delta = 8.0*std::numeric_limits<real_t>::epsilon();
+            tachy::time_shift t;
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date), src[2]);
+            vector_t z("z", tachy::tachy_date(date) + 3, src[3]);
+            vector_t r("r", tachy::tachy_date(date), src[0]);
+            vector_t e = tachy::exp(1.0 - 0.5*x);
+
+            // only the repeats of the same function of the same operands are shared
+            typedef tachy::common_subexpressions<real_t> cse_t;
+            TS_ASSERT_EQUALS(1u, cse_t(tachy::exp(1.0 - 0.5*x)*y + tachy::exp(1.0 - 0.5*x)).num_shared());
+            TS_ASSERT_EQUALS(1u, cse_t(tachy::exp(x[t-1])*tachy::exp(x[t-1])).num_shared());
+            TS_ASSERT_EQUALS(0u, cse_t(tachy::exp(1.0 - 0.5*x)*y + tachy::exp(1.0 - 0.5*y)).num_shared());
+            TS_ASSERT_EQUALS(0u, cse_t(tachy::exp(1.0 - 0.5*x)*y + tachy::exp(1.0 - 0.25*x)).num_shared());
+            TS_ASSERT_EQUALS(0u, cse_t(tachy::exp(x[t-1])*tachy::exp(x[t-2])).num_shared());
+            TS_ASSERT_EQUALS(0u, cse_t(tachy::exp(x)*tachy::log(x)).num_shared());
+
+            r = tachy::exp(1.0 - 0.5*x)*y + tachy::exp(1.0 - 0.5*x);
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(e[i]*src[2][i] + e[i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+            r += tachy::exp(1.0 - 0.5*x)*tachy::exp(1.0 - 0.5*x);
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(e[i]*src[2][i] + e[i] + e[i]*e[i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+            // the shared node is read at the dates of either use
+            vector_t u = tachy::exp(1.0 - 0.5*x)*z + tachy::exp(1.0 - 0.5*x);
+            TS_ASSERT_EQUALS(src[3].size() - 3, u.size());
+            for (int i = 0; i < u.size(); ++i)
+                  TS_ASSERT_DELTA(e[i+3]*src[3][i] + e[i+3], u[i], std::max(1.0, std::abs(u[i]))*delta);
+
+            // lags of the target keep the assignment guarded
+            r = x;
+            r = 0.5*tachy::exp(-r[t-1]) + 0.5*tachy::exp(-r[t-1]);
+            for (int i = 1; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(std::exp(-r[i-1]), r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+            // the nodes of an expression are only shared for the statement it is evaluated in
+            auto a = tachy::exp(x);
+            auto b = tachy::exp(x);
+            r = a*b;
+            r = a + y;
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(std::exp(src[1][i]) + src[2][i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+      }
+
+      void test_vector_tie()
+      {
+            TS_TRACE("test_vector_tie");
+
+            const real_t delta = 8.0*std::numeric_limits<real_t>::epsilon();
+            tachy::time_shift t;
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date), src[2]);
+            vector_t z("z", tachy::tachy_date(date) + 3, src[3]);
+            vector_t a("a", tachy::tachy_date(date), src[0]);
+            vector_t b("b", tachy::tachy_date(date), src[0]);
+            vector_t c("c", tachy::tachy_date(date), src[0]);
+
+            tachy::tie(a, b, c) = std::make_tuple(x*y - 0.5, x + y, 2.0*tachy::exp(x));
+            for (int i = 0; i < a.size(); ++i)
+            {
+                  TS_ASSERT_DELTA(src[1][i]*src[2][i] - 0.5, a[i], std::max(1.0, std::abs(a[i]))*delta);
+                  TS_ASSERT_DELTA(src[1][i] + src[2][i], b[i], std::max(1.0, std::abs(b[i]))*delta);
+                  TS_ASSERT_DELTA(2.0*std::exp(src[1][i]), c[i], std::max(1.0, std::abs(c[i]))*delta);
+            }
+
+            // expressions starting later keep the history of the outputs, as the single assignments do
+            a = x;
+            b = y;
+            tachy::tie(a, b) = std::make_tuple(x*z, z + y);
+            for (int i = 0; i < a.size(); ++i)
+            {
+                  TS_ASSERT_DELTA(i < 3 ? src[1][i] : src[1][i]*src[3][i-3], a[i], std::max(1.0, std::abs(a[i]))*delta);
+                  TS_ASSERT_DELTA(i < 3 ? src[2][i] : src[3][i-3] + src[2][i], b[i], std::max(1.0, std::abs(b[i]))*delta);
+            }
+
+            // outputs read by the expressions are assigned one after the other
+            tachy::tie(a, b) = std::make_tuple(x + 1.0, a[t-1] + a);
+            for (int i = 1; i < b.size(); ++i)
+                  TS_ASSERT_DELTA(src[1][i-1] + src[1][i] + 2.0, b[i], std::max(1.0, std::abs(b[i]))*delta);
+            tachy::tie(a, a) = std::make_tuple(x, y);
+            for (int i = 0; i < a.size(); ++i)
+                  TS_ASSERT_EQUALS(src[2][i], a[i]);
+      }
+
+      void test_tiled_assignment()
+      {
+            TS_TRACE("test_tiled_assignment");
+
+            const real_t delta = 8.0*std::numeric_limits<real_t>::epsilon();
+            tachy::time_shift t;
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date), src[2]);
+            vector_t a("a", tachy::tachy_date(date), src[0]);
+            vector_t b("b", tachy::tachy_date(date), src[3]);
+            vector_t c("c", tachy::tachy_date(date) + 5, src[4]);
+            vector_t ra(a), rb(b), rc(c);
+
+            // tiles give the results of the statements one after the other
+            ra = x*y + 1.0;
+            rb = 0.5*rb[t-1] + ra;
+            rc = ra[t-2] - 2.0*rb + rc;
+            for (unsigned int tile = 1; tile <= 64; tile *= 4)
+            {
+                  vector_t ta(a), tb(b), tc(c);
+                  tachy::tie(ta, tb, tc).tiled(tile) = std::make_tuple(x*y + 1.0, 0.5*tb[t-1] + ta, ta[t-2] - 2.0*tb + tc);
+                  for (int i = 0; i < ta.size(); ++i)
+                  {
+                        TS_ASSERT_DELTA(ra[i], ta[i], std::max(1.0, std::abs(ra[i]))*delta);
+                        TS_ASSERT_DELTA(rb[i], tb[i], std::max(1.0, std::abs(rb[i]))*delta);
+                  }
+                  for (int i = 0; i < tc.size(); ++i)
+                        TS_ASSERT_DELTA(rc[i], tc[i], std::max(1.0, std::abs(rc[i]))*delta);
+            }
+
+            // reads of the earlier outputs ahead of the date, or of the later ones behind it, are not tiled
+            ra = a;
+            rb = b;
+            ra = x + rb[t-1];
+            rb = ra[t+1]*y;
+            vector_t ta(a), tb(b);
+            tachy::tie(ta, tb).tiled(16) = std::make_tuple(x + tb[t-1], ta[t+1]*y);
+            for (int i = 0; i < ta.size(); ++i)
+            {
+                  TS_ASSERT_DELTA(ra[i], ta[i], std::max(1.0, std::abs(ra[i]))*delta);
+                  TS_ASSERT_DELTA(rb[i], tb[i], std::max(1.0, std::abs(rb[i]))*delta);
+            }
+
+            // an earlier output read through a node computed as the expressions are built would be stale,
+            // a later one is read as it is before its own statement, as when written one after the other
+            TS_ASSERT_THROWS(tachy::tie(ta, tb).tiled(16) = std::make_tuple(x*y, tachy::rolling_sum(ta, 3)), tachy::exception);
+            TS_ASSERT_THROWS(tachy::tie(ta, tb) = std::make_tuple(x*y, y + tachy::rolling_max(ta[t-1], 2)), tachy::exception);
+            rb = tb;
+            ra = x*y + tachy::rolling_sum(rb, 3);
+            rb = ra*y;
+            tachy::tie(ta, tb).tiled(16) = std::make_tuple(x*y + tachy::rolling_sum(tb, 3), ta*y);
+            for (int i = 0; i < ta.size(); ++i)
+            {
+                  TS_ASSERT_DELTA(ra[i], ta[i], std::max(1.0, std::abs(ra[i]))*delta);
+                  TS_ASSERT_DELTA(rb[i], tb[i], std::max(1.0, std::abs(rb[i]))*delta);
+            }
+      }
+
+      void test_suffix_assignment()
+      {
+            TS_TRACE("test_suffix_assignment");
+
+            const real_t delta = 8.0*std::numeric_limits<real_t>::epsilon();
+            const int k = 123;
+            tachy::time_shift t;
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date), src[2]);
+            vector_t r("r", tachy::tachy_date(date), src[0]);
+            vector_t s("s", tachy::tachy_date(date), src[0]);
+            r[0] = 0.0;
+            r = 0.5*r[t-1] + x*y;
+            s = r[t+2] - y;
+
+            // x changes from k on: r from k on, s two months earlier through the lead
+            for (int i = k; i < x.size(); ++i)
+                  x[i] = src[3][i];
+            for (int i = 0; i < k - 2; ++i)
+                  s[i] = -1.0;
+            TS_ASSERT_EQUALS(tachy::tachy_date(date) + k, r.assign_from(tachy::tachy_date(date) + k, 0.5*r[t-1] + x*y));
+            TS_ASSERT_EQUALS(tachy::tachy_date(date) + (k - 2), s.assign_from(tachy::tachy_date(date) + k, r[t+2] - y));
+
+            vector_t u("u", tachy::tachy_date(date), src[0]);
+            vector_t v("v", tachy::tachy_date(date), src[0]);
+            u[0] = 0.0;
+            u = 0.5*u[t-1] + x*y;
+            v = u[t+2] - y;
+            for (int i = 0; i < r.size(); ++i)
+            {
+                  TS_ASSERT_DELTA(u[i], r[i], std::max(1.0, std::abs(u[i]))*delta);
+                  TS_ASSERT_DELTA(i < k - 2 ? -1.0 : v[i], s[i], std::max(1.0, std::abs(v[i]))*delta);
+            }
+
+            // operands of later dates are aligned as in the assignment
+            vector_t z("z", tachy::tachy_date(date) + 3, src[4]);
+            u = r;
+            r.assign_from(tachy::tachy_date(date) + k, z*x);
+            v = z*x;
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(i < k ? u[i] : v[i], r[i], std::max(1.0, std::abs(r[i]))*delta);
+
+            // the leads under the nodes computed as the expression is built count too
+            vector_t w("w", tachy::tachy_date(date), src[0]);
+            w = tachy::rolling_sum(x[t+1], 2);
+            for (int i = k; i < x.size(); ++i)
+                  x[i] = src[5][i];
+            for (int i = 0; i < k - 1; ++i)
+                  w[i] = -1.0;
+            TS_ASSERT_EQUALS(tachy::tachy_date(date) + (k - 1), w.assign_from(tachy::tachy_date(date) + k, tachy::rolling_sum(x[t+1], 2)));
+            v = tachy::rolling_sum(x[t+1], 2);
+            for (int i = 0; i < w.size(); ++i)
+                  TS_ASSERT_DELTA(i < k - 1 ? -1.0 : v[i], w[i], std::max(1.0, std::abs(v[i]))*delta);
+      }
+
+      void test_scenario_scalars()
+      {
+            TS_TRACE("test_scenario_scalars");
+
+            typedef tachy::calc_vector<real_t, tachy::scenario_scalar<real_t>, 0U> shock_t;
+
+            const real_t delta = 8.0*std::numeric_limits<real_t>::epsilon();
+            const real_t shocks[] = { -0.02, -0.01, 0.0, 0.01, 0.02 };
+            const unsigned int n = sizeof(shocks)/sizeof(shocks[0]);
+
+            TS_ASSERT_THROWS(tachy::scenario_scalar<real_t>(std::vector<real_t>()), tachy::exception);
+            shock_t shock("shock", tachy::tachy_date(date), tachy::scenario_scalar<real_t>(std::vector<real_t>(shocks, shocks + n)));
+            TS_ASSERT_THROWS(shock.engine().select(n), tachy::exception);
+            shock.engine().select(3);
+
+            vector_t x("x", tachy::tachy_date(date), src[1]);
+            vector_t y("y", tachy::tachy_date(date) + 3, src[2]);
+            std::vector<vector_t> r(n, vector_t("r", tachy::tachy_date(date), src[0]));
+            vector_t* results[n];
+            for (unsigned int k = 0; k < n; ++k)
+                  results[k] = &r[k];
+
+            // all the scenarios in one pass, aligned on dates as in the assignment - the history is kept
+            tachy::assign_scenarios(results, x*(1.0 + shock) + y, shock);
+            TS_ASSERT_EQUALS(3u, shock.engine().selected());
+            for (unsigned int k = 0; k < n; ++k)
+            {
+                  for (int i = 0; i < r[k].size(); ++i)
+                  {
+                        const real_t v = i < 3 ? src[0][i] : src[1][i]*(1.0 + shocks[k]) + src[2][i-3];
+                        TS_ASSERT_DELTA(v, r[k][i], std::max(1.0, std::abs(v))*delta);
+                  }
+            }
+
+            // the same as selecting each scenario in turn
+            vector_t u("u", tachy::tachy_date(date), src[0]);
+            tachy::assign_scenarios(results, tachy::exp(x*shock), shock);
+            for (unsigned int k = 0; k < n; ++k)
+            {
+                  shock.engine().select(k);
+                  u = tachy::exp(x*shock);
+                  for (int i = 0; i < u.size(); ++i)
+                        TS_ASSERT_DELTA(u[i], r[k][i], std::max(1.0, std::abs(u[i]))*delta);
+            }
+
+            // the function nodes not reading the scenario are evaluated once per pack, the others on every pass
+            tachy::assign_scenarios(results, tachy::exp(tachy::exp(x*0.1))*shock + tachy::exp(x*0.1) + tachy::exp(x*shock)*tachy::exp(x*shock), shock);
+            for (unsigned int k = 0; k < n; ++k)
+            {
+                  shock.engine().select(k);
+                  u = tachy::exp(tachy::exp(x*0.1))*shock + tachy::exp(x*0.1) + tachy::exp(x*shock)*tachy::exp(x*shock);
+                  for (int i = 0; i < u.size(); ++i)
+                        TS_ASSERT_DELTA(u[i], r[k][i], std::max(1.0, std::abs(u[i]))*delta);
+            }
+
+            // an expression reading a result is assigned one scenario after the other
+            shock.engine().select(1);
+            for (unsigned int k = 0; k < n; ++k)
+                  r[k] = x;
+            tachy::assign_scenarios(results, r[0] + shock, shock);
+            TS_ASSERT_EQUALS(1u, shock.engine().selected());
+            for (unsigned int k = 0; k < n; ++k)
+            {
+                  for (int i = 0; i < x.size(); ++i)
+                  {
+                        const real_t v = src[1][i] + shocks[0] + (k == 0 ? 0.0 : shocks[k]);
+                        TS_ASSERT_DELTA(v, r[k][i], std::max(1.0, std::abs(v))*delta);
+                  }
+            }
+
+            // cached operands are computed once for all the scenarios
+            cache_t cache("the_cache");
+            cached_vector_t cx = make_cached_vector(cache, "cx", src[3]);
+            tachy::assign_scenarios(results, tachy::exp(cx)*shock, shock);
+            TS_ASSERT_EQUALS(1, std::distance(cache.begin(), cache.end()));
+            for (unsigned int k = 0; k < n; ++k)
+            {
+                  for (int i = 0; i < r[k].size(); ++i)
+                  {
+                        const real_t v = std::exp(src[3][i])*shocks[k];
+                        TS_ASSERT_DELTA(v, r[k][i], std::max(1.0, std::abs(v))*delta);
+                  }
+            }
+      }
 };
 
 class tachy_gcd_test : public CxxTest::TestSuite
@@ -1472,7 +2785,7 @@ public:
                   y += pts.back().second*std::max<real_t>(0.0, src[i] - pts.back().first);
                   const real_t delta = std::abs(y)*1e-8; //std::numeric_limits<real_t>::epsilon();
                   std::ostringstream msg;
-                  msg << i << ", " << x[i] << ", " << src[i] << ", " << y << ", " << r[i] << ", " << std::abs<real_t>(y - r[i]) << ", " << delta;
+                  msg << i << ", " << x[i] << ", " << src[i] << ", " << y << ", " << r[i] << ", " << std::abs(y - r[i]) << ", " << delta;
                   TSM_ASSERT_DELTA(msg.str().c_str(), y, r[i], delta);
             }
       }
@@ -1519,4 +2832,571 @@ public:
                   TSM_ASSERT(ex.what(), false);
             }
       }
+
+      void test_mod_uniform_index_spline_lazy()
+      {
+            TS_TRACE("test_mod_uniform_index_spline_lazy");
+
+            typedef tachy::linear_spline_uniform_index<real_t, true> td_spline_t;
+
+            const enum tachy::spline_util<real_t>::SPLINE_INIT_TYPE init_types[] = { tachy::spline_util<real_t>::SPLINE_INIT_FROM_INCR_SLOPES,
+                                                                                   tachy::spline_util<real_t>::SPLINE_INIT_FROM_LOCAL_SLOPES };
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                  const bool local = init_types[pass] == tachy::spline_util<real_t>::SPLINE_INIT_FROM_LOCAL_SLOPES;
+                  tachy::linear_spline_uniform_index<real_t, false> s0(local ? "local" : "incr", pts, init_types[pass]);
+
+                  // y = Sum( m_k(t)*s_k * max(0, x - x_k) ), or max(0, min(x_k+1, x) - x_k) for local slopes
+                  struct reference
+                  {
+                        static real_t eval(const xy_vector_t& pts, bool local, const std::vector<real_t>& mod, real_t x)
+                        {
+                              real_t y = 0.0;
+                              for (int k = 0, k_max = pts.size(); k < k_max; ++k)
+                              {
+                                    const real_t x_hi = local and k + 1 < k_max ? std::min(pts[k+1].first, x) : x;
+                                    y += mod[k]*pts[k].second*std::max<real_t>(0.0, x_hi - pts[k].first);
+                              }
+                              return y;
+                        }
+                  };
+
+                  cache_t cache("the_cache");
+
+                  unsigned int n_mod = 360;
+                  std::vector<cached_vector_t> modulation;
+                  modulation.reserve(pts.size());
+                  for (int i = 0, i_max = pts.size(); i < i_max; ++i)
+                  {
+                        std::ostringstream id;
+                        id << "mod " << i + 1;
+                        modulation.push_back(cached_vector_t(id.str(), tachy::tachy_date(date), n_mod, cache, true));
+                        const real_t amp = 0.5 + 0.1*i;
+                        for (int t = 0, t_max = n_mod; t < t_max; ++t)
+                              modulation[i][t] = amp*exp(-real_t(t)/n_mod);
+                  }
+                  std::vector<real_t> mod_t(pts.size(), 0.0);
+
+                  std::string key;
+                  unsigned int n_short = 40;
+                  std::vector<real_t> short_src(src.begin(), src.begin() + n_short);
+                  vector_t x("x", tachy::tachy_date(date), short_src);
+                  vector_t r("r", tachy::tachy_date(date), n_short);
+                  {
+                        tachy::mod_linear_spline_uniform_index<real_t, 2U> s(s0, modulation);
+                        key = s.get_id();
+                        r = s(x);
+                  }
+
+                  for (int t = 0, t_max = n_short; t < t_max; ++t)
+                  {
+                        for (int k = 0, k_max = pts.size(); k < k_max; ++k)
+                              mod_t[k] = modulation[k][t];
+                        const real_t y = reference::eval(pts, local, mod_t, short_src[t]);
+                        TS_ASSERT_DELTA(r[t], y, 1e-8*std::max<real_t>(1.0, std::abs(y)));
+                  }
+
+                  // only the blocks the argument reached are materialized, and the spline is cached as such
+                  TS_ASSERT(cache.has_key(key));
+                  const td_spline_t* cached = dynamic_cast<const td_spline_t*>(cache[key]);
+                  TS_ASSERT(cached != 0);
+                  TS_ASSERT_EQUALS(n_mod, cached->get_mod_size());
+                  TS_ASSERT(cached->get_num_slices() >= n_short);
+                  TS_ASSERT(cached->get_num_slices() < n_mod);
+
+                  // later use of the cached entry fills the block it reaches on demand, from the modulation as it
+                  // was when the spline was built
+                  const unsigned int n_filled = cached->get_num_slices();
+                  for (int k = 0, k_max = pts.size(); k < k_max; ++k)
+                  {
+                        mod_t[k] = modulation[k][n_mod - 1];
+                        modulation[k][n_mod - 1] = 0.0;
+                  }
+                  const real_t y_ref = reference::eval(pts, local, mod_t, src[0]);
+                  const real_t y_last = (*cached)(n_mod - 1, src[0]);
+                  TS_ASSERT_DELTA(y_last, y_ref, 1e-8*std::max<real_t>(1.0, std::abs(y_ref)));
+                  TS_ASSERT_DELTA(y_last, (*cached)(n_mod + 5, src[0]), 1e-12*std::abs(y_last));
+                  TS_ASSERT_EQUALS(n_filled + n_mod%td_spline_t::slice_block, cached->get_num_slices());
+
+                  // copies are always complete
+                  td_spline_t* copy = cached->clone();
+                  TS_ASSERT_EQUALS(n_mod, copy->get_num_slices());
+                  for (int t = 0, t_max = n_mod; t < t_max; ++t)
+                  {
+                        const real_t y = (*cached)(t, src[t]);
+                        TS_ASSERT_DELTA((*copy)(t, src[t]), y, 1e-12*std::max<real_t>(1.0, std::abs(y)));
+                  }
+                  delete copy;
+
+                  // the cached spline goes with any of its modulation vectors
+                  TS_ASSERT_EQUALS(2u, cache.invalidate(modulation[2].get_id()));
+                  TS_ASSERT(not cache.has_key(key));
+            }
+      }
+
+      void test_uniform_index_spline_lagged_args()
+      {
+            TS_TRACE("test_uniform_index_spline_lagged_args");
+
+            typedef tachy::linear_spline_uniform_index<real_t, false> spline_t;
+            spline_t s("test", pts, tachy::spline_util<real_t>::SPLINE_INIT_FROM_INCR_SLOPES);
+
+            vector_t x("x", tachy::tachy_date(date), src);
+            vector_t r("r", tachy::tachy_date(date), tgt);
+            tachy::time_shift t;
+
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                  // the vector changes between statements, its segments must not be reused
+                  if (pass > 0)
+                  {
+                        for (int i = 0; i < x.size(); ++i)
+                              x[i] = 0.9 - 0.7*x[i];
+                  }
+
+                  r = 0.6*s(x) + 0.4*s(x[t+1]) - s(x[t-2]);
+
+                  // leaded past the end is not checked here
+                  for (int i = 0, i_max = r.size() - 1; i < i_max; ++i)
+                  {
+                        const real_t y = 0.6*s(x[i]) + 0.4*s(x[i+1]) - s(x[std::max(0, i-2)]);
+                        TS_ASSERT_DELTA(y, r[i], 1e-12);
+                  }
+            }
+
+            // engines on the same vector within one statement share the segment table, kept by the statement
+            typedef tachy::common_subexpressions<real_t> cse_t;
+            TS_ASSERT_EQUALS(1u, cse_t(0.6*s(x) + 0.4*s(x[t+1]) - s(x[t-2])).num_tables());
+            TS_ASSERT_EQUALS(2u, cse_t(s(x) + s(r)).num_tables());
+            spline_t::segment_table_t segments;
+            s.fill_segment_table(x.engine(), x.size() + 8, segments);
+            TS_ASSERT(segments.size() >= x.size() + 8);
+            for (int i = 0; i < x.size(); ++i)
+            {
+                  const real_t y = s(x[i]);
+                  const real_t y_seg = s.get_intercepts()[segments[i]] + s.get_slopes()[segments[i]]*x[i];
+                  TS_ASSERT_DELTA(y, y_seg, 1e-12);
+            }
+      }
+
+      void test_uniform_index_spline_cached()
+      {
+            TS_TRACE("test_uniform_index_spline_cached");
+
+            tachy::linear_spline_uniform_index<real_t, false> s("test", pts, tachy::spline_util<real_t>::SPLINE_INIT_FROM_INCR_SLOPES);
+
+            cache_t cache("the_cache");
+            cached_vector_t x("x", tachy::tachy_date(date), src, cache, false);
+            vector_t r("r", tachy::tachy_date(date), tgt);
+
+            for (int k = 0; k < 2; ++k) // second time around it comes from the cache
+            {
+                  r = 2.0*s(x);
+                  for (int i = 0; i < r.size(); ++i)
+                  {
+                        real_t y = 0.0;
+                        for (int j = 0; j < pts.size(); ++j)
+                              y += pts[j].second*std::max<real_t>(0.0, src[i] - pts[j].first);
+                        TS_ASSERT_DELTA(2.0*y, r[i], 1e-12);
+                  }
+            }
+
+            // the cached spline node goes with its argument, and is recomputed from the new one
+            std::string y_id;
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), src, cache, true);
+            }
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), cache);
+                  cached_vector_t y = s(u);
+                  y_id = y.get_id();
+            }
+            TS_ASSERT(cache.has_key(y_id));
+            TS_ASSERT_EQUALS(2u, cache.invalidate("u"));
+            TS_ASSERT(not cache.has_key(y_id));
+            std::vector<real_t> w(src.size());
+            for (int i = 0; i < w.size(); ++i)
+                  w[i] = 0.9 - 0.7*src[i];
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), w, cache, true);
+            }
+            {
+                  cached_vector_t u("u", tachy::tachy_date(date), cache);
+                  cached_vector_t y = s(u);
+                  TS_ASSERT_EQUALS(y_id, y.get_id());
+                  for (int i = 0; i < y.size(); ++i)
+                        TS_ASSERT_DELTA(s(w[i]), y[i], 1e-12);
+            }
+      }
+
+      void test_spline_bank()
+      {
+            TS_TRACE("test_spline_bank");
+
+            typedef tachy::linear_spline_uniform_index<real_t, false> spline_t;
+            typedef tachy::linear_spline_bank_uniform_index<real_t> bank_t;
+
+            // per-pool multiples of the same spline, an odd number of them to exercise the padding
+            const unsigned int n_banks = 7;
+            std::vector<spline_t> splines;
+            for (int k = 0; k < n_banks; ++k)
+            {
+                  xy_vector_t nodes(pts);
+                  const real_t m = 0.5 + real_t(random())/RAND_MAX;
+                  for (int j = 0; j < nodes.size(); ++j)
+                        nodes[j].second *= m;
+                  std::ostringstream id;
+                  id << "pool " << k;
+                  splines.push_back(spline_t(id.str(), nodes, tachy::spline_util<real_t>::SPLINE_INIT_FROM_INCR_SLOPES));
+            }
+
+            bank_t bank("pools", splines);
+            TS_ASSERT_EQUALS(n_banks, bank.get_num_banks());
+            TS_ASSERT(bank.get_padded_size() >= n_banks);
+
+            vector_t x("x", tachy::tachy_date(date), src);
+
+            // common argument
+            bank_t::storage_t res;
+            bank.apply(x, res);
+            TS_ASSERT_EQUALS(src.size()*bank.get_padded_size(), res.size());
+            for (int t = 0; t < src.size(); ++t)
+            {
+                  for (int k = 0; k < n_banks; ++k)
+                  {
+                        const real_t y = splines[k](src[t]);
+                        TS_ASSERT_DELTA(y, res[t*bank.get_padded_size() + k], 1e-12);
+                        TS_ASSERT_DELTA(y, bank(k, src[t]), 1e-12);
+                  }
+            }
+
+            // one argument per bank
+            std::vector<vector_t> args;
+            for (int k = 0; k < n_banks; ++k)
+            {
+                  num_vector_t v(src.begin() + k, src.end());
+                  args.push_back(vector_t("arg", tachy::tachy_date(date), v));
+            }
+            bank_t copy(bank);
+            copy.apply(args, res);
+            const unsigned int n = src.size() - (n_banks - 1);
+            TS_ASSERT_EQUALS(n*bank.get_padded_size(), res.size());
+            for (int t = 0; t < n; ++t)
+            {
+                  for (int k = 0; k < n_banks; ++k)
+                        TS_ASSERT_DELTA(splines[k](src[t + k]), res[t*bank.get_padded_size() + k], 1e-12);
+            }
+
+            // splines in a bank must share their nodes
+            xy_vector_t other_nodes(pts);
+            other_nodes[3].first += 0.05;
+            splines.push_back(spline_t("other", other_nodes, tachy::spline_util<real_t>::SPLINE_INIT_FROM_INCR_SLOPES));
+            TS_ASSERT_THROWS(bank_t("bad", splines), tachy::exception);
+            TS_ASSERT_THROWS(bank_t("empty", std::vector<spline_t>()), tachy::exception);
+      }
+
+      void test_mod_uniform_index_spline_lagged_args()
+      {
+            TS_TRACE("test_mod_uniform_index_spline_lagged_args");
+
+            tachy::linear_spline_uniform_index<real_t, false> s0("base", pts, tachy::spline_util<real_t>::SPLINE_INIT_FROM_INCR_SLOPES);
+
+            cache_t cache("the_cache");
+
+            unsigned int n = src.size();
+            std::vector<cached_vector_t> modulation;
+            modulation.reserve(pts.size());
+            for (int i = 0; i < pts.size(); ++i)
+            {
+                  std::ostringstream id;
+                  id << "mod " << i + 1;
+                  modulation.push_back(cached_vector_t(id.str(), tachy::tachy_date(date), n, cache, true));
+                  real_t amp = real_t(random())/RAND_MAX;
+                  for (int k = 0; k < n; ++k)
+                        modulation[i][k] = amp*exp(-real_t(k)/n);
+            }
+
+            tachy::mod_linear_spline_uniform_index<real_t, 2U> s(s0, modulation);
+
+            vector_t x("x", tachy::tachy_date(date), src);
+            vector_t r("r", tachy::tachy_date(date), tgt);
+            tachy::time_shift t;
+
+            r = 0.6*s(x) + 0.4*s(x[t+1]);
+
+            for (int i = 0, i_max = r.size() - 1; i < i_max; ++i)
+            {
+                  const real_t y = 0.6*s(i, x[i]) + 0.4*s(i, x[i+1]);
+                  TS_ASSERT_DELTA(y, r[i], 1e-12);
+            }
+      }
+};
+
+class tachy_bilinear_surface_test : public CxxTest::TestSuite
+{
+private:
+      typedef double real_t;
+
+      typedef std::vector<real_t> num_vector_t;
+      typedef tachy::vector_engine<real_t> engine_t;
+      typedef tachy::calc_vector<real_t, engine_t, 0U> vector_t;
+      typedef tachy::calc_cache<real_t, 2U> cache_t;
+      typedef tachy::calc_vector<real_t, engine_t, cache_t::cache_level> cached_vector_t;
+      typedef tachy::bilinear_surface_uniform_index<real_t> surface_t;
+
+      num_vector_t x_nodes;
+      num_vector_t y_nodes;
+      num_vector_t z;
+      num_vector_t src_x;
+      num_vector_t src_y;
+      unsigned int date;
+
+      // straightforward bilinear interpolation, extrapolating the boundary cells
+      real_t expected(real_t x, real_t y) const
+      {
+            int i = 0;
+            while (i + 2 < x_nodes.size() && x > x_nodes[i+1])
+                  ++i;
+            int j = 0;
+            while (j + 2 < y_nodes.size() && y > y_nodes[j+1])
+                  ++j;
+            const int n_y = y_nodes.size();
+            const real_t u = (x - x_nodes[i])/(x_nodes[i+1] - x_nodes[i]);
+            const real_t v = (y - y_nodes[j])/(y_nodes[j+1] - y_nodes[j]);
+            return (1.0 - u)*(1.0 - v)*z[i*n_y + j] + u*(1.0 - v)*z[(i+1)*n_y + j] + (1.0 - u)*v*z[i*n_y + j + 1] + u*v*z[(i+1)*n_y + j + 1];
+      }
+
+public:
+
+      void setUp()
+      {
+            date = 201703;
+
+            // incentive x loan age, non-uniform in both directions
+            x_nodes.resize(5, 0.0);
+            x_nodes[0] = -0.5;
+            x_nodes[1] = 0.0;
+            x_nodes[2] = 0.25;
+            x_nodes[3] = 1.0;
+            x_nodes[4] = 2.0;
+
+            y_nodes.resize(4, 0.0);
+            y_nodes[0] = 0.0;
+            y_nodes[1] = 12.0;
+            y_nodes[2] = 36.0;
+            y_nodes[3] = 60.0;
+
+            z.resize(x_nodes.size()*y_nodes.size(), 0.0);
+            for (int k = 0; k < z.size(); ++k)
+                  z[k] = real_t(random())/RAND_MAX;
+
+            src_x.resize(501, 0.0);
+            src_y = src_x;
+            for (int i = 0; i < src_x.size(); ++i)
+            {
+                  src_x[i] = -0.75 + 3.0*real_t(random())/RAND_MAX;
+                  src_y[i] = -5.0 + 75.0*real_t(random())/RAND_MAX;
+            }
+      }
+
+      void test_surface_scalar()
+      {
+            TS_TRACE("test_surface_scalar");
+
+            surface_t f("test", x_nodes, y_nodes, z);
+
+            for (int i = 0; i < x_nodes.size(); ++i)
+                  for (int j = 0; j < y_nodes.size(); ++j)
+                        TS_ASSERT_DELTA(z[i*y_nodes.size() + j], f(x_nodes[i], y_nodes[j]), 1e-12);
+
+            for (int i = 0; i < src_x.size(); ++i)
+                  TS_ASSERT_DELTA(expected(src_x[i], src_y[i]), f(src_x[i], src_y[i]), 1e-12);
+
+            surface_t* g = f.clone();
+            for (int i = 0; i < src_x.size(); ++i)
+                  TS_ASSERT_EQUALS(f(src_x[i], src_y[i]), (*g)(src_x[i], src_y[i]));
+            delete g;
+      }
+
+      void test_surface_bad_input()
+      {
+            TS_TRACE("test_surface_bad_input");
+
+            num_vector_t z_short(z.begin(), z.end() - 1);
+            TS_ASSERT_THROWS(surface_t("bad", x_nodes, y_nodes, z_short), tachy::exception);
+
+            num_vector_t x_bad(x_nodes);
+            x_bad[2] = x_bad[1];
+            TS_ASSERT_THROWS(surface_t("bad", x_bad, y_nodes, z), tachy::exception);
+
+            num_vector_t y_bad(1, 0.0);
+            TS_ASSERT_THROWS(surface_t("bad", x_nodes, y_bad, num_vector_t(x_nodes.size(), 0.0)), tachy::exception);
+      }
+
+      void test_surface_vector()
+      {
+            TS_TRACE("test_surface_vector");
+
+            surface_t f("test", x_nodes, y_nodes, z);
+
+            vector_t x("x", tachy::tachy_date(date), src_x);
+            vector_t y("y", tachy::tachy_date(date), src_y);
+            vector_t r("r", tachy::tachy_date(date), src_x.size());
+
+            r = f(x, y);
+
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(expected(src_x[i], src_y[i]), r[i], 1e-12);
+
+            // arguments are aligned on their start dates
+            vector_t y_late("y_late", tachy::tachy_date(date) + 3, src_y);
+            vector_t r_late("r_late", tachy::tachy_date(date) + 3, src_x.size() - 3);
+            r_late = f(x, y_late);
+            for (int i = 0; i < r_late.size(); ++i)
+                  TS_ASSERT_DELTA(expected(src_x[i+3], src_y[i]), r_late[i], 1e-12);
+      }
+
+      void test_surface_cached()
+      {
+            TS_TRACE("test_surface_cached");
+
+            surface_t f("test", x_nodes, y_nodes, z);
+            cache_t cache("the_cache");
+
+            cached_vector_t x("x", tachy::tachy_date(date), src_x, cache, true);
+            cached_vector_t y("y", tachy::tachy_date(date), src_y, cache, true);
+            vector_t y0("y0", tachy::tachy_date(date), src_y);
+            vector_t r("r", tachy::tachy_date(date), src_x.size());
+
+            const std::string key = cache.get_hash_key(f.get_id() + x.get_id() + std::string("_") + y.get_id());
+            TS_ASSERT(not cache.has_key(key));
+            r = f(x, y);
+            TS_ASSERT(cache.has_key(key));
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(expected(src_x[i], src_y[i]), r[i], 1e-12);
+
+            // second evaluation is served from the cache
+            const engine_t* cached = dynamic_cast<const engine_t*>(cache[key]);
+            TS_ASSERT(cached != 0);
+            vector_t r2("r2", tachy::tachy_date(date), src_x.size());
+            r2 = f(x, y);
+            TS_ASSERT_EQUALS(cached, dynamic_cast<const engine_t*>(cache[key]));
+            for (int i = 0; i < r2.size(); ++i)
+                  TS_ASSERT_EQUALS(r[i], r2[i]);
+
+            // mixed with a level 0 argument the result is not cached
+            r = f(x, y0*2.0);
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(expected(src_x[i], 2.0*src_y[i]), r[i], 1e-12);
+      }
+};
+
+class tachy_rolling_window_test : public CxxTest::TestSuite
+{
+private:
+      typedef double real_t;
+
+      typedef std::vector<real_t> num_vector_t;
+      typedef tachy::vector_engine<real_t> engine_t;
+      typedef tachy::calc_vector<real_t, engine_t, 0U> vector_t;
+      typedef tachy::calc_cache<real_t, 1U> cache_t;
+      typedef tachy::calc_vector<real_t, engine_t, cache_t::cache_level> cached_vector_t;
+
+      num_vector_t src;
+      unsigned int date;
+
+      // the window as k lag_checked views
+      real_t window(int i, int k, int what) const
+      {
+            real_t s = 0.0;
+            real_t lo = src[i];
+            real_t hi = src[i];
+            for (int j = 0; j < k; ++j)
+            {
+                  const real_t x = src[std::max(0, i-j)];
+                  s += x;
+                  lo = std::min(lo, x);
+                  hi = std::max(hi, x);
+            }
+            return 0 == what ? s : 1 == what ? s/k : 2 == what ? lo : hi;
+      }
+
+public:
+
+      void setUp()
+      {
+            date = 201703;
+            src.resize(359, 0.0);
+            for (int i = 0; i < src.size(); ++i)
+                  src[i] = 2.0*real_t(random())/RAND_MAX - 1.0;
+      }
+
+      void test_rolling_window()
+      {
+            TS_TRACE("test_rolling_window");
+
+            vector_t x("x", tachy::tachy_date(date), src);
+            vector_t r("r", tachy::tachy_date(date), src.size());
+
+            const int windows[] = { 1, 3, 6, 12, 17 };
+            for (int w = 0; w < sizeof(windows)/sizeof(windows[0]); ++w)
+            {
+                  const int k = windows[w];
+                  r = tachy::rolling_sum(x, k);
+                  for (int i = 0; i < r.size(); ++i)
+                        TS_ASSERT_DELTA(window(i, k, 0), r[i], 1e-12);
+                  r = tachy::rolling_mean(x, k);
+                  for (int i = 0; i < r.size(); ++i)
+                        TS_ASSERT_DELTA(window(i, k, 1), r[i], 1e-12);
+                  r = tachy::rolling_min(x, k);
+                  for (int i = 0; i < r.size(); ++i)
+                        TS_ASSERT_EQUALS(window(i, k, 2), r[i]);
+                  r = tachy::rolling_max(x, k);
+                  for (int i = 0; i < r.size(); ++i)
+                        TS_ASSERT_EQUALS(window(i, k, 3), r[i]);
+            }
+
+            // windows over an expression, aligned on dates with a later vector
+            vector_t y("y", tachy::tachy_date(date) + 5, num_vector_t(src.size() - 5, 1.0));
+            vector_t u = tachy::rolling_max(2.0*x, 6) + y;
+            TS_ASSERT_EQUALS(y.get_start_date(), u.get_start_date());
+            for (int i = 0; i < u.size(); ++i)
+                  TS_ASSERT_DELTA(2.0*window(i+5, 6, 3) + 1.0, u[i], 1e-14);
+
+            // the sums are not thrown off by a large element once it is out of the window
+            num_vector_t z(src.size(), 0.0);
+            z[0] = 1.0/std::numeric_limits<real_t>::epsilon();
+            for (int i = 1; i < z.size(); ++i)
+                  z[i] = 0.125*(i%7);
+            vector_t zz("z", tachy::tachy_date(date), z);
+            r = tachy::rolling_sum(zz, 4);
+            for (int i = 4; i < r.size(); ++i)
+                  TS_ASSERT_EQUALS(z[i] + z[i-1] + z[i-2] + z[i-3], r[i]);
+
+            TS_ASSERT_THROWS(tachy::rolling_mean(x, 0), tachy::exception);
+      }
+
+      void test_rolling_window_cached()
+      {
+            TS_TRACE("test_rolling_window_cached");
+
+            cache_t cache("the_cache");
+            cached_vector_t x("x", tachy::tachy_date(date), src, cache, true);
+            vector_t r("r", tachy::tachy_date(date), src.size());
+
+            std::ostringstream key;
+            key << "RMEAN_" << 12 << '_' << x.get_id();
+            const std::string hashed_key = cache.get_hash_key(key.str());
+            TS_ASSERT(not cache.has_key(hashed_key));
+            r = tachy::rolling_mean(x, 12);
+            TS_ASSERT(cache.has_key(hashed_key));
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(window(i, 12, 1), r[i], 1e-12);
+
+            const engine_t* cached = dynamic_cast<const engine_t*>(cache[hashed_key]);
+            r = tachy::rolling_mean(x, 12) - tachy::rolling_mean(x, 3);
+            TS_ASSERT_EQUALS(cached, dynamic_cast<const engine_t*>(cache[hashed_key]));
+            for (int i = 0; i < r.size(); ++i)
+                  TS_ASSERT_DELTA(window(i, 12, 1) - window(i, 3, 1), r[i], 1e-12);
+      }
 };